@@ -26,29 +26,80 @@
 */
 
 #include "ColorMatrix.h"
+#include <intrin.h>
+
+// Coefficients of every conversion between the built-in matrices for each 
+// inputFR/outputFR combination (index inputFR|outputFR<<1), and the range 
+// only luts for each inputFR.  Filled once in VapourSynthPluginInit and only 
+// read afterwards, so instances don't have to redo the floating point setup.  
+// std_convertd keeps the unrounded matrices for the float kernels.
+static int std_convert[4][NUM_MODES][3][3];
+static double std_convertd[4][NUM_MODES][3][3];
+static int range_luts[2][2][256];
+
+// 16x16 Bayer matrix for dither=1, filled in init_tables.
+__declspec(align(16)) unsigned char dither_matrix[16][16];
+
+// dupcache hash keys (splitmix64 output), two per 16 byte block.
+__declspec(align(16)) const uint64_t hash_secret[16] = {
+    0xE220A8397B1DCDAFULL, 0x6E789E6AA1B965F4ULL, 0x06C45D188009454FULL, 0xF88BB8A8724C81ECULL,
+    0x1B39896A51A8749BULL, 0x53CB9F0C747EA2EAULL, 0x2C829ABE1F4532E1ULL, 0xC584133AC916AB3CULL,
+    0x3EE5789041C98AC3ULL, 0xF3B8488C368CB0A6ULL, 0x657EECDD3CB13D09ULL, 0xC2D326E0055BDEF6ULL,
+    0x8621A03FE0BBDB7BULL, 0x8E1F7555983AA92FULL, 0xB54E0F1600CC4D19ULL, 0x84BB3F97971D80ABULL,
+};
 
 void VS_CC ColorMatrix::ColorMatrixInit(VSMap *in, VSMap *out, void **instanceData, VSNode *node, VSCore *core, const VSAPI *vsapi) {
     ColorMatrix *d = (ColorMatrix *)*instanceData;
-    vsapi->setVideoInfo(&d->vi, 1, node);
+    VSVideoInfo vo = d->vi;
+    vo.format = d->dstFormat;
+    vsapi->setVideoInfo(&vo, 1, node);
 }
 
 void VS_CC ColorMatrix::ColorMatrixFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
     ColorMatrix *d = (ColorMatrix *)instanceData;
-    vsapi->freeNode(d->child);
-    vsapi->freeNode(d->hintClip);
+    VSNodeRef *child = d->child;
+    VSNodeRef *hintClip = d->hintClip;
+    if (d->dupCache)
+    {
+        if (d->debug)
+        {
+            fprintf(stderr, "ColorMatrix:%u:  dupcache:  %d of %d frames reused (%.1f%%)\n", 
+                GetCurrentThreadId(), d->dupHits, d->dupFrames, 
+                d->dupFrames ? 100.0*d->dupHits/d->dupFrames : 0.0);
+        }
+        for (int i=0; i<d->dupcache; ++i)
+        {
+            vsapi->freeFrame(d->dupCache[i].src);
+            vsapi->freeFrame(d->dupCache[i].dst);
+        }
+    }
     delete d;
+    vsapi->freeNode(child);
+    vsapi->freeNode(hintClip);
 }
 
-ColorMatrix::ColorMatrix(VSNodeRef *_child, const char* _mode, int _source, int _dest, int _clamp, 
-    bool _interlaced, bool _inputFR, bool _outputFR, bool _hints, const char* _d2v, bool _debug, 
-    int _threads, int _thrdmthd, int _opt, const VSAPI *vsapi, VSCore *core) : child(_child), 
-    mode(_mode), source(_source), dest(_dest), clamp(_clamp), interlaced(_interlaced), 
-    inputFR(_inputFR), outputFR(_outputFR), hints(_hints), d2v(_d2v), debug(_debug), 
-    threads(_threads), thrdmthd(_thrdmthd), opt(_opt), min_luma(16), max_luma(235),
+ColorMatrix::ColorMatrix(VSNodeRef *_child, const CM_ARGS &args, const VSAPI *vsapi, VSCore *core) : 
+    child(_child), mode(args.mode), source(args.source), dest(args.dest), clamp(args.clamp), 
+    interlaced(args.interlaced), inputFR(args.inputFR), outputFR(args.outputFR), hints(args.hints), 
+    d2v(args.d2v), debug(args.debug), threads(args.threads), thrdmthd(args.thrdmthd), opt(args.opt), 
+    writehints(args.writehints), hintcache(args.hintcache), kr(args.kr), kb(args.kb), 
+    exact(args.exact), jit(args.jit), lut(args.lut), approx(args.approx), depth(args.depth), 
+    dither(args.dither), rgb(args.rgb), ycocg(args.ycocg), nv(args.nv), v210(args.v210), 
+    gray(args.gray), dupcache(args.dupcache), min_luma(16), max_luma(235), 
     min_chroma(16), max_chroma(240)
 {
     vi = *vsapi->getVideoInfo(child);
     d2vArray = NULL;
+    hintArray = NULL;
+    jitCode = NULL;
+    uvTables = NULL;
+    dupCache = NULL;
+    dupNext = dupHits = dupFrames = 0;
+    custom_convert = NULL;
+    custom_convertd = NULL;
+    modeCFS = NULL;
+    hintClip = NULL;
+    hintFrames = hintKnown = 0;
     tids = NULL;
     thds = NULL;
     pssInfo = NULL;
@@ -56,10 +107,145 @@ ColorMatrix::ColorMatrix(VSNodeRef *_child, const char* _mode, int _source, int
     {
         throw std::runtime_error(std::string("ColorMatrix:  hints and d2v input cannot be used at the same time!"));
     }
-    if (vi.format->id != pfYUV420P8 && vi.format->id != pfCompatYUY2)
+    const bool is420 = vi.format->subSamplingW == 1 && vi.format->subSamplingH == 1;
+    const bool is4xx = vi.format->subSamplingW <= 2 && vi.format->subSamplingH == 0;
+    const bool is444 = vi.format->subSamplingW == 0 && vi.format->subSamplingH == 0;
+    fp = vi.format->sampleType == stFloat;
+    rgbin = vi.format->colorFamily == cmRGB;
+    ycocgin = vi.format->colorFamily == cmYCoCg;
+    // NV12/P010 come as a Gray8/Gray16 clip of the raw layout, the luma rows 
+    // followed by half as many rows of interleaved u,v
+    if (nv && (vi.format->colorFamily != cmGray || fp || (vi.format->bitsPerSample != 8 && 
+        vi.format->bitsPerSample != 16) || vi.height%3 || (vi.width&1)))
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  nv needs a Gray8 (NV12) or Gray16 (P010) clip of mod 2 width and mod 3 height!"));
+    }
+    // v210 comes as a Gray8 clip one v210 row (16 bytes per 6 pixels) wide
+    if (v210 && (vi.format->id != pfGray8 || (vi.width&15)))
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  v210 needs a Gray8 clip whose width is the v210 row in bytes (mod 16)!"));
+    }
+    if (nv && v210)
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  nv and v210 cannot be used at the same time!"));
+    }
+    // the rest are planar clips taken as they are
+    const bool planar = !nv && !v210 && vi.format->id != pfCompatYUY2;
+    const int inbits = vi.format->bitsPerSample;
+    if (planar && !rgbin && !ycocgin && vi.format->colorFamily != cmYUV)
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  input to filter must be YUY2, YUV, RGB, or YCoCg, Gray only with nv or v210!"));
+    }
+    if (planar && rgbin && (fp ? inbits != 32 : inbits > 16))
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  rgb input must be 8-16 bit or float (RGBS)!"));
+    }
+    if (planar && ycocgin && (fp || !is444 || inbits < 9 || inbits > 16))
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  YCoCg input must be 9-16 bit 4:4:4!"));
+    }
+    if (planar && vi.format->colorFamily == cmYUV && fp && !is444)
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  float YUV input must be 4:4:4!"));
+    }
+    if (planar && vi.format->colorFamily == cmYUV && !fp && inbits > 16)
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  YUV input must be 8-16 bit or float!"));
+    }
+    if (planar && vi.format->colorFamily == cmYUV && !fp && !is420 && !is4xx)
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  YUV input must be 4:2:0, 4:1:1, 4:2:2, or 4:4:4!"));
+    }
+    if (planar && vi.format->colorFamily == cmYUV && !fp && inbits > 8 && !is420 && !(is444 && ycocg))
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  9-16 bit YUV input must be 4:2:0, or 4:4:4 with ycocg=true!"));
+    }
+    bits = vi.format->id == pfCompatYUY2 ? 8 : v210 ? 10 : vi.format->bitsPerSample;
+    if ((rgbin || ycocgin) && (*d2v || hints || writehints || rgb || ycocg || dither))
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  d2v, hints, writehints, rgb, ycocg, and dither need YUV input!"));
+    }
+    if ((nv || v210) && (depth != bits || rgb || ycocg || dither))
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  nv and v210 output keep the input layout, rgb, ycocg, dither, and depth cannot be used!"));
+    }
+    if (rgbin && ((vi.width|vi.height)&1))
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  rgb input needs mod 2 width and height for 4:2:0 output!"));
+    }
+    if (rgbin && (depth < 8 || (depth > 16 && depth != 32)))
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  rgb input needs depth=8-16 or 32 (float)!"));
+    }
+    if (ycocgin && (depth < 8 || depth > 16))
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  YCoCg input needs depth=8-16!"));
+    }
+    if (ycocg && rgb)
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  rgb and ycocg cannot be used at the same time!"));
+    }
+    if (ycocg && (fp || !is444))
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  ycocg output needs 8-16 bit YUV 4:4:4 input!"));
+    }
+    if (ycocg && (depth < 9 || depth > 16))
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  ycocg output needs depth=9-16, Co and Cg take one bit more than the RGB inside!"));
+    }
+    if (bits > 8 && (hints || writehints))
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  hints and writehints need 8 bit input!"));
+    }
+    if (gray && (vi.format->colorFamily != cmYUV || fp || bits != 8 || depth != 8 || rgb || ycocg || dither))
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  gray output needs 8 bit planar YUV input, rgb, ycocg, dither, and depth cannot be used!"));
+    }
+    if ((rgb || depth != 8) && vi.format->subSamplingW == 2)
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  4:1:1 input only goes to 8 bit 4:1:1, rgb and depth need 4:2:0, 4:2:2, or 4:4:4!"));
+    }
+    if (rgb && vi.format->id == pfCompatYUY2)
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  rgb output needs planar input!"));
+    }
+    if (rgb && depth != 8 && depth != 16 && depth != 32)
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  rgb output needs depth=8 (RGB24), 16 (RGB48), or 32 (RGBS)!"));
+    }
+    if (!rgb && !rgbin && !ycocg && !ycocgin && depth != bits && !(bits > 8 && depth == 8) && 
+        (bits != 8 || vi.format->id == pfCompatYUY2 || depth < 9 || depth > 16))
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  depth must be 9-16 for 8 bit planar input or 8 for deeper input!"));
+    }
+    if (dither < 0 || dither > 2)
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  dither must be set to 0, 1, or 2!"));
+    }
+    if (dither && (depth >= bits || rgb || ycocg))
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  dither needs depth=8 and YUV output with 9-16 bit or float input!"));
+    }
+    if ((depth != bits || rgb || ycocg) && writehints)
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  writehints needs 8 bit YUV output!"));
+    }
+    // putHint writes 64 bytes into the first luma row
+    if (writehints && vi.width*(vi.format->id == pfCompatYUY2 ? 2 : 1) < 64)
     {
-        throw std::runtime_error(std::string("ColorMatrix:  input to filter must be YV12 or YUY2!"));
+        throw std::runtime_error(std::string("ColorMatrix:  writehints needs a luma row of at least 64 bytes!"));
     }
+    if (rgb)
+        dstFormat = vsapi->registerFormat(cmRGB, depth == 32 ? stFloat : stInteger, depth, 0, 0, core);
+    else if (rgbin)
+        dstFormat = vsapi->registerFormat(cmYUV, depth == 32 ? stFloat : stInteger, depth, 1, 1, core);
+    else if (ycocg || ycocgin)
+        dstFormat = vsapi->registerFormat(ycocg ? cmYCoCg : cmYUV, stInteger, depth, 0, 0, core);
+    else if (gray)
+        dstFormat = vsapi->registerFormat(cmGray, stInteger, 8, 0, 0, core);
+    else
+        dstFormat = depth == bits ? vi.format : vsapi->registerFormat(cmYUV, stInteger, depth, 
+            vi.format->subSamplingW, vi.format->subSamplingH, core);
     if (clamp < 0 || clamp > 3)
     {
         throw std::runtime_error(std::string("ColorMatrix:  clamp must be set to 0, 1, 2, or 3!"));
@@ -72,40 +258,79 @@ ColorMatrix::ColorMatrix(VSNodeRef *_child, const char* _mode, int _source, int
     {
         throw std::runtime_error(std::string("ColorMatrix:  threads must greater than or equal to 0!"));
     }
-    if ((vi.format->id == pfCompatYUY2 && threads > vi.height) || (vi.format->id == pfYUV420P8 && threads > vi.height/2))
+    // slices are cut on chroma lines, rgb input is cut on the output ones
+    const int sliceh = nv ? vi.height/3 : vi.height>>(rgbin ? 1 : vi.format->subSamplingH);
+    if (threads > sliceh)
     {
-        throw std::runtime_error(std::string("ColorMatrix:  cannot use more than %d threads on this clip!",
-            vi.format->id == pfCompatYUY2 ? vi.height : vi.height/2));
+        // VS2010 only has the long long to_string overload
+        throw std::runtime_error(std::string("ColorMatrix:  cannot use more than ") + 
+            std::to_string((long long)sliceh) + " threads on this clip!");
     }
     if (thrdmthd < 0 || thrdmthd > 1)
     {
         throw std::runtime_error(std::string("ColorMatrix:  thrdmthd must be set to 0 or 1!"));
     }
-    long cpu = CPUF_FPU | CPUF_MMX | CPUF_INTEGER_SSE | CPUF_SSE | CPUF_SSE2;
+    // the Sierra-lite error is diffused down the whole frame, so it cannot be 
+    // cut into slices (threads=0 picks one per processor)
+    if (dither == 2 && threads != 1)
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  dither=2 needs threads=1!"));
+    }
+    if (hintcache < 0 || hintcache > 2)
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  hintcache must be set to 0, 1, or 2!"));
+    }
+    if (hintcache && !hints)
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  hintcache needs hints=true!"));
+    }
+    if (lut < 0 || lut > 2)
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  lut must be set to 0, 1, or 2!"));
+    }
+    if (dupcache < 0 || dupcache > 16)
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  dupcache must be set to 0-16!"));
+    }
+    if (approx && (exact || jit))
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  approx cannot be combined with exact or jit!"));
+    }
+    cpu = CPUF_FPU | CPUF_MMX | CPUF_INTEGER_SSE | CPUF_SSE | CPUF_SSE2;
     if (opt != 3)
     {
         if (opt == 0) cpu &= ~0x2C;
         else if (opt == 1) { cpu &= ~0x28; cpu |= 0x04; }
         else if (opt == 2) cpu |= 0x2C;
     }
-    css.cpu = cpu;
-    css.debug = debug;
+    else cpu |= cpu_extensions();
     if (*mode) 
     {
         checkMode(mode, vsapi);
     }
     else
     {
-        if (source < 0 || source > 3)
-            throw std::runtime_error(std::string("ColorMatrix:  source must be set to 0, 1, 2, or 3!"));
-        if (dest < 0 || dest > 3)
-            throw std::runtime_error(std::string("ColorMatrix:  dest must be set to 0, 1, 2, or 3!"));
+        if (source < 0 || source >= NUM_MATRICES)
+            throw std::runtime_error(std::string("ColorMatrix:  source must be set to 0, 1, 2, 3, 4, or 5!"));
+        if (dest < 0 || dest >= NUM_MATRICES)
+            throw std::runtime_error(std::string("ColorMatrix:  dest must be set to 0, 1, 2, 3, 4, or 5!"));
+    }
+    if ((source == MATRIX_CUSTOM || dest == MATRIX_CUSTOM) && 
+        (kr <= 0.0 || kb <= 0.0 || kr+kb >= 1.0))
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  the custom matrix needs kr > 0, kb > 0, and kr+kb < 1!"));
+    }
+    if ((*d2v || hints) && dest == MATRIX_CUSTOM)
+    {
+        throw std::runtime_error(std::string("ColorMatrix:  the custom matrix cannot be the destination with hints or d2v input!"));
     }
-    if (source == dest && inputFR == outputFR && !(*d2v) && !hints)
+    if (source == dest && inputFR == outputFR && depth == bits && !rgb && !rgbin && !ycocg && !ycocgin && !gray && !(*d2v) && !hints)
     {
-        throw std::runtime_error(std::string("ColorMatrix:  source and dest or inputFR and outputFR must have different values!"));
+        throw std::runtime_error(std::string("ColorMatrix:  source and dest, inputFR and outputFR, or depth must have different values!"));
     }
-    modei = source == dest ? -2 : source*4+dest;
+    modei = source == dest && !rgb && !rgbin && !ycocg && !ycocgin ? -2 : MODE(source,dest);
+    // neutral chroma stays 128 under any clamp, so only luma needs a copy
+    neutral = vi.format->colorFamily == cmYUV && bits == 8 && depth == 8 && !rgb && !gray;
     if (debug)
     {
         fprintf(stderr, "ColorMatrix:%u:  version %s (%s)\n", 
@@ -115,38 +340,25 @@ ColorMatrix::ColorMatrix(VSNodeRef *_child, const char* _mode, int _source, int
     {
         int temp;
         //child->SetCacheHints(CACHE_RANGE, 1);
-        hintClip = child;
+        hintClip = vsapi->cloneNodeRef(child);
+        hintFrames = vi.numFrames;
         const VSFrameRef *pv = vsapi->getFrame(0, child, NULL, 0);
         //AvisynthCompat::PVideoFrame pv = child->GetFrame(0, env);
         getHint(vsapi->getReadPtr(pv, 0), temp);
+        vsapi->freeFrame(pv);
         if (temp == -1)
             throw std::runtime_error(std::string("ColorMatrix:  no hints detected in stream with hints=true!"));
-    }
-    //else child->SetCacheHints(CACHE_NOTHING, 0);
-    if (clamp & 1) // clip input to 16-235/16-240 range
-    {
-        VSPlugin *findPlugin = vsapi->getPluginId("com.vapoursynth.avisynth", core);
-        if (!findPlugin)
+        if (hintcache)
         {
-            throw std::runtime_error(std::string("Avisynth filters are not present."));
+            hintArray = (unsigned char *)malloc(hintFrames*sizeof(unsigned char));
+            if (!hintArray)
+                throw std::runtime_error(std::string("ColorMatrix:  malloc failure (hintArray)!"));
+            memset((void*)hintArray, HINT_UNKNOWN, hintFrames*sizeof(unsigned char));
+            hintArray[0] = temp;
+            hintKnown = 1;
         }
-        VSMap *args = vsapi->newMap();
-        vsapi->propSetNode(args, "c1", child, 0);
-        VSMap *ret = vsapi->invoke(findPlugin, "Limiter", args);
-        child = vsapi->propGetNode(ret, "clip", 0, 0);
-        //try
-        //{
-        //child = env->Invoke("Limiter", child).AsClip();
-        //}
-        //catch (AvisynthCompat::IScriptEnvironment::NotFound)
-        //{
-        //    env->ThrowError("ColorMatrix:  error invoking Limiter (not found)!");
-        //}
-        //catch (AvisynthCompat::AvisynthError e)
-        //{
-        //    env->ThrowError("ColorMatrix:  avisynth error invoking Limiter (%s)!", e.msg);
-        //}
     }
+    //else child->SetCacheHints(CACHE_NOTHING, 0);
     if (interlaced)
     {
         //TODO: look into this
@@ -195,7 +407,28 @@ ColorMatrix::ColorMatrix(VSNodeRef *_child, const char* _mode, int _source, int
         else if (temp == -8) throw std::runtime_error(std::string("ColorMatrix:  malloc failure (d2varray)!"));
         else if (temp == -9) throw std::runtime_error(std::string("ColorMatrix:  not all frames had valid values after d2v parsing!"));
     }
-    calc_coefficients(vsapi);
+    if (source == MATRIX_CUSTOM || dest == MATRIX_CUSTOM)
+    {
+        custom_convert = (int(*)[3][3])malloc(sizeof(std_convert[0]));
+        if (!custom_convert)
+            throw std::runtime_error(std::string("ColorMatrix:  malloc failure (custom_convert)!"));
+        custom_convertd = (double(*)[3][3])malloc(sizeof(std_convertd[0]));
+        if (!custom_convertd)
+            throw std::runtime_error(std::string("ColorMatrix:  malloc failure (custom_convertd)!"));
+        memcpy(custom_convert, std_convert[inputFR|(outputFR<<1)], sizeof(std_convert[0]));
+        memcpy(custom_convertd, std_convertd[inputFR|(outputFR<<1)], sizeof(std_convertd[0]));
+        calc_coefficients(custom_convert, custom_convertd, inputFR, outputFR, kr, kb, true);
+        yuv_convert = custom_convert;
+        yuv_convertd = custom_convertd;
+    }
+    else
+    {
+        yuv_convert = std_convert[inputFR|(outputFR<<1)];
+        yuv_convertd = std_convertd[inputFR|(outputFR<<1)];
+    }
+    if (rgb || rgbin || ycocg || ycocgin)
+        calc_rgb_coefficients(yuv_coeffd, rgb_convertd, kr, kb);
+    select_kernels();
     if (threads == 0)
     {
         threads = get_num_processors();
@@ -210,35 +443,37 @@ ColorMatrix::ColorMatrix(VSNodeRef *_child, const char* _mode, int _source, int
     pssInfo = (PS_INFO**)malloc(threads*sizeof(PS_INFO*));
     if (!tids || !thds || !pssInfo)
         throw std::runtime_error(std::string("ColorMatrix:  malloc failure (thread storage)!"));
-    double c0y, c1y, c0uv, c1uv;
-    if (inputFR)
-    {
-        c0y = 219.0/255.0;
-        c1y = 16.0+0.5;
-        c0uv = 224.0/255.0;
-    }
-    else
+    if (dupcache)
     {
-        c0y = 255.0/219.0;
-        c1y = -16.0*255.0/219.0+0.5;
-        c0uv = 255.0/224.0;
+        dupCache = (DupEntry*)malloc(dupcache*sizeof(DupEntry));
+        if (!dupCache)
+            throw std::runtime_error(std::string("ColorMatrix:  malloc failure (dupCache)!"));
+        memset(dupCache, 0, dupcache*sizeof(DupEntry));
     }
-    c1uv = -128.0*c0uv+128.0+0.5;
     for (int i=0; i<threads; ++i)
     {
         pssInfo[i] = (PS_INFO*)malloc(sizeof(PS_INFO));
-        pssInfo[i]->cs = &css;
+        pssInfo[i]->cs = &modeCFS[NUM_MODES];
+        pssInfo[i]->hint = -1;
         pssInfo[i]->finished = 0;
-        for (int j=0; j<256; ++j)
+        pssInfo[i]->uvval = vs_aligned_malloc<int>(((vi.width+31)&~31)*sizeof(int), 16);
+        if (!pssInfo[i]->uvval)
+            throw std::runtime_error(std::string("ColorMatrix:  malloc failure (uvval)!"));
+        pssInfo[i]->dith = NULL;
+        if (depth < bits || rgb)
         {
-            pssInfo[i]->ylut[j] = CB((int)(j*c0y+c1y));
-            pssInfo[i]->uvlut[j] = CB((int)(j*c0uv+c1uv));
+            // three sum rows plus current/next error rows for each plane, 
+            // more than the two chroma rows rgb needs
+            const int w = (vi.width+31)&~31;
+            pssInfo[i]->dith = vs_aligned_malloc<int>((3*w+6*(w+2))*sizeof(int), 16);
+            if (!pssInfo[i]->dith)
+                throw std::runtime_error(std::string("ColorMatrix:  malloc failure (dith)!"));
         }
+        pssInfo[i]->ylut = range_luts[inputFR][0];
+        pssInfo[i]->uvlut = range_luts[inputFR][1];
         pssInfo[i]->jobFinished = CreateEvent(NULL, TRUE, TRUE, NULL);
         pssInfo[i]->nextJob = CreateEvent(NULL, TRUE, FALSE, NULL);
-        thds[i] = vi.format->id == pfCompatYUY2 ? 
-            (HANDLE)_beginthreadex(0,0,&processFrame_YUY2,(void*)(pssInfo[i]),0,&tids[i]) :
-        (HANDLE)_beginthreadex(0,0,&processFrame_YV12,(void*)(pssInfo[i]),0,&tids[i]);
+        thds[i] = (HANDLE)_beginthreadex(0,0,&processFrame,(void*)(pssInfo[i]),0,&tids[i]);
     }
 }
 
@@ -260,513 +495,2930 @@ ColorMatrix::~ColorMatrix()
         {
             CloseHandle(pssInfo[i]->jobFinished);
             CloseHandle(pssInfo[i]->nextJob);
+            vs_aligned_free(pssInfo[i]->uvval);
+            vs_aligned_free(pssInfo[i]->dith);
             free(pssInfo[i]);
         }
         free(pssInfo);
     }
     if (d2vArray) free(d2vArray);
+    if (hintArray) free(hintArray);
+    if (jitCode)
+    {
+#ifdef _M_X64
+        RtlDeleteFunctionTable(jitFuncs);
+#endif
+        VirtualFree(jitCode, 0, MEM_RELEASE);
+    }
+    if (uvTables) free(uvTables);
+    if (custom_convert) free(custom_convert);
+    if (custom_convertd) free(custom_convertd);
+    if (modeCFS) vs_aligned_free(modeCFS);
+    if (dupCache) free(dupCache);
 }
 
 int num_processors()
 {
     int pcount = 0;
-    DWORD p_aff, s_aff;
+    DWORD_PTR p_aff, s_aff;
     GetProcessAffinityMask(GetCurrentProcess(), &p_aff, &s_aff);
     for(; p_aff != 0; p_aff>>=1) 
         pcount += (p_aff&1);
     return pcount;
 }
 
+// Only the extensions that have kernels beyond sse2 are actually probed, 
+// opt=3 assumes the rest like before.
+int64_t cpu_extensions()
+{
+    int info[4];
+    int64_t flags = 0;
+#ifdef CM_AVX2
+    __cpuid(info, 0);
+    const int maxid = info[0];
+#endif
+    __cpuid(info, 1);
+    if (info[2]&(1<<9))
+        flags |= CPUF_SSSE3;
+#ifdef CM_AVX2
+    // avx2, fma3, and f16c also need the os to save the ymm registers (osxsave + xcr0)
+    if ((info[2]&(1<<27)) && (info[2]&(1<<28)) && (_xgetbv(0)&6) == 6)
+    {
+        if (info[2]&(1<<12))
+            flags |= CPUF_FMA3;
+        if (info[2]&(1<<29))
+            flags |= CPUF_F16C;
+        if (maxid < 7)
+            return flags;
+        __cpuidex(info, 7, 0);
+        if (info[1]&(1<<5))
+            flags |= CPUF_AVX2;
+    }
+#endif
+    return flags;
+}
+
 int ColorMatrix::get_num_processors() 
 {
     static const int pcount = num_processors();
     return pcount;
 }
 
-unsigned __stdcall processFrame_YUY2(void *ps)
+// Clamps width bytes of a row to 16-235, or to 16-240 for chroma.
+static void limit_row_C(const unsigned char *srcp, unsigned char *dstp, int width, bool chroma)
+{
+    const int hi = chroma ? 240 : 235;
+    for (int x=0; x<width; ++x)
+        dstp[x] = srcp[x] < 16 ? 16 : srcp[x] > hi ? hi : srcp[x];
+}
+
+unsigned __stdcall processFrame(void *ps)
 {
     const PS_INFO *pss = (PS_INFO*)ps;
-    const bool debug = pss->cs->debug;
     while (true)
     {
         WaitForSingleObject(pss->nextJob,INFINITE);
         if (pss->finished)
             return 0;
-        const unsigned char *srcp = pss->srcp;
-        const int src_pitch = pss->src_pitch;
-        const int height = pss->height;
-        const int width = pss->width;
-        unsigned char *dstp = pss->dstp;
-        const int dst_pitch = pss->dst_pitch;
-        if (pss->cs->modef == -2)
+        const CFS *cs = pss->cs;
+        if (cs->debug)
         {
-            if (debug)
+            if (cs->modef == -2)
             {
-                fprintf(stderr, "ColorMatrix:%u:  frame %d:  YUY2 range conversion only.\n", 
-                    GetCurrentThreadId(), pss->cs->n);
+                fprintf(stderr, "ColorMatrix:%u:  frame %d:  %s range conversion only.\n", 
+                    GetCurrentThreadId(), pss->n, cs->format);
             }
-            const int *ylut = pss->ylut;
-            const int *uvlut = pss->uvlut;
-            for (int h=0; h<height; ++h)
+            else
             {
-                for (int x=0; x<width; x+=4)
-                {
-                    dstp[x] = ylut[srcp[x]];
-                    dstp[x+1] = uvlut[srcp[x+1]];
-                    dstp[x+2] = ylut[srcp[x+2]];
-                    dstp[x+3] = uvlut[srcp[x+3]];
-                }
-                srcp += src_pitch;
-                dstp += dst_pitch;
+                fprintf(stderr, "ColorMatrix:%u:  frame %d:  using %s %s->%s conversion (%s).\n", 
+                    GetCurrentThreadId(), pss->n, cs->format, MTS(MODE_SRC(cs->modef)), 
+                    MTS(MODE_DST(cs->modef)), cs->procName);
             }
         }
-        else
+        cs->proc(ps);
+        if (pss->hint >= 0)
+            putHint(pss->dstp, pss->hint, cs->limitHints);
+        ResetEvent(pss->nextJob);
+        SetEvent(pss->jobFinished);
+    }
+}
+
+// Whether every sample of a chroma plane is 128.  u = v = 0 turns every mode 
+// without a range change into an identity.
+bool neutral_chroma_C(const unsigned char *srcp, int pitch, int width, int height)
+{
+    for (int y=0; y<height; ++y)
+    {
+        int t = 0;
+        for (int x=0; x<width; ++x)
+            t |= srcp[x]^128;
+        if (t)
+            return false;
+        srcp += pitch;
+    }
+    return true;
+}
+
+// xxh3 style accumulation for dupcache, every 16 byte block adds the 32x32 
+// bit products of its key mixed halves and itself with the halves swapped.  
+// The key rotates along the row and with the row number, a short tail is 
+// zero padded.  Frames are compared byte for byte on a match, so this only 
+// has to spread well, not resist collisions.
+static inline void hash_block_C(const unsigned char *p, const uint64_t *key, uint64_t acc[2])
+{
+    uint64_t d[2];
+    memcpy(d, p, 16);
+    for (int l=0; l<2; ++l)
+    {
+        const uint64_t dk = d[l]^key[l];
+        acc[l] += (dk&0xFFFFFFFF)*(dk>>32);
+        acc[l^1] += d[l];
+    }
+}
+
+void hash_plane_C(const unsigned char *srcp, int pitch, int width, int height, uint64_t acc[2])
+{
+    for (int y=0; y<height; ++y)
+    {
+        int x = 0;
+        for (; x+16<=width; x+=16)
+            hash_block_C(srcp+x, hash_secret+2*(((x>>4)+y)&7), acc);
+        if (x < width)
         {
-            if (debug)
+            unsigned char t[16] = { 0 };
+            memcpy(t, srcp+x, width-x);
+            hash_block_C(t, hash_secret+2*(((x>>4)+y)&7), acc);
+        }
+        srcp += pitch;
+    }
+}
+
+// Saturating narrow written as a min/max pair so that compilers can map it 
+// onto packus/umin/umax style instructions.
+static inline unsigned char sat8(int v)
+{
+    v = v < 0 ? 0 : v;
+    return (unsigned char)(v > 255 ? 255 : v);
+}
+
+static inline int clampi(int v, int lo, int hi)
+{
+    v = v < lo ? lo : v;
+    return v > hi ? hi : v;
+}
+
+// The YV12/YUY2 kernels take CLAMP as a template parameter, the clamps are 
+// only applied when it is set.  The output clamps cover the 0-255 saturation.
+template <bool CLAMP>
+void range_YUY2_C(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned char *srcp = pss->srcp;
+    const int src_pitch = pss->src_pitch;
+    const int height = pss->height;
+    const int width = pss->width;
+    unsigned char *dstp = pss->dstp;
+    const int dst_pitch = pss->dst_pitch;
+    const int *ylut = pss->ylut;
+    const int *uvlut = pss->uvlut;
+    const int inmin_Y = cs->inmin[0], inmax_Y = cs->inmax[0];
+    const int inmin_UV = cs->inmin[1], inmax_UV = cs->inmax[1];
+    const int outmin_Y = cs->outmin[0], outmax_Y = cs->outmax[0];
+    const int outmin_UV = cs->outmin[1], outmax_UV = cs->outmax[1];
+    for (int h=0; h<height; ++h)
+    {
+        for (int x=0; x<width; x+=4)
+        {
+            if (CLAMP)
             {
-                fprintf(stderr, "ColorMatrix:%u:  frame %d:  using YUY2 %s conversion.\n", 
-                    GetCurrentThreadId(), pss->cs->n, CTS2(pss->cs->modef));
+                dstp[x] = clampi(ylut[clampi(srcp[x], inmin_Y, inmax_Y)], outmin_Y, outmax_Y);
+                dstp[x+1] = clampi(uvlut[clampi(srcp[x+1], inmin_UV, inmax_UV)], outmin_UV, outmax_UV);
+                dstp[x+2] = clampi(ylut[clampi(srcp[x+2], inmin_Y, inmax_Y)], outmin_Y, outmax_Y);
+                dstp[x+3] = clampi(uvlut[clampi(srcp[x+3], inmin_UV, inmax_UV)], outmin_UV, outmax_UV);
             }
-            const int c1 = pss->cs->c1;
-            const int c2 = pss->cs->c2;
-            const int c3 = pss->cs->c3; 
-            const int c4 = pss->cs->c4;
-            const int c5 = pss->cs->c5;
-            const int c6 = pss->cs->c6;
-            const int c7 = pss->cs->c7;
-            const int c8 = pss->cs->c8;
-            for (int h=0; h<height; ++h) 
+            else
             {
-                for (int x=0; x<width; x+=4)
-                {
-                    const int u = srcp[x+1]-128;
-                    const int v = srcp[x+3]-128;
-                    const int uvval = c2*u + c3*v + c8;
-                    dstp[x] = CB((c1*srcp[x] + uvval) >> 16);
-                    dstp[x+1] = CB((c4*u + c5*v + 8421376) >> 16);
-                    dstp[x+2] = CB((c1*srcp[x+2] + uvval) >> 16);
-                    dstp[x+3] = CB((c6*u + c7*v + 8421376) >> 16);
-                }
-                srcp += src_pitch;
-                dstp += dst_pitch;
+                dstp[x] = ylut[srcp[x]];
+                dstp[x+1] = uvlut[srcp[x+1]];
+                dstp[x+2] = ylut[srcp[x+2]];
+                dstp[x+3] = uvlut[srcp[x+3]];
             }
         }
-        ResetEvent(pss->nextJob);
-        SetEvent(pss->jobFinished);
+        srcp += src_pitch;
+        dstp += dst_pitch;
     }
 }
 
-unsigned _stdcall processFrame_YV12(void *ps)
+// RANGE is true when c1 != 65536, otherwise c1*Y folds down to Y<<16.  The 
+// -128 chroma offset is folded into the biases.
+template <bool RANGE, bool CLAMP>
+void conv_YUY2_C(void *ps)
 {
     const PS_INFO *pss = (PS_INFO*)ps;
-    const long cpu = pss->cs->cpu;
-    const bool debug = pss->cs->debug;
-    while (true)
+    const CFS *cs = pss->cs;
+    const unsigned char * __restrict srcp = pss->srcp;
+    const int src_pitch = pss->src_pitch;
+    const int height = pss->height;
+    const int pairs = pss->width>>2;
+    unsigned char * __restrict dstp = pss->dstp;
+    const int dst_pitch = pss->dst_pitch;
+    const int c1 = pss->cs->c1;
+    const int c2 = pss->cs->c2;
+    const int c3 = pss->cs->c3; 
+    const int c4 = pss->cs->c4;
+    const int c5 = pss->cs->c5;
+    const int c6 = pss->cs->c6;
+    const int c7 = pss->cs->c7;
+    const int bias_Y = pss->cs->c8-128*(c2+c3);
+    const int bias_U = 8421376-128*(c4+c5);
+    const int bias_V = 8421376-128*(c6+c7);
+    const int inmin_Y = cs->inmin[0], inmax_Y = cs->inmax[0];
+    const int inmin_UV = cs->inmin[1], inmax_UV = cs->inmax[1];
+    const int outmin_Y = cs->outmin[0], outmax_Y = cs->outmax[0];
+    const int outmin_UV = cs->outmin[1], outmax_UV = cs->outmax[1];
+    for (int h=0; h<height; ++h) 
     {
-        WaitForSingleObject(pss->nextJob,INFINITE);
-        if (pss->finished)
-            return 0;
-        if (pss->cs->modef == -2)
+        for (int x=0; x<pairs; ++x)
         {
-            if (debug)
-            {
-                fprintf(stderr,"ColorMatrix:%u:  frame %d:  YV12 range conversion only.\n", 
-                    GetCurrentThreadId(), pss->cs->n);
-            }
-            for (int b=0; b<3; ++b)
+            const int y0 = CLAMP ? clampi(srcp[4*x], inmin_Y, inmax_Y) : srcp[4*x];
+            const int u = CLAMP ? clampi(srcp[4*x+1], inmin_UV, inmax_UV) : srcp[4*x+1];
+            const int y1 = CLAMP ? clampi(srcp[4*x+2], inmin_Y, inmax_Y) : srcp[4*x+2];
+            const int v = CLAMP ? clampi(srcp[4*x+3], inmin_UV, inmax_UV) : srcp[4*x+3];
+            const int uvval = c2*u + c3*v + bias_Y;
+            const int ny0 = ((RANGE ? c1*y0 : y0<<16) + uvval) >> 16;
+            const int nu = (c4*u + c5*v + bias_U) >> 16;
+            const int ny1 = ((RANGE ? c1*y1 : y1<<16) + uvval) >> 16;
+            const int nv = (c6*u + c7*v + bias_V) >> 16;
+            dstp[4*x] = CLAMP ? clampi(ny0, outmin_Y, outmax_Y) : sat8(ny0);
+            dstp[4*x+1] = CLAMP ? clampi(nu, outmin_UV, outmax_UV) : sat8(nu);
+            dstp[4*x+2] = CLAMP ? clampi(ny1, outmin_Y, outmax_Y) : sat8(ny1);
+            dstp[4*x+3] = CLAMP ? clampi(nv, outmin_UV, outmax_UV) : sat8(nv);
+        }
+        srcp += src_pitch;
+        dstp += dst_pitch;
+    }
+}
+
+template <bool CLAMP>
+void range_YV12_C(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    for (int b=0; b<3; ++b)
+    {
+        const unsigned char *srcp = b == 0 ? pss->srcp :
+            b == 1 ? pss->srcpU : pss->srcpV;
+        unsigned char *dstp = b == 0 ? pss->dstp :
+            b == 1 ? pss->dstpU : pss->dstpV;
+        const int *plut = b == 0 ? pss->ylut : pss->uvlut;
+        const int inmin = cs->inmin[b ? 1 : 0], inmax = cs->inmax[b ? 1 : 0];
+        const int outmin = cs->outmin[b ? 1 : 0], outmax = cs->outmax[b ? 1 : 0];
+        if (b == 0)
+        {
+            // luma lines come in pairs, src_pitch may be scaled by thrdmthd=1
+            const int src_pitch = pss->src_pitch;
+            const int src_pitchR = pss->src_pitchR;
+            const int dst_pitch = pss->dst_pitch;
+            const int dst_pitchR = pss->dst_pitchR;
+            const int width = pss->width;
+            const int height = pss->height;
+            for (int h=0; h<height; h+=2)
             {
-                const unsigned char *srcp = b == 0 ? pss->srcp :
-                    b == 1 ? pss->srcpU : pss->srcpV;
-                unsigned char *dstp = b == 0 ? pss->dstp :
-                    b == 1 ? pss->dstpU : pss->dstpV;
-                int src_pitch, dst_pitch, width, height;
-                if (b == 0)
+                for (int x=0; x<width; ++x)
                 {
-                    src_pitch = pss->src_pitch;
-                    dst_pitch = pss->dst_pitch;
-                    width = pss->width;
-                    height = pss->height;
-                }
-                else
-                {
-                    src_pitch = pss->src_pitchUV;
-                    dst_pitch = pss->dst_pitchUV;
-                    width = pss->width>>1;
-                    height = pss->height>>1;
-                }
-                const int *plut = b == 0 ? pss->ylut : pss->uvlut;
-                for (int h=0; h<height; ++h)
-                {
-                    for (int x=0; x<width; ++x)
+                    if (CLAMP)
+                    {
+                        dstp[x] = clampi(plut[clampi(srcp[x], inmin, inmax)], outmin, outmax);
+                        dstp[x+dst_pitchR] = clampi(plut[clampi(srcp[x+src_pitchR], inmin, inmax)], 
+                            outmin, outmax);
+                    }
+                    else
                     {
                         dstp[x] = plut[srcp[x]];
+                        dstp[x+dst_pitchR] = plut[srcp[x+src_pitchR]];
                     }
-                    srcp += src_pitch;
-                    dstp += dst_pitch;
                 }
+                srcp += src_pitch<<1;
+                dstp += dst_pitch<<1;
             }
         }
         else
         {
-            const unsigned char *srcp = pss->srcp;
-            unsigned char *dstp = pss->dstp;
-            const int widtha = pss->widtha;
-            const int src_pitch = pss->src_pitch;
-            const int dst_pitch = pss->dst_pitch;
-            const int c1 = pss->cs->c1;
-            if (c1 == 65536 && (cpu&CPUF_SSE2) && 
-                !((int(srcp)|int(dstp)|widtha|dst_pitch|src_pitch)&15))
-            {
-                if (debug)
-                {
-                    fprintf(stderr,"ColorMatrix:%u:  frame %d:  using YV12 %s conversion (SSE2).\n", 
-                        GetCurrentThreadId(), pss->cs->n, CTS2(pss->cs->modef));
-                }
-                (find_YV12_SIMD(pss->cs->modef, true))(ps);
-            }
-            else if (c1 == 65536 && (cpu&CPUF_MMX) && !(widtha&7))
-            {
-                if (debug)
-                {
-                    fprintf(stderr,"ColorMatrix:%u:  frame %d:  using YV12 %s conversion (MMX).\n", 
-                        GetCurrentThreadId(), pss->cs->n, CTS2(pss->cs->modef));
-                }
-                (find_YV12_SIMD(pss->cs->modef, false))(ps);
-            }
-            else
+            const int src_pitch = pss->src_pitchUV;
+            const int dst_pitch = pss->dst_pitchUV;
+            const int width = pss->width>>1;
+            const int height = pss->height>>1;
+            for (int h=0; h<height; ++h)
             {
-                if (debug)
-                {
-                    fprintf(stderr,"ColorMatrix:%u:  frame %d:  using YV12 %s conversion (C).\n", 
-                        GetCurrentThreadId(), pss->cs->n, CTS2(pss->cs->modef));
-                }
-                const unsigned char *srcpU = pss->srcpU;
-                const unsigned char *srcpV = pss->srcpV;
-                const unsigned char *srcpn = pss->srcpn;
-                const int src_pitchUV = pss->src_pitchUV;
-                const int height = pss->height;
-                const int width = pss->width;
-                unsigned char *dstpU = pss->dstpU;
-                unsigned char *dstpV = pss->dstpV;
-                unsigned char *dstpn = pss->dstpn;
-                const int dst_pitchUV = pss->dst_pitchUV;
-                const int c2 = pss->cs->c2;
-                const int c3 = pss->cs->c3; 
-                const int c4 = pss->cs->c4;
-                const int c5 = pss->cs->c5;
-                const int c6 = pss->cs->c6;
-                const int c7 = pss->cs->c7;
-                const int c8 = pss->cs->c8;
-                for (int h=0; h<height; h+=2)
+                for (int x=0; x<width; ++x)
                 {
-                    for (int x=0; x<width; x+=2)
-                    {
-                        const int u = srcpU[x>>1]-128;
-                        const int v = srcpV[x>>1]-128;
-                        const int uvval = c2*u + c3*v + c8;
-                        dstp[x] = CB((c1*srcp[x] + uvval) >> 16);
-                        dstp[x+1] = CB((c1*srcp[x+1] + uvval) >> 16);
-                        dstpn[x] = CB((c1*srcpn[x] + uvval) >> 16);
-                        dstpn[x+1] = CB((c1*srcpn[x+1] + uvval) >> 16);
-                        dstpU[x>>1] = CB((c4*u + c5*v + 8421376) >> 16);
-                        dstpV[x>>1] = CB((c6*u + c7*v + 8421376) >> 16);
-                    }
-                    srcp += src_pitch<<1;
-                    srcpn += src_pitch<<1;
-                    dstp += dst_pitch<<1;
-                    dstpn += dst_pitch<<1;
-                    srcpU += src_pitchUV;
-                    srcpV += src_pitchUV;
-                    dstpU += dst_pitchUV;
-                    dstpV += dst_pitchUV;
+                    dstp[x] = CLAMP ? clampi(plut[clampi(srcp[x], inmin, inmax)], outmin, outmax) : 
+                        plut[srcp[x]];
                 }
+                srcp += src_pitch;
+                dstp += dst_pitch;
             }
         }
-        ResetEvent(pss->nextJob);
-        SetEvent(pss->jobFinished);
     }
 }
 
-const VSFrameRef *VS_CC ColorMatrix::ColorMatrixGetFrame(int n, int activationReason, void **instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
-    ColorMatrix *d = (ColorMatrix *)*instanceData;
-    return d->getFrame(n, activationReason, frameCtx, core, vsapi);
+// Chroma contribution to luma for one chroma line, stored once per luma 
+// sample (SSW is the horizontal chroma subsampling) so that the luma loops 
+// below are plain unit stride loops.  lo/hi is the chroma input clamp.
+template <int SSW, bool CLAMP>
+static void uvval_row_C(const unsigned char * __restrict srcpU, 
+    const unsigned char * __restrict srcpV, int * __restrict uvval, int c2, int c3, 
+    int bias, int widthUV, int lo, int hi)
+{
+    for (int x=0; x<widthUV; ++x)
+    {
+        const int u = CLAMP ? clampi(srcpU[x], lo, hi) : srcpU[x];
+        const int v = CLAMP ? clampi(srcpV[x], lo, hi) : srcpV[x];
+        const int t = c2*u + c3*v + bias;
+        uvval[x<<SSW] = t;
+        if (SSW)
+            uvval[(x<<SSW)+1] = t;
+    }
 }
 
-const VSFrameRef *ColorMatrix::getFrame(int n, int activationReason, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi)
+// clip holds the luma in min/max and out min/max.
+template <bool RANGE, bool CLAMP>
+static void luma_row_C(const unsigned char * __restrict srcp, unsigned char * __restrict dstp, 
+    const int * __restrict uvval, int c1, int width, const int *clip)
 {
-    if (activationReason == arInitial) {
-        vsapi->requestFrameFilter(n, child, frameCtx);
+    const int inmin = clip[0], inmax = clip[1], outmin = clip[2], outmax = clip[3];
+    for (int x=0; x<width; ++x)
+    {
+        const int y = CLAMP ? clampi(srcp[x], inmin, inmax) : srcp[x];
+        const int t = ((RANGE ? c1*y : y<<16) + uvval[x]) >> 16;
+        dstp[x] = CLAMP ? clampi(t, outmin, outmax) : sat8(t);
     }
-    else if (activationReason == arAllFramesReady)
+}
+
+// clip holds the chroma in min/max and out min/max.
+template <bool CLAMP>
+static void chroma_row_C(const unsigned char * __restrict srcpU, 
+    const unsigned char * __restrict srcpV, unsigned char * __restrict dstp, int ca, int cb, 
+    int bias, int widthUV, const int *clip)
+{
+    const int inmin = clip[0], inmax = clip[1], outmin = clip[2], outmax = clip[3];
+    for (int x=0; x<widthUV; ++x)
     {
-        const VSFrameRef *src = vsapi->getFrameFilter(n, child, frameCtx);// child->GetFrame(n, env);
-        int modef = modei;
-        if (d2vArray)
+        const int u = CLAMP ? clampi(srcpU[x], inmin, inmax) : srcpU[x];
+        const int v = CLAMP ? clampi(srcpV[x], inmin, inmax) : srcpV[x];
+        const int t = (ca*u + cb*v + bias) >> 16;
+        dstp[x] = CLAMP ? clampi(t, outmin, outmax) : sat8(t);
+    }
+}
+
+// Plane by plane so that every inner loop auto-vectorizes.  The -128 chroma 
+// offset is folded into the biases, which gives the same 32 bit results as 
+// subtracting it from u and v first.
+template <bool RANGE, bool CLAMP>
+void conv_YV12_C(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned char *srcp = pss->srcp;
+    unsigned char *dstp = pss->dstp;
+    const int src_pitch = pss->src_pitch;
+    const int dst_pitch = pss->dst_pitch;
+    const unsigned char *srcpU = pss->srcpU;
+    const unsigned char *srcpV = pss->srcpV;
+    const unsigned char *srcpn = pss->srcpn;
+    const int src_pitchUV = pss->src_pitchUV;
+    const int height = pss->height;
+    const int width = pss->width;
+    unsigned char *dstpU = pss->dstpU;
+    unsigned char *dstpV = pss->dstpV;
+    unsigned char *dstpn = pss->dstpn;
+    const int dst_pitchUV = pss->dst_pitchUV;
+    int *uvval = pss->uvval;
+    const int c1 = pss->cs->c1;
+    const int c2 = pss->cs->c2;
+    const int c3 = pss->cs->c3; 
+    const int c4 = pss->cs->c4;
+    const int c5 = pss->cs->c5;
+    const int c6 = pss->cs->c6;
+    const int c7 = pss->cs->c7;
+    const int bias_Y = pss->cs->c8-128*(c2+c3);
+    const int bias_U = 8421376-128*(c4+c5);
+    const int bias_V = 8421376-128*(c6+c7);
+    const int clip_Y[4] = { cs->inmin[0], cs->inmax[0], cs->outmin[0], cs->outmax[0] };
+    const int clip_UV[4] = { cs->inmin[1], cs->inmax[1], cs->outmin[1], cs->outmax[1] };
+    for (int h=0; h<height; h+=2)
+    {
+        uvval_row_C<1,CLAMP>(srcpU, srcpV, uvval, c2, c3, bias_Y, width>>1, clip_UV[0], clip_UV[1]);
+        luma_row_C<RANGE,CLAMP>(srcp, dstp, uvval, c1, width, clip_Y);
+        luma_row_C<RANGE,CLAMP>(srcpn, dstpn, uvval, c1, width, clip_Y);
+        chroma_row_C<CLAMP>(srcpU, srcpV, dstpU, c4, c5, bias_U, width>>1, clip_UV);
+        chroma_row_C<CLAMP>(srcpU, srcpV, dstpV, c6, c7, bias_V, width>>1, clip_UV);
+        srcp += src_pitch<<1;
+        srcpn += src_pitch<<1;
+        dstp += dst_pitch<<1;
+        dstpn += dst_pitch<<1;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+}
+
+// 4:1:1 (SSW=2), 4:2:2 (SSW=1), and 4:4:4 (SSW=0), one luma line per chroma 
+// line.  Both clamps are applied here.
+template <int SSW, bool RANGE>
+void conv_YUVP8_C(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned char *srcp = pss->srcp;
+    unsigned char *dstp = pss->dstp;
+    const int src_pitch = pss->src_pitch;
+    const int dst_pitch = pss->dst_pitch;
+    const unsigned char *srcpU = pss->srcpU;
+    const unsigned char *srcpV = pss->srcpV;
+    const int src_pitchUV = pss->src_pitchUV;
+    const int height = pss->height;
+    const int width = pss->width;
+    unsigned char *dstpU = pss->dstpU;
+    unsigned char *dstpV = pss->dstpV;
+    const int dst_pitchUV = pss->dst_pitchUV;
+    int * __restrict uvval = pss->uvval;
+    const int c1 = cs->c1;
+    const int bias_Y = cs->c8-128*(cs->c2+cs->c3);
+    const int bias_U = 8421376-128*(cs->c4+cs->c5);
+    const int bias_V = 8421376-128*(cs->c6+cs->c7);
+    for (int h=0; h<height; ++h)
+    {
+        for (int x=0; x<(width>>SSW); ++x)
         {
-            int temp = d2vArray[interlaced?(n>>1):n];
-            if (debug)
-            {
-                fprintf(stderr, "ColorMatrix:%u:  frame %d:  detected colorimetry from d2v = %d (%s)\n", 
-                    GetCurrentThreadId(), n, temp, CTS(temp));
-            }
-            modef = findMode(temp);
-            if (modef == -1) 
-            {
-                if (debug)
-                {
-                    fprintf(stderr, "ColorMatrix:%u:  frame %d:  returning src frame... no conversion " \
-                        "required (d2v)\n", GetCurrentThreadId(), n);
-                }
-                return src;
-            }
+            const int u = clampi(srcpU[x], cs->inmin[1], cs->inmax[1]);
+            const int v = clampi(srcpV[x], cs->inmin[1], cs->inmax[1]);
+            const int t = cs->c2*u + cs->c3*v + bias_Y;
+            for (int i=0; i<(1<<SSW); ++i)
+                uvval[(x<<SSW)+i] = t;
+            dstpU[x] = clampi((cs->c4*u + cs->c5*v + bias_U) >> 16, cs->outmin[1], cs->outmax[1]);
+            dstpV[x] = clampi((cs->c6*u + cs->c7*v + bias_V) >> 16, cs->outmin[1], cs->outmax[1]);
         }
-        else if (hints)
+        for (int x=0; x<width; ++x)
         {
-            int temp = -1;
-            const VSFrameRef *hintf;
-            if (interlaced)
-            {
-                hintf = vsapi->getFrameFilter(n>>1, hintClip, frameCtx);// hintClip->GetFrame(n>>1, env);
-            }
-            else
-            {
-                hintf = vsapi->getFrameFilter(n, hintClip, frameCtx); //hintClip->GetFrame(n, env);	
-            }
-            getHint(vsapi->getReadPtr(hintf, PLANAR_Y), temp);// hintf->GetReadPtr(AvisynthCompat::PLANAR_Y), temp);
-            if (temp == -1) 
+            const int y = clampi(srcp[x], cs->inmin[0], cs->inmax[0]);
+            dstp[x] = clampi(((RANGE ? c1*y : y<<16) + uvval[x]) >> 16, cs->outmin[0], cs->outmax[0]);
+        }
+        srcp += src_pitch;
+        dstp += dst_pitch;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+}
+
+// Gray output, the luma half of conv_YV12_C (SSH=1) and conv_YUVP8_C.  
+// Both clamps are applied here.
+template <int SSW, int SSH, bool RANGE>
+void convl_YUVP8_C(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const unsigned char *srcp = pss->srcp;
+    unsigned char *dstp = pss->dstp;
+    const int src_pitch = pss->src_pitch;
+    const int dst_pitch = pss->dst_pitch;
+    const unsigned char *srcpU = pss->srcpU;
+    const unsigned char *srcpV = pss->srcpV;
+    const unsigned char *srcpn = pss->srcpn;
+    const int src_pitchUV = pss->src_pitchUV;
+    const int height = pss->height;
+    const int width = pss->width;
+    unsigned char *dstpn = pss->dstpn;
+    int * __restrict uvval = pss->uvval;
+    const int c1 = pss->cs->c1;
+    const int c2 = pss->cs->c2;
+    const int c3 = pss->cs->c3;
+    const int bias_Y = pss->cs->c8-128*(c2+c3);
+    const CFS *cs = pss->cs;
+    const int lo = cs->outmin[0];
+    const int hi = cs->outmax[0];
+    for (int h=0; h<height; h+=1<<SSH)
+    {
+        for (int x=0; x<(width>>SSW); ++x)
+        {
+            const int t = c2*clampi(srcpU[x], cs->inmin[1], cs->inmax[1]) + 
+                c3*clampi(srcpV[x], cs->inmin[1], cs->inmax[1]) + bias_Y;
+            for (int i=0; i<(1<<SSW); ++i)
+                uvval[(x<<SSW)+i] = t;
+        }
+        for (int x=0; x<width; ++x)
+        {
+            const int y = clampi(srcp[x], cs->inmin[0], cs->inmax[0]);
+            dstp[x] = clampi(((RANGE ? c1*y : y<<16) + uvval[x]) >> 16, lo, hi);
+        }
+        if (SSH)
+        {
+            for (int x=0; x<width; ++x)
             {
-                throw std::runtime_error(std::string("ColorMatrix:  no hints detected in stream with hints=true!"));
+                const int y = clampi(srcpn[x], cs->inmin[0], cs->inmax[0]);
+                dstpn[x] = clampi(((RANGE ? c1*y : y<<16) + uvval[x]) >> 16, lo, hi);
+            }
+        }
+        srcp += src_pitch<<SSH;
+        srcpn += src_pitch<<SSH;
+        dstp += dst_pitch<<SSH;
+        dstpn += dst_pitch<<SSH;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+    }
+}
+
+// Chroma comes straight out of the (u,v) table, only luma is computed.  The 
+// chroma clamps are built into the table, CLAMP only adds the luma ones.
+template <bool RANGE, bool CLAMP>
+void lut_YUY2_C(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned char * __restrict srcp = pss->srcp;
+    const int src_pitch = pss->src_pitch;
+    const int height = pss->height;
+    const int pairs = pss->width>>2;
+    unsigned char * __restrict dstp = pss->dstp;
+    const int dst_pitch = pss->dst_pitch;
+    const UVLUT *table = pss->cs->uvtable;
+    const int c1 = pss->cs->c1;
+    const int inmin = cs->inmin[0], inmax = cs->inmax[0];
+    const int outmin = cs->outmin[0], outmax = cs->outmax[0];
+    for (int h=0; h<height; ++h) 
+    {
+        for (int x=0; x<pairs; ++x)
+        {
+            const UVLUT e = table[(srcp[4*x+1]<<8)|srcp[4*x+3]];
+            const int y0 = CLAMP ? clampi(srcp[4*x], inmin, inmax) : srcp[4*x];
+            const int y1 = CLAMP ? clampi(srcp[4*x+2], inmin, inmax) : srcp[4*x+2];
+            const int ny0 = ((RANGE ? c1*y0 : y0<<16) + e.uvval) >> 16;
+            const int ny1 = ((RANGE ? c1*y1 : y1<<16) + e.uvval) >> 16;
+            dstp[4*x] = CLAMP ? clampi(ny0, outmin, outmax) : sat8(ny0);
+            dstp[4*x+1] = e.u;
+            dstp[4*x+2] = CLAMP ? clampi(ny1, outmin, outmax) : sat8(ny1);
+            dstp[4*x+3] = e.v;
+        }
+        srcp += src_pitch;
+        dstp += dst_pitch;
+    }
+}
+
+template <bool RANGE, bool CLAMP>
+void lut_YV12_C(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned char *srcp = pss->srcp;
+    unsigned char *dstp = pss->dstp;
+    const int src_pitch = pss->src_pitch;
+    const int dst_pitch = pss->dst_pitch;
+    const unsigned char *srcpU = pss->srcpU;
+    const unsigned char *srcpV = pss->srcpV;
+    const unsigned char *srcpn = pss->srcpn;
+    const int src_pitchUV = pss->src_pitchUV;
+    const int height = pss->height;
+    const int width = pss->width;
+    unsigned char *dstpU = pss->dstpU;
+    unsigned char *dstpV = pss->dstpV;
+    unsigned char *dstpn = pss->dstpn;
+    const int dst_pitchUV = pss->dst_pitchUV;
+    int * __restrict uvval = pss->uvval;
+    const UVLUT *table = pss->cs->uvtable;
+    const int c1 = pss->cs->c1;
+    const int clip_Y[4] = { cs->inmin[0], cs->inmax[0], cs->outmin[0], cs->outmax[0] };
+    for (int h=0; h<height; h+=2)
+    {
+        for (int x=0; x<(width>>1); ++x)
+        {
+            const UVLUT e = table[(srcpU[x]<<8)|srcpV[x]];
+            uvval[2*x] = e.uvval;
+            uvval[2*x+1] = e.uvval;
+            dstpU[x] = e.u;
+            dstpV[x] = e.v;
+        }
+        luma_row_C<RANGE,CLAMP>(srcp, dstp, uvval, c1, width, clip_Y);
+        luma_row_C<RANGE,CLAMP>(srcpn, dstpn, uvval, c1, width, clip_Y);
+        srcp += src_pitch<<1;
+        srcpn += src_pitch<<1;
+        dstp += dst_pitch<<1;
+        dstpn += dst_pitch<<1;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+}
+
+// NV12, the same sums as conv_YV12_C with u and v taken from and written 
+// back to one interleaved row.  The chroma rows sit in the Gray8 container 
+// below luma, so both clamps are applied here.
+template <bool RANGE>
+void conv_NV12_C(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned char *srcp = pss->srcp;
+    unsigned char *dstp = pss->dstp;
+    const int src_pitch = pss->src_pitch;
+    const int dst_pitch = pss->dst_pitch;
+    const unsigned char *srcpUV = pss->srcpU;
+    const unsigned char *srcpn = pss->srcpn;
+    const int src_pitchUV = pss->src_pitchUV;
+    const int height = pss->height;
+    const int width = pss->width;
+    unsigned char *dstpUV = pss->dstpU;
+    unsigned char *dstpn = pss->dstpn;
+    const int dst_pitchUV = pss->dst_pitchUV;
+    int * __restrict uvval = pss->uvval;
+    const int c1 = cs->c1;
+    const int bias_Y = cs->c8-128*(cs->c2+cs->c3);
+    const int bias_U = 8421376-128*(cs->c4+cs->c5);
+    const int bias_V = 8421376-128*(cs->c6+cs->c7);
+    for (int h=0; h<height; h+=2)
+    {
+        for (int x=0; x<width; x+=2)
+        {
+            const int u = clampi(srcpUV[x], cs->inmin[1], cs->inmax[1]);
+            const int v = clampi(srcpUV[x+1], cs->inmin[1], cs->inmax[1]);
+            uvval[x] = uvval[x+1] = cs->c2*u + cs->c3*v + bias_Y;
+            dstpUV[x] = clampi((cs->c4*u + cs->c5*v + bias_U) >> 16, cs->outmin[1], cs->outmax[1]);
+            dstpUV[x+1] = clampi((cs->c6*u + cs->c7*v + bias_V) >> 16, cs->outmin[1], cs->outmax[1]);
+        }
+        for (int x=0; x<width; ++x)
+        {
+            const int y0 = clampi(srcp[x], cs->inmin[0], cs->inmax[0]);
+            const int y1 = clampi(srcpn[x], cs->inmin[0], cs->inmax[0]);
+            dstp[x] = clampi(((RANGE ? c1*y0 : y0<<16) + uvval[x]) >> 16, cs->outmin[0], cs->outmax[0]);
+            dstpn[x] = clampi(((RANGE ? c1*y1 : y1<<16) + uvval[x]) >> 16, cs->outmin[0], cs->outmax[0]);
+        }
+        srcp += src_pitch<<1;
+        srcpn += src_pitch<<1;
+        dstp += dst_pitch<<1;
+        dstpn += dst_pitch<<1;
+        srcpUV += src_pitchUV;
+        dstpUV += dst_pitchUV;
+    }
+}
+
+// 9-14 bit 4:2:0.  The coefficients are in 2^-hshift units and u and v are 
+// centered on half so that the sums stay in 32 bits, see load_coefficients.  
+// Both clamps are applied here.  conv_YUV420P16_SSE2 gives the same results.  
+// P010 (NV=1) has u and v interleaved in one row, srcpV/dstpV point one 
+// sample past u.
+template <int NV>
+void conv_YUV420P16_C(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned short *srcp = (const unsigned short*)pss->srcp;
+    unsigned short *dstp = (unsigned short*)pss->dstp;
+    const int src_pitch = pss->src_pitch>>1;
+    const int dst_pitch = pss->dst_pitch>>1;
+    const unsigned short *srcpU = (const unsigned short*)pss->srcpU;
+    const unsigned short *srcpV = (const unsigned short*)pss->srcpV;
+    const unsigned short *srcpn = (const unsigned short*)pss->srcpn;
+    const int src_pitchUV = pss->src_pitchUV>>1;
+    const int height = pss->height;
+    const int width = pss->width>>1;
+    unsigned short *dstpU = (unsigned short*)pss->dstpU;
+    unsigned short *dstpV = (unsigned short*)pss->dstpV;
+    unsigned short *dstpn = (unsigned short*)pss->dstpn;
+    const int dst_pitchUV = pss->dst_pitchUV>>1;
+    int * __restrict uvval = pss->uvval;
+    const int half = 1<<(cs->bits-1);
+    const int shift = cs->hshift;
+    for (int h=0; h<height; h+=2)
+    {
+        for (int x=0; x<(width>>1); ++x)
+        {
+            const int u = clampi(srcpU[x<<NV], cs->inmin[1], cs->inmax[1]) - half;
+            const int v = clampi(srcpV[x<<NV], cs->inmin[1], cs->inmax[1]) - half;
+            uvval[2*x] = uvval[2*x+1] = cs->c2*u + cs->c3*v + cs->c8;
+            dstpU[x<<NV] = clampi((cs->c4*u + cs->c5*v + cs->cuv) >> shift, cs->outmin[1], cs->outmax[1]);
+            dstpV[x<<NV] = clampi((cs->c6*u + cs->c7*v + cs->cuv) >> shift, cs->outmin[1], cs->outmax[1]);
+        }
+        for (int x=0; x<width; ++x)
+        {
+            const int y0 = clampi(srcp[x], cs->inmin[0], cs->inmax[0]);
+            const int y1 = clampi(srcpn[x], cs->inmin[0], cs->inmax[0]);
+            dstp[x] = clampi((cs->c1*y0 + uvval[x]) >> shift, cs->outmin[0], cs->outmax[0]);
+            dstpn[x] = clampi((cs->c1*y1 + uvval[x]) >> shift, cs->outmin[0], cs->outmax[0]);
+        }
+        srcp += src_pitch<<1;
+        srcpn += src_pitch<<1;
+        dstp += dst_pitch<<1;
+        dstpn += dst_pitch<<1;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+}
+
+// 15/16 bit 4:2:0 with 2^-20 coefficients.  y, u, and v are centered on half 
+// and the sums are 64 bit, the output is the centered result plus half.  
+// conv_YUV420P16W_SSE2 gives the same results.
+template <int NV>
+void conv_YUV420P16W_C(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned short *srcp = (const unsigned short*)pss->srcp;
+    unsigned short *dstp = (unsigned short*)pss->dstp;
+    const int src_pitch = pss->src_pitch>>1;
+    const int dst_pitch = pss->dst_pitch>>1;
+    const unsigned short *srcpU = (const unsigned short*)pss->srcpU;
+    const unsigned short *srcpV = (const unsigned short*)pss->srcpV;
+    const unsigned short *srcpn = (const unsigned short*)pss->srcpn;
+    const int src_pitchUV = pss->src_pitchUV>>1;
+    const int height = pss->height;
+    const int width = pss->width>>1;
+    unsigned short *dstpU = (unsigned short*)pss->dstpU;
+    unsigned short *dstpV = (unsigned short*)pss->dstpV;
+    unsigned short *dstpn = (unsigned short*)pss->dstpn;
+    const int dst_pitchUV = pss->dst_pitchUV>>1;
+    const int half = 1<<(cs->bits-1);
+    const int shift = cs->hshift;
+    for (int h=0; h<height; h+=2)
+    {
+        for (int x=0; x<(width>>1); ++x)
+        {
+            const int u = clampi(srcpU[x<<NV], cs->inmin[1], cs->inmax[1]) - half;
+            const int v = clampi(srcpV[x<<NV], cs->inmin[1], cs->inmax[1]) - half;
+            const int64_t uvval = (int64_t)cs->c2*u + (int64_t)cs->c3*v + cs->wc8;
+            dstpU[x<<NV] = clampi((int)(((int64_t)cs->c4*u + (int64_t)cs->c5*v + cs->cuv) >> shift) + half, 
+                cs->outmin[1], cs->outmax[1]);
+            dstpV[x<<NV] = clampi((int)(((int64_t)cs->c6*u + (int64_t)cs->c7*v + cs->cuv) >> shift) + half, 
+                cs->outmin[1], cs->outmax[1]);
+            for (int k=2*x; k<2*x+2; ++k)
+            {
+                const int y0 = clampi(srcp[k], cs->inmin[0], cs->inmax[0]) - half;
+                const int y1 = clampi(srcpn[k], cs->inmin[0], cs->inmax[0]) - half;
+                dstp[k] = clampi((int)(((int64_t)cs->c1*y0 + uvval) >> shift) + half, cs->outmin[0], cs->outmax[0]);
+                dstpn[k] = clampi((int)(((int64_t)cs->c1*y1 + uvval) >> shift) + half, cs->outmin[0], cs->outmax[0]);
+            }
+        }
+        srcp += src_pitch<<1;
+        srcpn += src_pitch<<1;
+        dstp += dst_pitch<<1;
+        dstpn += dst_pitch<<1;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+}
+
+// v210, three 10 bit samples per dword in u y v y order with 6 pixels per 
+// 16 bytes.  Every (u,v) pair serves two luma samples like in conv_YUY2_C, 
+// the sums and clamps are those of conv_YUV420P16_C.
+void conv_v210_C(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned int *srcp = (const unsigned int*)pss->srcp;
+    unsigned int *dstp = (unsigned int*)pss->dstp;
+    const int src_pitch = pss->src_pitch>>2;
+    const int dst_pitch = pss->dst_pitch>>2;
+    const int height = pss->height;
+    const int words = pss->width>>2;
+    const int half = 1<<(cs->bits-1);
+    const int shift = cs->hshift;
+    for (int h=0; h<height; ++h)
+    {
+        for (int x=0; x<words; x+=4)
+        {
+            int s[12];
+            for (int i=0; i<12; ++i)
+                s[i] = (srcp[x+i/3] >> (10*(i%3))) & 1023;
+            for (int p=0; p<12; p+=4)
+            {
+                const int u = clampi(s[p], cs->inmin[1], cs->inmax[1]) - half;
+                const int v = clampi(s[p+2], cs->inmin[1], cs->inmax[1]) - half;
+                const int y0 = clampi(s[p+1], cs->inmin[0], cs->inmax[0]);
+                const int y1 = clampi(s[p+3], cs->inmin[0], cs->inmax[0]);
+                const int uvval = cs->c2*u + cs->c3*v + cs->c8;
+                s[p] = clampi((cs->c4*u + cs->c5*v + cs->cuv) >> shift, cs->outmin[1], cs->outmax[1]);
+                s[p+1] = clampi((cs->c1*y0 + uvval) >> shift, cs->outmin[0], cs->outmax[0]);
+                s[p+2] = clampi((cs->c6*u + cs->c7*v + cs->cuv) >> shift, cs->outmin[1], cs->outmax[1]);
+                s[p+3] = clampi((cs->c1*y1 + uvval) >> shift, cs->outmin[0], cs->outmax[0]);
+            }
+            for (int i=0; i<4; ++i)
+                dstp[x+i] = s[3*i] | (s[3*i+1]<<10) | (s[3*i+2]<<20);
+        }
+        srcp += src_pitch;
+        dstp += dst_pitch;
+    }
+}
+
+// Rounds (DITHER=0), Bayer dithers (1), or Sierra-lite diffuses (2) one row 
+// of sums with shift fraction bits down to 8 bit.  The diffused error is the 
+// rounding error only, so clipped pixels do not smear into their neighbours.  
+// err0/err1 are the current and next error rows with one guard entry on 
+// each side and are swapped for the next row.
+template <int DITHER>
+static void narrow_row_C(const int *q, unsigned char *dstp, int width, int shift, 
+    int lo, int hi, int row, int *&err0, int *&err1)
+{
+    const int rnd = 1<<(shift-1);
+    if (DITHER == 1)
+    {
+        const unsigned char *b = dither_matrix[row&15];
+        for (int x=0; x<width; ++x)
+            dstp[x] = (unsigned char)clampi((q[x] + ((2*b[x&15]+1)<<(shift-9))) >> shift, lo, hi);
+    }
+    else if (DITHER == 2)
+    {
+        for (int x=0; x<width; ++x)
+        {
+            const int v = q[x] + err0[x+1];
+            const int o = (v + rnd) >> shift;
+            const int e = v - (o<<shift);
+            err0[x+2] += e>>1;
+            err1[x] += e>>2;
+            err1[x+1] += e>>2;
+            dstp[x] = (unsigned char)clampi(o, lo, hi);
+        }
+        int *t = err0;
+        err0 = err1;
+        err1 = t;
+        memset(err1, 0, (width+2)*sizeof(int));
+    }
+    else
+    {
+        for (int x=0; x<width; ++x)
+            dstp[x] = (unsigned char)clampi((q[x] + rnd) >> shift, lo, hi);
+    }
+}
+
+// 9-16 bit 4:2:0 in, 8 bit out.  Same sums as conv_YUV420P16_C without the 
+// rounding, which narrow_row_C applies together with the dither.  The 
+// dither pattern follows the absolute line so slices line up, Sierra-lite 
+// always gets the whole frame as one slice.
+template <int DITHER>
+void convn_YUV420P16_C(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned short *srcp = (const unsigned short*)pss->srcp;
+    unsigned char *dstp = pss->dstp;
+    const int src_pitch = pss->src_pitch>>1;
+    const int dst_pitch = pss->dst_pitch;
+    const unsigned short *srcpU = (const unsigned short*)pss->srcpU;
+    const unsigned short *srcpV = (const unsigned short*)pss->srcpV;
+    const unsigned short *srcpn = (const unsigned short*)pss->srcpn;
+    const int src_pitchUV = pss->src_pitchUV>>1;
+    const int height = pss->height;
+    const int width = pss->width>>1;
+    unsigned char *dstpU = pss->dstpU;
+    unsigned char *dstpV = pss->dstpV;
+    unsigned char *dstpn = pss->dstpn;
+    const int dst_pitchUV = pss->dst_pitchUV;
+    int * __restrict uvval = pss->uvval;
+    const int wa = (width+31)&~31;
+    int *qY = pss->dith, *qU = qY+wa, *qV = qU+wa;
+    int *err[3][2];
+    for (int p=0; p<3; ++p)
+    {
+        err[p][0] = qY+3*wa+2*p*(wa+2);
+        err[p][1] = err[p][0]+wa+2;
+    }
+    if (DITHER == 2)
+        memset(err[0][0], 0, 6*(wa+2)*sizeof(int));
+    const int half = 1<<(cs->bits-1);
+    const int shift = cs->nshift;
+    for (int h=0; h<height; h+=2)
+    {
+        const int line = pss->line0+(h>>1)*pss->linestep;
+        for (int x=0; x<(width>>1); ++x)
+        {
+            const int u = clampi(srcpU[x], cs->inmin[1], cs->inmax[1]) - half;
+            const int v = clampi(srcpV[x], cs->inmin[1], cs->inmax[1]) - half;
+            uvval[2*x] = uvval[2*x+1] = cs->c2*u + cs->c3*v + cs->c8;
+            qU[x] = cs->c4*u + cs->c5*v + cs->cuv;
+            qV[x] = cs->c6*u + cs->c7*v + cs->cuv;
+        }
+        narrow_row_C<DITHER>(qU, dstpU, width>>1, shift, cs->outmin[1], cs->outmax[1], line, err[1][0], err[1][1]);
+        narrow_row_C<DITHER>(qV, dstpV, width>>1, shift, cs->outmin[1], cs->outmax[1], line, err[2][0], err[2][1]);
+        for (int r=0; r<2; ++r)
+        {
+            const unsigned short *s = r ? srcpn : srcp;
+            for (int x=0; x<width; ++x)
+                qY[x] = cs->c1*clampi(s[x], cs->inmin[0], cs->inmax[0]) + uvval[x];
+            narrow_row_C<DITHER>(qY, r ? dstpn : dstp, width, shift, cs->outmin[0], cs->outmax[0], 
+                (line<<1)+r, err[0][0], err[0][1]);
+        }
+        srcp += src_pitch<<1;
+        srcpn += src_pitch<<1;
+        dstp += dst_pitch<<1;
+        dstpn += dst_pitch<<1;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+}
+
+// 8 bit 4:2:0 (SSH=1), 4:2:2 (SSW=1), or 4:4:4 in, 9-16 bit out.  The 16.16 
+// sums are shifted by 24-depth instead of 16, so the fraction the 8 bit 
+// kernels drop ends up in the low bits of the output.  Both clamps are 
+// applied here.
+template <int SSW, int SSH>
+void convd_YUVP8_C(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned char *srcp = pss->srcp;
+    unsigned short *dstp = (unsigned short*)pss->dstp;
+    const int src_pitch = pss->src_pitch;
+    const int src_pitchR = pss->src_pitchR;
+    const int dst_pitch = pss->dst_pitch>>1;
+    const int dst_pitchR = pss->dst_pitchR>>1;
+    const unsigned char *srcpU = pss->srcpU;
+    const unsigned char *srcpV = pss->srcpV;
+    const int src_pitchUV = pss->src_pitchUV;
+    const int height = pss->height;
+    const int width = pss->width;
+    unsigned short *dstpU = (unsigned short*)pss->dstpU;
+    unsigned short *dstpV = (unsigned short*)pss->dstpV;
+    const int dst_pitchUV = pss->dst_pitchUV>>1;
+    int * __restrict uvval = pss->uvval;
+    const int shift = cs->dshift;
+    for (int h=0; h<height; h+=1<<SSH)
+    {
+        for (int x=0; x<(width>>SSW); ++x)
+        {
+            const int u = clampi(srcpU[x], cs->inmin[1], cs->inmax[1]) - 128;
+            const int v = clampi(srcpV[x], cs->inmin[1], cs->inmax[1]) - 128;
+            uvval[x] = cs->c2*u + cs->c3*v + cs->c8;
+            dstpU[x] = clampi((cs->c4*u + cs->c5*v + cs->cuv) >> shift, cs->outmin[1], cs->outmax[1]);
+            dstpV[x] = clampi((cs->c6*u + cs->c7*v + cs->cuv) >> shift, cs->outmin[1], cs->outmax[1]);
+        }
+        for (int r=0; r<(1<<SSH); ++r)
+        {
+            for (int x=0; x<width; ++x)
+                dstp[r*dst_pitchR+x] = clampi((cs->c1*clampi(srcp[r*src_pitchR+x], cs->inmin[0], cs->inmax[0]) + 
+                    uvval[x>>SSW]) >> shift, cs->outmin[0], cs->outmax[0]);
+        }
+        srcp += src_pitch<<SSH;
+        dstp += dst_pitch<<SSH;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+}
+
+static inline float half_to_float(unsigned short h)
+{
+    const unsigned sign = (h&0x8000)<<16;
+    unsigned exp = (h>>10)&0x1F, mant = h&0x3FF, bits;
+    if (exp == 0x1F) // inf/nan
+        bits = sign | 0x7F800000 | (mant<<13);
+    else if (exp)
+        bits = sign | ((exp+112)<<23) | (mant<<13);
+    else if (mant) // denormal, normalize it
+    {
+        exp = 113;
+        while (!(mant&0x400)) { mant <<= 1; --exp; }
+        bits = sign | (exp<<23) | ((mant&0x3FF)<<13);
+    }
+    else
+        bits = sign;
+    float f;
+    memcpy(&f, &bits, 4);
+    return f;
+}
+
+// Round to nearest even like vcvtps2ph with imm 0.
+static inline unsigned short float_to_half(float f)
+{
+    unsigned x;
+    memcpy(&x, &f, 4);
+    const unsigned sign = (x>>16)&0x8000;
+    const unsigned ax = x&0x7FFFFFFF;
+    if (ax >= 0x7F800000) // inf/nan
+        return (unsigned short)(sign | 0x7C00 | (ax > 0x7F800000 ? 0x200 : 0));
+    if (ax >= 0x477FF000) // rounds past 65504
+        return (unsigned short)(sign | 0x7C00);
+    unsigned r, rem, halfway;
+    if (ax < 0x38800000) // denormal or zero
+    {
+        if (ax <= 0x33000000)
+            return (unsigned short)sign;
+        const unsigned shift = 126-(ax>>23);
+        const unsigned m = (ax&0x7FFFFF) | 0x800000;
+        r = m>>shift;
+        rem = m&((1u<<shift)-1);
+        halfway = 1u<<(shift-1);
+    }
+    else
+    {
+        r = (ax-0x38000000)>>13;
+        rem = ax&0x1FFF;
+        halfway = 0x1000;
+    }
+    if (rem > halfway || (rem == halfway && (r&1)))
+        ++r;
+    return (unsigned short)(sign | r);
+}
+
+static inline float load_f(float v) { return v; }
+static inline float load_f(unsigned short v) { return half_to_float(v); }
+static inline void store_f(float &d, float v) { d = v; }
+static inline void store_f(unsigned short &d, float v) { d = float_to_half(v); }
+
+// Float (T=float) and half (T=unsigned short) 4:4:4.  The coefficients come 
+// straight from the double matrices, luma is 0-1 and chroma -0.5-0.5 (or 
+// the 16/255 based equivalents for limited range), and nothing is clamped 
+// or rounded beyond the output type unless clamp asks for it.
+template <typename T, bool CLAMP>
+void conv_YUV444F_C(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const T *srcp = (const T*)pss->srcp;
+    const T *srcpU = (const T*)pss->srcpU;
+    const T *srcpV = (const T*)pss->srcpV;
+    T *dstp = (T*)pss->dstp;
+    T *dstpU = (T*)pss->dstpU;
+    T *dstpV = (T*)pss->dstpV;
+    const int src_pitch = pss->src_pitch/sizeof(T);
+    const int dst_pitch = pss->dst_pitch/sizeof(T);
+    const int src_pitchUV = pss->src_pitchUV/sizeof(T);
+    const int dst_pitchUV = pss->dst_pitchUV/sizeof(T);
+    const int height = pss->height;
+    const int width = pss->width/sizeof(T);
+    const float c1 = cs->fc[0], c2 = cs->fc[1], c3 = cs->fc[2], c4 = cs->fc[3];
+    const float c5 = cs->fc[4], c6 = cs->fc[5], c7 = cs->fc[6], bias_Y = cs->fc[7];
+    const float *fclip = cs->fclip;
+    for (int h=0; h<height; ++h)
+    {
+        for (int x=0; x<width; ++x)
+        {
+            float y = load_f(srcp[x]);
+            float u = load_f(srcpU[x]);
+            float v = load_f(srcpV[x]);
+            if (CLAMP)
+            {
+                y = (std::min)((std::max)(y, fclip[0]), fclip[1]);
+                u = (std::min)((std::max)(u, fclip[2]), fclip[3]);
+                v = (std::min)((std::max)(v, fclip[2]), fclip[3]);
+            }
+            float ny = c1*y + c2*u + c3*v + bias_Y;
+            float nu = c4*u + c5*v;
+            float nv = c6*u + c7*v;
+            if (CLAMP)
+            {
+                ny = (std::min)((std::max)(ny, fclip[4]), fclip[5]);
+                nu = (std::min)((std::max)(nu, fclip[6]), fclip[7]);
+                nv = (std::min)((std::max)(nv, fclip[6]), fclip[7]);
+            }
+            store_f(dstp[x], ny);
+            store_f(dstpU[x], nu);
+            store_f(dstpV[x], nv);
+        }
+        srcp += src_pitch;
+        dstp += dst_pitch;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+}
+
+// The float 8 bit level in 2^-16 units.  NaN ends up at the low end and 
+// the clamp keeps the conversion inside int.
+static inline int fixf(float f)
+{
+    f = f > -1.0f ? f : -1.0f;
+    f = f < 256.0f ? f : 256.0f;
+    return (int)(f*65536.0f);
+}
+
+// Float or half 4:4:4 in, 8 bit out.  Same math as conv_YUV444F_C, the 
+// results are scaled to 8 bit levels and handed to narrow_row_C.  The input 
+// clamp is always applied since it is a no-op when not requested, the 
+// output clamp is done on the 8 bit values.
+template <typename T, int DITHER>
+void convn_YUV444F_C(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const T *srcp = (const T*)pss->srcp;
+    const T *srcpU = (const T*)pss->srcpU;
+    const T *srcpV = (const T*)pss->srcpV;
+    unsigned char *dstp = pss->dstp;
+    unsigned char *dstpU = pss->dstpU;
+    unsigned char *dstpV = pss->dstpV;
+    const int src_pitch = pss->src_pitch/sizeof(T);
+    const int src_pitchUV = pss->src_pitchUV/sizeof(T);
+    const int dst_pitch = pss->dst_pitch;
+    const int dst_pitchUV = pss->dst_pitchUV;
+    const int height = pss->height;
+    const int width = pss->width/sizeof(T);
+    const float c1 = cs->fc[0], c2 = cs->fc[1], c3 = cs->fc[2], c4 = cs->fc[3];
+    const float c5 = cs->fc[4], c6 = cs->fc[5], c7 = cs->fc[6], bias_Y = cs->fc[7];
+    const float *fclip = cs->fclip;
+    const int wa = (width+31)&~31;
+    int *q[3] = { pss->dith, pss->dith+wa, pss->dith+2*wa };
+    int *err[3][2];
+    for (int p=0; p<3; ++p)
+    {
+        err[p][0] = q[0]+3*wa+2*p*(wa+2);
+        err[p][1] = err[p][0]+wa+2;
+    }
+    if (DITHER == 2)
+        memset(err[0][0], 0, 6*(wa+2)*sizeof(int));
+    for (int h=0; h<height; ++h)
+    {
+        const int line = pss->line0+h*pss->linestep;
+        for (int x=0; x<width; ++x)
+        {
+            const float y = (std::min)((std::max)(load_f(srcp[x]), fclip[0]), fclip[1]);
+            const float u = (std::min)((std::max)(load_f(srcpU[x]), fclip[2]), fclip[3]);
+            const float v = (std::min)((std::max)(load_f(srcpV[x]), fclip[2]), fclip[3]);
+            q[0][x] = fixf((c1*y + c2*u + c3*v + bias_Y)*255.0f);
+            q[1][x] = fixf((c4*u + c5*v)*255.0f + 128.0f);
+            q[2][x] = fixf((c6*u + c7*v)*255.0f + 128.0f);
+        }
+        narrow_row_C<DITHER>(q[0], dstp, width, 16, cs->outmin[0], cs->outmax[0], line, err[0][0], err[0][1]);
+        narrow_row_C<DITHER>(q[1], dstpU, width, 16, cs->outmin[1], cs->outmax[1], line, err[1][0], err[1][1]);
+        narrow_row_C<DITHER>(q[2], dstpV, width, 16, cs->outmin[1], cs->outmax[1], line, err[2][0], err[2][1]);
+        srcp += src_pitch;
+        dstp += dst_pitch;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+}
+
+// Matrix, clamp, and store of one rgb pixel, see fill_cfs.  The clamps are 
+// written like maxps/minps so NaN ends up at the low end like in the SSE2 
+// kernels, integer output is already offset by 0.5 and just truncated.
+static inline void rgb_store(unsigned char &d, float v) { d = (unsigned char)(int)v; }
+static inline void rgb_store(unsigned short &d, float v) { d = (unsigned short)(int)v; }
+static inline void rgb_store(float &d, float v) { d = v; }
+static inline void rgb_store(int &d, float v) { d = (int)v; }
+
+template <typename D>
+static inline void rgb_px_C(const CFS *cs, float y, float u, float v, D &r, D &g, D &b)
+{
+    const float *k = cs->rc;
+    float o[3];
+    y = y > cs->rclip[0] ? y : cs->rclip[0];
+    y = y < cs->rclip[1] ? y : cs->rclip[1];
+    for (int i=0; i<3; ++i)
+    {
+        const float t = k[4*i]*y + k[4*i+1]*u + k[4*i+2]*v + k[4*i+3];
+        o[i] = t > cs->rclip[2] ? t : cs->rclip[2];
+        o[i] = o[i] < cs->rclip[3] ? o[i] : cs->rclip[3];
+    }
+    rgb_store(r, o[0]);
+    rgb_store(g, o[1]);
+    rgb_store(b, o[2]);
+}
+
+// Clamped and centered chroma of one luma row for the integer rgb kernels.  
+// The vertical 3:1 blend with the neighbouring chroma line (SSH, MPEG-2 
+// siting) is done here without rounding, so cu/cv come out scaled by 
+// 1<<(2*SSH).  The horizontal step is left to the kernels, which read one 
+// entry past the last sample for it, so that entry repeats the last one.
+template <typename T, int SSH>
+static void rgb_chroma_row_C(const T *pU, const T *pV, const T *nU, const T *nV, 
+    int cw, const CFS *cs, int *cu, int *cv)
+{
+    const int half = 1<<(cs->bits-1);
+    for (int x=0; x<cw; ++x)
+    {
+        int u = clampi(pU[x], cs->inmin[1], cs->inmax[1]) - half;
+        int v = clampi(pV[x], cs->inmin[1], cs->inmax[1]) - half;
+        if (SSH)
+        {
+            u = 3*u + clampi(nU[x], cs->inmin[1], cs->inmax[1]) - half;
+            v = 3*v + clampi(nV[x], cs->inmin[1], cs->inmax[1]) - half;
+        }
+        cu[x] = u;
+        cv[x] = v;
+    }
+    cu[cw] = cu[cw-1];
+    cv[cw] = cv[cw-1];
+}
+
+// 8 bit 4:2:0/4:2:2/4:4:4 or 9-16 bit 4:2:0 (T) in, RGB24/RGB48/RGBS (D) 
+// out.  Chroma is upsampled with MPEG-2 siting, cosited horizontally and 
+// centered vertically, and the neighbouring chroma line is read across the 
+// slice border.  convr_YUVP_SSE2 gives the same results.
+template <typename T, int SSW, int SSH, typename D>
+void convr_YUVP_C(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const T *srcp = (const T*)pss->srcp;
+    const T *srcpU = (const T*)pss->srcpU;
+    const T *srcpV = (const T*)pss->srcpV;
+    D *dstpR = (D*)pss->dstp;
+    D *dstpG = (D*)pss->dstpU;
+    D *dstpB = (D*)pss->dstpV;
+    const int src_pitch = pss->src_pitch/sizeof(T);
+    const int src_pitchR = pss->src_pitchR/sizeof(T);
+    const int src_pitchUV = pss->src_pitchUV/sizeof(T);
+    const int src_pitchUVR = pss->src_pitchUVR/sizeof(T);
+    // the planes of one RGB frame share the pitch
+    const int dst_pitch = pss->dst_pitch/sizeof(D);
+    const int dst_pitchR = pss->dst_pitchR/sizeof(D);
+    const int height = pss->height;
+    const int width = pss->width/sizeof(T);
+    const int cw = width>>SSW;
+    int *cu = pss->dith, *cv = cu+((width+31)&~31)+16;
+    for (int h=0; h<height; h+=1<<SSH)
+    {
+        const int line = pss->line0+(h>>SSH)*pss->linestep;
+        for (int r=0; r<(1<<SSH); ++r)
+        {
+            const int nl = SSH ? clampi(line+(r ? 1 : -1), 0, pss->linesUV-1)-line : 0;
+            rgb_chroma_row_C<T,SSH>(srcpU, srcpV, srcpU+nl*src_pitchUVR, srcpV+nl*src_pitchUVR, cw, cs, cu, cv);
+            const T *s = srcp+r*src_pitchR;
+            D *dr = dstpR+r*dst_pitchR, *dg = dstpG+r*dst_pitchR, *db = dstpB+r*dst_pitchR;
+            for (int x=0; x<width; ++x)
+            {
+                const int i = x>>SSW;
+                const int u = SSW ? (x&1 ? cu[i]+cu[i+1] : 2*cu[i]) : cu[i];
+                const int v = SSW ? (x&1 ? cv[i]+cv[i+1] : 2*cv[i]) : cv[i];
+                rgb_px_C(cs, (float)s[x], (float)u, (float)v, dr[x], dg[x], db[x]);
+            }
+        }
+        srcp += src_pitch<<SSH;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpR += dst_pitch<<SSH;
+        dstpG += dst_pitch<<SSH;
+        dstpB += dst_pitch<<SSH;
+    }
+}
+
+// Float (T=float) or half (T=unsigned short) 4:4:4 in, RGB24/RGB48/RGBS out.
+template <typename T, typename D>
+void convr_YUV444F_C(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const T *srcp = (const T*)pss->srcp;
+    const T *srcpU = (const T*)pss->srcpU;
+    const T *srcpV = (const T*)pss->srcpV;
+    D *dstpR = (D*)pss->dstp;
+    D *dstpG = (D*)pss->dstpU;
+    D *dstpB = (D*)pss->dstpV;
+    const int src_pitch = pss->src_pitch/sizeof(T);
+    const int src_pitchUV = pss->src_pitchUV/sizeof(T);
+    const int dst_pitch = pss->dst_pitch/sizeof(D);
+    const int height = pss->height;
+    const int width = pss->width/sizeof(T);
+    const float *fclip = cs->fclip;
+    for (int h=0; h<height; ++h)
+    {
+        for (int x=0; x<width; ++x)
+        {
+            float u = load_f(srcpU[x]);
+            float v = load_f(srcpV[x]);
+            u = u > fclip[2] ? u : fclip[2];
+            u = u < fclip[3] ? u : fclip[3];
+            v = v > fclip[2] ? v : fclip[2];
+            v = v < fclip[3] ? v : fclip[3];
+            rgb_px_C(cs, load_f(srcp[x]), u, v, dstpR[x], dstpG[x], dstpB[x]);
+        }
+        srcp += src_pitch;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpR += dst_pitch;
+        dstpG += dst_pitch;
+        dstpB += dst_pitch;
+    }
+}
+
+// One output sample of the rgb input kernels, ordered and clamped like 
+// rgb_px_C.  k and clip point at the Y or the chroma row of rc/rclip.
+template <typename D>
+static inline void yuv_px_C(const float *k, const float *clip, float r, float g, float b, D &d)
+{
+    float t = k[0]*r + k[1]*g + k[2]*b + k[3];
+    t = t > clip[0] ? t : clip[0];
+    t = t < clip[1] ? t : clip[1];
+    rgb_store(d, t);
+}
+
+// 8-16 bit or float RGB (T) in, 4:2:0 of the dest matrix (D) out.  Chroma 
+// is the 2x2 average, taken from the RGB sums since the matrix is linear.  
+// convy_RGB_SSE2 gives the same results.
+template <typename T, typename D>
+void convy_RGB_C(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const T *srcp[3] = { (const T*)pss->srcp, (const T*)pss->srcpU, (const T*)pss->srcpV };
+    D *dstp = (D*)pss->dstp;
+    D *dstpU = (D*)pss->dstpU;
+    D *dstpV = (D*)pss->dstpV;
+    // the planes of one RGB frame share the pitch
+    const int src_pitch = pss->src_pitch/sizeof(T);
+    const int src_pitchR = pss->src_pitchR/sizeof(T);
+    const int dst_pitch = pss->dst_pitch/sizeof(D);
+    const int dst_pitchR = pss->dst_pitchR/sizeof(D);
+    const int dst_pitchUV = pss->dst_pitchUV/sizeof(D);
+    const int height = pss->height;
+    const int width = pss->width/sizeof(T);
+    const float *k = cs->rc, *clip = cs->rclip, *fclip = cs->fclip;
+    for (int h=0; h<height; h+=2)
+    {
+        for (int x=0; x<width; x+=2)
+        {
+            float p[3][4], sum[3];
+            for (int c=0; c<3; ++c)
+            {
+                const T *s = srcp[c]+x;
+                const float v[4] = { (float)s[0], (float)s[1], (float)s[src_pitchR], (float)s[src_pitchR+1] };
+                for (int i=0; i<4; ++i)
+                {
+                    p[c][i] = v[i] > fclip[0] ? v[i] : fclip[0];
+                    p[c][i] = p[c][i] < fclip[1] ? p[c][i] : fclip[1];
+                }
+                sum[c] = (p[c][0] + p[c][2]) + (p[c][1] + p[c][3]);
+            }
+            for (int i=0; i<4; ++i)
+                yuv_px_C(k, clip, p[0][i], p[1][i], p[2][i], dstp[(i>>1)*dst_pitchR+x+(i&1)]);
+            yuv_px_C(k+4, clip+2, sum[0], sum[1], sum[2], dstpU[x>>1]);
+            yuv_px_C(k+8, clip+2, sum[0], sum[1], sum[2], dstpV[x>>1]);
+        }
+        for (int c=0; c<3; ++c)
+            srcp[c] += src_pitch<<1;
+        dstp += dst_pitch<<1;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+}
+
+// The reversible YCoCg-R lifting.  Co and Cg come out one bit wider than 
+// RGB and are stored offset by half of their range, so RGB of n bits 
+// takes an n+1 bit YCoCg clip and the round trip is exact.
+static inline void ycocg_fwd(int r, int g, int b, int &y, int &co, int &cg)
+{
+    co = r - b;
+    const int t = b + (co>>1);
+    cg = g - t;
+    y = t + (cg>>1);
+}
+
+static inline void ycocg_inv(int y, int co, int cg, int &r, int &g, int &b)
+{
+    const int t = y - (cg>>1);
+    g = cg + t;
+    b = t - (co>>1);
+    r = b + co;
+}
+
+// 8-16 bit YUV 4:4:4 (T) in, YCoCg out.  The source matrix takes it to 
+// RGB of cs->rgb bits like convr_YUVP_C, the lifting does the rest.  
+// convc_YUV444_SSE2 gives the same results.
+template <typename T>
+void convc_YUV444_C(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const T *srcp = (const T*)pss->srcp;
+    const T *srcpU = (const T*)pss->srcpU;
+    const T *srcpV = (const T*)pss->srcpV;
+    unsigned short *dstp = (unsigned short*)pss->dstp;
+    unsigned short *dstpCo = (unsigned short*)pss->dstpU;
+    unsigned short *dstpCg = (unsigned short*)pss->dstpV;
+    const int src_pitch = pss->src_pitch/sizeof(T);
+    const int src_pitchUV = pss->src_pitchUV/sizeof(T);
+    const int dst_pitch = pss->dst_pitch/sizeof(unsigned short);
+    const int dst_pitchUV = pss->dst_pitchUV/sizeof(unsigned short);
+    const int height = pss->height;
+    const int width = pss->width/sizeof(T);
+    const int half = 1<<(cs->bits-1), cbias = 1<<cs->rgb;
+    for (int h=0; h<height; ++h)
+    {
+        for (int x=0; x<width; ++x)
+        {
+            const int u = clampi(srcpU[x], cs->inmin[1], cs->inmax[1]) - half;
+            const int v = clampi(srcpV[x], cs->inmin[1], cs->inmax[1]) - half;
+            int r, g, b, y, co, cg;
+            rgb_px_C(cs, (float)srcp[x], (float)u, (float)v, r, g, b);
+            ycocg_fwd(r, g, b, y, co, cg);
+            dstp[x] = (unsigned short)y;
+            dstpCo[x] = (unsigned short)(co+cbias);
+            dstpCg[x] = (unsigned short)(cg+cbias);
+        }
+        srcp += src_pitch;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstp += dst_pitch;
+        dstpCo += dst_pitchUV;
+        dstpCg += dst_pitchUV;
+    }
+}
+
+// YCoCg in, 8-16 bit YUV 4:4:4 (D) of the dest matrix out.  The lifting 
+// gives back the exact RGB of cs->rgbin bits, which then goes through the 
+// dest matrix like in convy_RGB_C.  convc_YCoCg_SSE2 gives the same results.
+template <typename D>
+void convc_YCoCg_C(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned short *srcp = (const unsigned short*)pss->srcp;
+    const unsigned short *srcpCo = (const unsigned short*)pss->srcpU;
+    const unsigned short *srcpCg = (const unsigned short*)pss->srcpV;
+    D *dstp = (D*)pss->dstp;
+    D *dstpU = (D*)pss->dstpU;
+    D *dstpV = (D*)pss->dstpV;
+    const int src_pitch = pss->src_pitch/sizeof(unsigned short);
+    const int src_pitchUV = pss->src_pitchUV/sizeof(unsigned short);
+    const int dst_pitch = pss->dst_pitch/sizeof(D);
+    const int dst_pitchUV = pss->dst_pitchUV/sizeof(D);
+    const int height = pss->height;
+    const int width = pss->width/sizeof(unsigned short);
+    const float *k = cs->rc, *clip = cs->rclip, *fclip = cs->fclip;
+    const int cbias = 1<<cs->rgbin;
+    for (int h=0; h<height; ++h)
+    {
+        for (int x=0; x<width; ++x)
+        {
+            int c[3];
+            ycocg_inv(srcp[x], srcpCo[x]-cbias, srcpCg[x]-cbias, c[0], c[1], c[2]);
+            float p[3];
+            for (int i=0; i<3; ++i)
+            {
+                p[i] = c[i] > fclip[0] ? (float)c[i] : fclip[0];
+                p[i] = p[i] < fclip[1] ? p[i] : fclip[1];
+            }
+            yuv_px_C(k, clip, p[0], p[1], p[2], dstp[x]);
+            yuv_px_C(k+4, clip+2, p[0], p[1], p[2], dstpU[x]);
+            yuv_px_C(k+8, clip+2, p[0], p[1], p[2], dstpV[x]);
+        }
+        srcp += src_pitch;
+        srcpCo += src_pitchUV;
+        srcpCg += src_pitchUV;
+        dstp += dst_pitch;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+}
+
+const VSFrameRef *VS_CC ColorMatrix::ColorMatrixGetFrame(int n, int activationReason, void **instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    ColorMatrix *d = (ColorMatrix *)*instanceData;
+    return d->getFrame(n, activationReason, frameCtx, core, vsapi);
+}
+
+const VSFrameRef *ColorMatrix::getFrame(int n, int activationReason, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi)
+{
+    if (activationReason == arInitial) {
+        vsapi->requestFrameFilter(n, child, frameCtx);
+        if (hints)
+        {
+            const int hn = interlaced ? (n>>1) : n;
+            if (!hintArray || hintArray[hn] == HINT_UNKNOWN)
+                vsapi->requestFrameFilter(hn, hintClip, frameCtx);
+            // hintcache=2 reads ahead, the frames are decoded once they are ready
+            for (int i=hn+1; hintcache == 2 && i<=hn+HINT_AHEAD && i<hintFrames; ++i)
+            {
+                if (hintArray[i] == HINT_UNKNOWN)
+                    vsapi->requestFrameFilter(i, hintClip, frameCtx);
             }
+        }
+    }
+    else if (activationReason == arAllFramesReady)
+    {
+        const VSFrameRef *src = vsapi->getFrameFilter(n, child, frameCtx);// child->GetFrame(n, env);
+        int modef = modei;
+        const int color = matrix_colorimetry[dest];
+        const int hint = writehints && (color == 1 || (color >= 4 && color <= 7)) ? 
+            (color<<COLORIMETRY_SHIFT) : -1;
+        if (d2vArray)
+        {
+            int temp = d2vArray[interlaced?(n>>1):n];
             if (debug)
             {
-                fprintf(stderr, "ColorMatrix:%u:  frame %d:  detected hint = %d (%s)\n", 
+                fprintf(stderr, "ColorMatrix:%u:  frame %d:  detected colorimetry from d2v = %d (%s)\n", 
                     GetCurrentThreadId(), n, temp, CTS(temp));
             }
             modef = findMode(temp);
             if (modef == -1) 
             {
-                if (debug)
-                {
-                    fprintf(stderr, "ColorMatrix:%u:  frame %d:  returning src frame... no conversion " \
-                        "required (hints)\n", GetCurrentThreadId(), n);
-                }
-                return src;
+                if (debug)
+                {
+                    fprintf(stderr, "ColorMatrix:%u:  frame %d:  sharing src planes... no conversion " \
+                        "required (d2v)\n", GetCurrentThreadId(), n);
+                }
+                VSFrameRef *dst = shareFrame(src, hint, false, core, vsapi);
+                vsapi->freeFrame(src);
+                return dst;
+            }
+        }
+        else if (hints)
+        {
+            const int hn = interlaced ? (n>>1) : n;
+            const VSFrameRef *hintf = NULL;
+            if (!hintArray || hintArray[hn] == HINT_UNKNOWN)
+                hintf = vsapi->getFrameFilter(hn, hintClip, frameCtx);// hintClip->GetFrame(hn, env);
+            int temp = getCachedHint(hn, hintf, vsapi);
+            if (hintf)
+                vsapi->freeFrame(hintf);
+            for (int i=hn+1; hintcache == 2 && i<=hn+HINT_AHEAD && i<hintFrames; ++i)
+            {
+                // still unknown means it was requested above
+                if (hintArray[i] != HINT_UNKNOWN)
+                    continue;
+                const VSFrameRef *aheadf = vsapi->getFrameFilter(i, hintClip, frameCtx);
+                if (aheadf)
+                {
+                    getCachedHint(i, aheadf, vsapi);
+                    vsapi->freeFrame(aheadf);
+                }
+            }
+            if (temp == -1) 
+            {
+                throw std::runtime_error(std::string("ColorMatrix:  no hints detected in stream with hints=true!"));
+            }
+            if (debug)
+            {
+                fprintf(stderr, "ColorMatrix:%u:  frame %d:  detected hint = %d (%s)\n", 
+                    GetCurrentThreadId(), n, temp, CTS(temp));
+            }
+            modef = findMode(temp);
+            if (modef == -1) 
+            {
+                if (debug)
+                {
+                    fprintf(stderr, "ColorMatrix:%u:  frame %d:  sharing src planes... no conversion " \
+                        "required (hints)\n", GetCurrentThreadId(), n);
+                }
+                VSFrameRef *dst = shareFrame(src, hint, false, core, vsapi);
+                vsapi->freeFrame(src);
+                return dst;
+            }
+        }
+        if (neutral && modef >= 0 && modeCFS[modef].c1 == 65536 && modeCFS[modef].c8 == 32768)
+        {
+            const int widthUV = vsapi->getFrameWidth(src, PLANAR_U);
+            const int heightUV = vsapi->getFrameHeight(src, PLANAR_U);
+            bool (*scan)(const unsigned char*, int, int, int) = (cpu&CPUF_SSE2) ? 
+                &neutral_chroma_SSE2 : &neutral_chroma_C;
+            if (scan(vsapi->getReadPtr(src, PLANAR_U), vsapi->getStride(src, PLANAR_U), widthUV, heightUV) && 
+                scan(vsapi->getReadPtr(src, PLANAR_V), vsapi->getStride(src, PLANAR_V), widthUV, heightUV))
+            {
+                if (debug)
+                {
+                    fprintf(stderr, "ColorMatrix:%u:  frame %d:  sharing src planes... no conversion " \
+                        "required (neutral chroma)\n", GetCurrentThreadId(), n);
+                }
+                // the chroma planes are shared, luma is copied for the clamp 
+                // and the hint
+                VSFrameRef *dst = shareFrame(src, hint, clamp != 0, core, vsapi);
+                vsapi->freeFrame(src);
+                return dst;
+            }
+        }
+        uint64_t hash[2];
+        if (dupcache)
+        {
+            hashFrame(src, hash, vsapi);
+            ++dupFrames;
+            for (int i=0; i<dupcache; ++i)
+            {
+                const DupEntry &e = dupCache[i];
+                if (!e.src || e.modef != modef || e.hash[0] != hash[0] || e.hash[1] != hash[1] || 
+                    !sameFrame(e.src, src, vsapi))
+                    continue;
+                ++dupHits;
+                if (debug)
+                {
+                    fprintf(stderr, "ColorMatrix:%u:  frame %d:  sharing cached output planes... " \
+                        "identical src frame (dupcache)\n", GetCurrentThreadId(), n);
+                }
+                // the cached planes with this frame's props
+                const VSFrameRef *planeSrc[3] = { e.dst, e.dst, e.dst };
+                const int planes[3] = { 0, 1, 2 };
+                VSFrameRef *dst = vsapi->newVideoFrame2(dstFormat, vi.width, vi.height, planeSrc, planes, src, core);
+                setFrameProps(dst, vsapi);
+                vsapi->freeFrame(src);
+                return dst;
+            }
+        }
+        VSFrameRef *dst = vsapi->newVideoFrame(dstFormat, vi.width, vi.height, src, core); //env->NewVideoFrame(vi);
+        const int src_pitch = vsapi->getStride(src, 0);// src->GetPitch();
+        const int src_width = vsapi->getFrameWidth(src, 0) * vi.format->bytesPerSample; // src->GetRowSize();
+        const int src_height = nv ? vsapi->getFrameHeight(src, 0)/3*2 : vsapi->getFrameHeight(src, 0); // src->GetHeight(), only the luma rows for nv
+        const int dst_pitch = vsapi->getStride(dst, 0); // dst->GetPitch();
+        const int dst_width = vsapi->getFrameWidth(dst, 0) * dstFormat->bytesPerSample; // dst->GetRowSize();
+        const int dst_height = vsapi->getFrameHeight(dst, 0); // dst->GetHeight();
+        const CFS *cs = modef >= 0 ? &modeCFS[modef] : &modeCFS[NUM_MODES];
+        if (vi.format->id == pfCompatYUY2 || v210) // packed, one plane
+        {
+            for (int b=0; b<vi.format->numPlanes; ++b)
+            {
+                const unsigned char* srcp = vsapi->getReadPtr(src, b); // src->GetReadPtr();
+                unsigned char* dstp = vsapi->getWritePtr(dst, b); // dst->GetWritePtr();
+                const int hslice = src_height/threads;
+                const int hremain = src_height%threads;
+                for (int tc=0; tc<threads; ++tc)
+                {
+                    pssInfo[tc]->width = src_width;
+                    pssInfo[tc]->cs = cs;
+                    pssInfo[tc]->n = n;
+                    pssInfo[tc]->hint = tc == 0 ? hint : -1; // slice 0 owns the first line
+                    if (thrdmthd == 1)
+                    {
+                        pssInfo[tc]->dst_pitch = dst_pitch*threads;
+                        pssInfo[tc]->src_pitch = src_pitch*threads;
+                        pssInfo[tc]->dstp = dstp+tc*dst_pitch;
+                        pssInfo[tc]->srcp = srcp+tc*src_pitch;
+                        pssInfo[tc]->height = tc < hremain ? hslice+1 : hslice;
+                    }
+                    else
+                    {
+                        pssInfo[tc]->dst_pitch = dst_pitch;
+                        pssInfo[tc]->src_pitch = src_pitch;
+                        pssInfo[tc]->dstp = dstp+hslice*tc*dst_pitch;
+                        pssInfo[tc]->srcp = srcp+hslice*tc*src_pitch;
+                        pssInfo[tc]->height = tc == threads-1 ? hslice+hremain : hslice;
+                    }
+                    ResetEvent(pssInfo[tc]->jobFinished);
+                    SetEvent(pssInfo[tc]->nextJob);
+                }
+                for (int tc=0; tc<threads; ++tc)
+                    WaitForSingleObject(pssInfo[tc]->jobFinished,INFINITE);
+            }
+        }
+        else
+        {
+            const unsigned char* srcp = vsapi->getReadPtr(src, PLANAR_Y); // src->GetReadPtr(PLANAR_Y);
+            // nv chroma is the interleaved rows below luma, v starts one sample after u
+            const unsigned char* srcpU = nv ? srcp+src_height*src_pitch : vsapi->getReadPtr(src, PLANAR_U); // src->GetReadPtr(PLANAR_U);
+            const unsigned char* srcpV = nv ? srcpU+vi.format->bytesPerSample : vsapi->getReadPtr(src, PLANAR_V); // src->GetReadPtr(PLANAR_V);
+
+            int row_size = vsapi->getFrameWidth(src, PLANAR_Y) * vi.format->bytesPerSample;
+            int r = (row_size + 32 - 1) & (~(32 - 1)); // Aligned rowsize
+            if (r > vsapi->getStride(src, PLANAR_Y))
+                r = row_size;
+
+            const int src_widtha = r; // src->GetRowSize(PLANAR_Y_ALIGNED);
+            const int src_pitchUV = nv ? src_pitch : vsapi->getStride(src, PLANAR_U); // src->GetPitch(PLANAR_U);
+            const int src_heightUV = nv ? src_height>>1 : vsapi->getFrameHeight(src, PLANAR_U); // src->GetHeight(PLANAR_U);
+            unsigned char* dstp = vsapi->getWritePtr(dst, PLANAR_Y); // dst->GetWritePtr(PLANAR_Y);
+            // gray output has no chroma planes, its kernels never touch dstpU/dstpV
+            unsigned char* dstpU = gray ? NULL : nv ? dstp+src_height*dst_pitch : vsapi->getWritePtr(dst, PLANAR_U); // dst->GetWritePtr(PLANAR_U);
+            unsigned char* dstpV = gray ? NULL : nv ? dstpU+vi.format->bytesPerSample : vsapi->getWritePtr(dst, PLANAR_V); // dst->GetWritePtr(PLANAR_V);
+            const int dst_pitchUV = gray ? 0 : nv ? dst_pitch : vsapi->getStride(dst, PLANAR_U); // dst->GetPitch(PLANAR_U);
+            // slices are cut on chroma lines, one luma line per chroma line for 4:2:2/4:4:4
+            const int ssh = rgbin || nv ? 1 : vi.format->subSamplingH;
+            const int dssh = rgb ? ssh : 0; // rgb planes are all full size
+            const int sssh = rgbin ? 1 : 0;
+            const int hslice = (src_height>>ssh)/threads;
+            const int hremain = (src_height>>ssh)%threads;
+            for (int tc=0; tc<threads; ++tc)
+            {
+                pssInfo[tc]->width = src_width;
+                pssInfo[tc]->widtha = src_widtha;
+                pssInfo[tc]->cs = cs;
+                pssInfo[tc]->n = n;
+                pssInfo[tc]->hint = tc == 0 ? hint : -1; // slice 0 owns the first line
+                pssInfo[tc]->src_pitchUVR = src_pitchUV;
+                pssInfo[tc]->linesUV = src_heightUV;
+                if (thrdmthd == 1)
+                {
+                    pssInfo[tc]->dst_pitch = dst_pitch*threads;
+                    pssInfo[tc]->dst_pitchR = dst_pitch;
+                    pssInfo[tc]->dst_pitchUV = dst_pitchUV*threads;
+                    pssInfo[tc]->src_pitch = src_pitch*threads;
+                    pssInfo[tc]->src_pitchR = src_pitch;
+                    pssInfo[tc]->src_pitchUV = src_pitchUV*threads;
+                    pssInfo[tc]->dstp = dstp+(tc*dst_pitch<<ssh);
+                    pssInfo[tc]->dstpn = pssInfo[tc]->dstp+dst_pitch;
+                    pssInfo[tc]->dstpU = dstpU+(tc*dst_pitchUV<<dssh);
+                    pssInfo[tc]->dstpV = dstpV+(tc*dst_pitchUV<<dssh);
+                    pssInfo[tc]->srcp = srcp+(tc*src_pitch<<ssh);
+                    pssInfo[tc]->srcpn = pssInfo[tc]->srcp+src_pitch;
+                    pssInfo[tc]->srcpU = srcpU+(tc*src_pitchUV<<sssh);
+                    pssInfo[tc]->srcpV = srcpV+(tc*src_pitchUV<<sssh);
+                    pssInfo[tc]->height = tc < hremain ? (hslice+1)<<ssh : hslice<<ssh;
+                    pssInfo[tc]->line0 = tc;
+                    pssInfo[tc]->linestep = threads;
+                }
+                else
+                {
+                    pssInfo[tc]->dst_pitch = dst_pitch;
+                    pssInfo[tc]->dst_pitchR = dst_pitch;
+                    pssInfo[tc]->dst_pitchUV = dst_pitchUV;
+                    pssInfo[tc]->src_pitch = src_pitch;
+                    pssInfo[tc]->src_pitchR = src_pitch;
+                    pssInfo[tc]->src_pitchUV = src_pitchUV;
+                    pssInfo[tc]->dstp = dstp+(hslice*tc*dst_pitch<<ssh);
+                    pssInfo[tc]->dstpn = pssInfo[tc]->dstp+dst_pitch;
+                    pssInfo[tc]->dstpU = dstpU+(hslice*tc*dst_pitchUV<<dssh);
+                    pssInfo[tc]->dstpV = dstpV+(hslice*tc*dst_pitchUV<<dssh);
+                    pssInfo[tc]->srcp = srcp+(hslice*tc*src_pitch<<ssh);
+                    pssInfo[tc]->srcpn = pssInfo[tc]->srcp+src_pitch;
+                    pssInfo[tc]->srcpU = srcpU+(hslice*tc*src_pitchUV<<sssh);
+                    pssInfo[tc]->srcpV = srcpV+(hslice*tc*src_pitchUV<<sssh);
+                    pssInfo[tc]->height = tc == threads-1 ? (hslice+hremain)<<ssh : hslice<<ssh;
+                    pssInfo[tc]->line0 = hslice*tc;
+                    pssInfo[tc]->linestep = 1;
+                }
+                ResetEvent(pssInfo[tc]->jobFinished);
+                SetEvent(pssInfo[tc]->nextJob);
+            }
+            for (int tc=0; tc<threads; ++tc)
+                WaitForSingleObject(pssInfo[tc]->jobFinished,INFINITE);
+        }
+        setFrameProps(dst, vsapi);
+        if (dupcache)
+        {
+            // the oldest entry makes room, src is kept for the byte compare
+            DupEntry &e = dupCache[dupNext];
+            vsapi->freeFrame(e.src);
+            vsapi->freeFrame(e.dst);
+            e.hash[0] = hash[0];
+            e.hash[1] = hash[1];
+            e.modef = modef;
+            e.src = src;
+            e.dst = vsapi->cloneFrameRef(dst);
+            dupNext = (dupNext+1)%dupcache;
+        }
+        else
+        {
+            // Release the source frame
+            vsapi->freeFrame(src);
+        }
+        return dst;
+    }
+    return NULL;
+}
+
+void ColorMatrix::getHint(const unsigned char *srcp, int &color)
+{
+    color = -1;
+    unsigned int i, hint = 0, magic_number = 0;
+    for (i=0; i<32; ++i)
+    {
+        magic_number |= ((*srcp++ & 1) << i);
+    }
+    if (magic_number != MAGIC_NUMBER) return;
+    for (i=0; i<32; ++i)
+    {
+        hint |= ((*srcp++ & 1) << i);
+    }
+    if (hint&0xFFFFFFE0) return; // this will need to be changed if more hint fields are added
+    color = (hint&COLORIMETRY)>>COLORIMETRY_SHIFT;
+    if (color != 1 && (color < 4 || color > 7))
+        color = -1;
+}
+
+// Inverse of getHint().  The magic number and hint word are stored in the lsb 
+// of the first 64 bytes of the line.  When the output is clamped the bytes 
+// are kept inside 16-235.
+void putHint(unsigned char *dstp, int color, bool limit)
+{
+    const unsigned int words[2] = { MAGIC_NUMBER, (unsigned int)color };
+    for (int w=0; w<2; ++w)
+    {
+        for (int i=0; i<32; ++i)
+        {
+            const int bit = (words[w] >> i) & 1;
+            int val = (*dstp & ~1) | bit;
+            if (limit)
+            {
+                if (val < 16) val = 16 | bit;
+                else if (val > 235) val = 234 | bit;
+            }
+            *dstp++ = val;
+        }
+    }
+}
+
+// Returns the hint for frame hn of hintClip, decoding it from hintf (when not 
+// NULL) and remembering it if caching is enabled.
+int ColorMatrix::getCachedHint(int hn, const VSFrameRef *hintf, const VSAPI *vsapi)
+{
+    int color = -1;
+    if (hintArray && hintArray[hn] != HINT_UNKNOWN)
+    {
+        if (hintArray[hn] != HINT_MISSING)
+            color = hintArray[hn];
+        if (debug)
+        {
+            fprintf(stderr, "ColorMatrix:%u:  frame %d:  using cached hint\n", 
+                GetCurrentThreadId(), hn);
+        }
+        return color;
+    }
+    getHint(vsapi->getReadPtr(hintf, PLANAR_Y), color);// hintf->GetReadPtr(AvisynthCompat::PLANAR_Y), color);
+    if (hintArray)
+    {
+        hintArray[hn] = color == -1 ? HINT_MISSING : color;
+        if (++hintKnown == hintFrames && debug)
+            printHintRuns();
+    }
+    return color;
+}
+
+void ColorMatrix::printHintRuns()
+{
+    int start = 0;
+    for (int i=1; i<=hintFrames; ++i)
+    {
+        if (i < hintFrames && hintArray[i] == hintArray[start])
+            continue;
+        const int temp = hintArray[start] == HINT_MISSING ? -1 : hintArray[start];
+        fprintf(stderr, "ColorMatrix:%u:  frames %d-%d:  hint = %d (%s)\n", 
+            GetCurrentThreadId(), start, i-1, temp, CTS(temp));
+        start = i;
+    }
+}
+
+void ColorMatrix::checkMode(const char *md, const VSAPI *vsapi)
+{
+    source = dest = -1;
+    const char *sep = strstr(md, "->");
+    if (sep)
+    {
+        const std::string src(md, sep-md);
+        for (int i=0; i<NUM_MATRICES; ++i)
+        {
+            if (lstrcmpi(src.c_str(), matrix_names[i]) == 0) source = i;
+            if (lstrcmpi(sep+2, matrix_names[i]) == 0) dest = i;
+        }
+    }
+    if (source == -1 || dest == -1)
+        throw std::runtime_error(std::string("ColorMatrix:  invalid mode string!"));
+}
+
+void ColorMatrix::hashFrame(const VSFrameRef *src, uint64_t hash[2], const VSAPI *vsapi)
+{
+    void (*proc)(const unsigned char*, int, int, int, uint64_t*) = (cpu&CPUF_SSE2) ? 
+        &hash_plane_SSE2 : &hash_plane_C;
+    hash[0] = hash[1] = 0;
+    for (int b=0; b<vi.format->numPlanes; ++b)
+    {
+        proc(vsapi->getReadPtr(src, b), vsapi->getStride(src, b), 
+            vsapi->getFrameWidth(src, b)*vi.format->bytesPerSample, vsapi->getFrameHeight(src, b), hash);
+    }
+    for (int i=0; i<2; ++i)
+    {
+        // xxh3 avalanche
+        hash[i] ^= hash[i] >> 37;
+        hash[i] *= 0x165667919E3779F9ULL;
+        hash[i] ^= hash[i] >> 32;
+    }
+}
+
+bool ColorMatrix::sameFrame(const VSFrameRef *a, const VSFrameRef *b, const VSAPI *vsapi)
+{
+    for (int p=0; p<vi.format->numPlanes; ++p)
+    {
+        const unsigned char *pa = vsapi->getReadPtr(a, p);
+        const unsigned char *pb = vsapi->getReadPtr(b, p);
+        const int width = vsapi->getFrameWidth(a, p)*vi.format->bytesPerSample;
+        for (int y=0; y<vsapi->getFrameHeight(a, p); ++y)
+        {
+            if (memcmp(pa, pb, width))
+                return false;
+            pa += vsapi->getStride(a, p);
+            pb += vsapi->getStride(b, p);
+        }
+    }
+    return true;
+}
+
+void ColorMatrix::setFrameProps(VSFrameRef *dst, const VSAPI *vsapi)
+{
+    VSMap *props = vsapi->getFramePropsRW(dst);
+    // YCoCg output is tagged with the YCgCo matrix code (8)
+    vsapi->propSetInt(props, "_Matrix", rgb ? 0 : ycocg ? 8 : matrix_colorimetry[dest], paReplace);
+    vsapi->propSetInt(props, "_ColorRange", outputFR || rgb || ycocg ? RANGE_FULL : RANGE_LIMITED, paReplace);
+}
+
+// src's planes as a new frame with the output props, for frames that need no 
+// conversion.  With a hint to write or clampLuma the luma plane is copied 
+// instead, clamped to 16-235 with clampLuma, so that the hint can be put onto 
+// its first line.
+VSFrameRef *ColorMatrix::shareFrame(const VSFrameRef *src, int hint, bool clampLuma, VSCore *core, 
+    const VSAPI *vsapi)
+{
+    const bool copyLuma = hint >= 0 || clampLuma;
+    const VSFrameRef *planeSrc[3] = { copyLuma ? NULL : src, src, src };
+    const int planes[3] = { 0, 1, 2 };
+    VSFrameRef *dst = vsapi->newVideoFrame2(dstFormat, vi.width, vi.height, planeSrc, planes, src, core);
+    if (copyLuma)
+    {
+        const unsigned char *srcp = vsapi->getReadPtr(src, 0);
+        unsigned char *dstp = vsapi->getWritePtr(dst, 0);
+        const int src_pitch = vsapi->getStride(src, 0);
+        const int dst_pitch = vsapi->getStride(dst, 0);
+        const int row_size = vsapi->getFrameWidth(src, 0) * vi.format->bytesPerSample;
+        for (int y=0; y<vsapi->getFrameHeight(src, 0); ++y)
+        {
+            if (clampLuma)
+                limit_row_C(srcp+y*src_pitch, dstp+y*dst_pitch, row_size, false);
+            else
+                memcpy(dstp+y*dst_pitch, srcp+y*src_pitch, row_size);
+        }
+        if (hint >= 0)
+            putHint(dstp, hint, clamp > 1);
+    }
+    setFrameProps(dst, vsapi);
+    return dst;
+}
+
+int ColorMatrix::findMode(int color)
+{
+    if (rgb || ycocg)
+    {
+        // every source matrix needs its own conversion to rgb
+        const int s = color == 1 ? 0 : color == 4 ? 1 : color == 5 || color == 6 ? 2 : 
+            color == 7 ? 3 : source;
+        return MODE(s,dest);
+    }
+    if (color == 1 && dest != 0) 
+        return MODE(0,dest);
+    else if (color == 4 && dest != 1)
+        return MODE(1,dest);
+    else if ((color == 5 || color == 6) && dest != 2)
+        return MODE(2,dest);
+    else if (color == 7 && dest != 3)
+        return MODE(3,dest);
+    if (inputFR != outputFR || depth != bits || gray)
+        return -2; // a depth change or gray output alone still needs the (identity) range block
+    // nothing to convert, but the clamps still apply, the dest->dest 
+    // coefficients are the identity and the kernels clamp
+    return clamp ? MODE(dest,dest) : -1;
+}
+
+// The conv1-conv4 kernels have the coefficient signs of the conversions 
+// between the original four matrices baked in and need c1 == 65536.  NULL 
+// means there is no hand-written kernel for this mode.  They are inline asm, 
+// which only exists in x86 builds.
+void (*find_YV12_SIMD(int modef, bool sse2))(void *ps)
+{
+#ifdef _M_IX86
+    if (modef == MODE(0,1) || modef == MODE(0,2) || modef == MODE(0,3) || 
+        modef == MODE(3,1) || modef == MODE(3,2))
+    {
+        if (sse2) return &conv1_YV12_SSE2;
+        return &conv1_YV12_MMX;
+    }
+    else if (modef == MODE(1,0) || modef == MODE(1,3) || modef == MODE(2,0) || 
+        modef == MODE(2,3) || modef == MODE(3,0))
+    {
+        if (sse2) return &conv2_YV12_SSE2;
+        return &conv2_YV12_MMX;
+    }
+    else if (modef == MODE(1,2))
+    {
+        if (sse2) return &conv3_YV12_SSE2;
+        return &conv3_YV12_MMX;
+    }
+    else if (modef == MODE(2,1))
+    {
+        if (sse2) return &conv4_YV12_SSE2;
+        return &conv4_YV12_MMX;
+    }
+#endif
+    return NULL;
+}
+
+// Picks the kernel for every mode once, so the workers never have to branch 
+// on format, range change, or cpu.  The simd kernels rely on VapourSynth 
+// handing out 32 byte aligned frame pointers and strides.  The YV12 and YUY2 
+// kernels have clamping instances picked here with clip, all other kernels 
+// clamp themselves.
+#define RC_KERNEL(k) (range ? (clip ? &k<true,true> : &k<true,false>) : \
+    (clip ? &k<false,true> : &k<false,false>))
+#define RC_KERNEL_NV(k, nv) (range ? (clip ? &k<true,nv,true> : &k<true,nv,false>) : \
+    (clip ? &k<false,nv,true> : &k<false,nv,false>))
+void ColorMatrix::select_kernels()
+{
+    const bool yuy2 = vi.format->id == pfCompatYUY2;
+    const bool yv12 = !yuy2 && !rgb && !gray && bits == 8 && depth == 8 && vi.format->subSamplingH == 1;
+    const bool sse2 = (cpu&CPUF_SSE2) != 0;
+    const bool clip = clamp != 0;
+#define RGB_KERNEL(k, ...) (depth == 8 ? &k<__VA_ARGS__,unsigned char> : \
+    depth <= 16 ? &k<__VA_ARGS__,unsigned short> : &k<__VA_ARGS__,float>)
+    for (int m=0; m<NUM_MODES; ++m)
+    {
+        const bool range = yuv_convert[m][0][0] != 65536;
+        void (*simd)(void *ps) = NULL;
+        if (rgb)
+        {
+            // straight to RGB24/RGB48/RGBS, chroma is upsampled on the fly
+            const int ssw = vi.format->subSamplingW, ssh = vi.format->subSamplingH;
+            if (fp)
+            {
+                if (bits == 32 && sse2)
+                    modeProcs[m] = depth == 8 ? &convr_YUV444PS_SSE2<unsigned char> : 
+                        depth == 16 ? &convr_YUV444PS_SSE2<unsigned short> : &convr_YUV444PS_SSE2<float>;
+                else if (bits == 32)
+                    modeProcs[m] = RGB_KERNEL(convr_YUV444F_C, float);
+                else
+                    modeProcs[m] = RGB_KERNEL(convr_YUV444F_C, unsigned short);
+            }
+            else if (bits > 8)
+                modeProcs[m] = sse2 ? RGB_KERNEL(convr_YUVP_SSE2, unsigned short, 1, 1) : 
+                    RGB_KERNEL(convr_YUVP_C, unsigned short, 1, 1);
+            else if (ssh)
+                modeProcs[m] = sse2 ? RGB_KERNEL(convr_YUVP_SSE2, unsigned char, 1, 1) : 
+                    RGB_KERNEL(convr_YUVP_C, unsigned char, 1, 1);
+            else if (ssw)
+                modeProcs[m] = sse2 ? RGB_KERNEL(convr_YUVP_SSE2, unsigned char, 1, 0) : 
+                    RGB_KERNEL(convr_YUVP_C, unsigned char, 1, 0);
+            else
+                modeProcs[m] = sse2 ? RGB_KERNEL(convr_YUVP_SSE2, unsigned char, 0, 0) : 
+                    RGB_KERNEL(convr_YUVP_C, unsigned char, 0, 0);
+            modeProcNames[m] = sse2 && !(fp && bits == 16) ? "SSE2" : "C";
+        }
+        else if (rgbin)
+        {
+            // RGB24-RGB48/RGBS to 4:2:0, chroma is averaged on the fly
+            if (fp)
+                modeProcs[m] = sse2 ? RGB_KERNEL(convy_RGB_SSE2, float) : RGB_KERNEL(convy_RGB_C, float);
+            else if (bits > 8)
+                modeProcs[m] = sse2 ? RGB_KERNEL(convy_RGB_SSE2, unsigned short) : 
+                    RGB_KERNEL(convy_RGB_C, unsigned short);
+            else
+                modeProcs[m] = sse2 ? RGB_KERNEL(convy_RGB_SSE2, unsigned char) : 
+                    RGB_KERNEL(convy_RGB_C, unsigned char);
+            modeProcNames[m] = sse2 ? "SSE2" : "C";
+        }
+        else if (ycocg)
+        {
+            // 4:4:4 to YCoCg through RGB
+            if (bits > 8)
+                modeProcs[m] = sse2 ? &convc_YUV444_SSE2<unsigned short> : &convc_YUV444_C<unsigned short>;
+            else
+                modeProcs[m] = sse2 ? &convc_YUV444_SSE2<unsigned char> : &convc_YUV444_C<unsigned char>;
+            modeProcNames[m] = sse2 ? "SSE2" : "C";
+        }
+        else if (ycocgin)
+        {
+            if (depth > 8)
+                modeProcs[m] = sse2 ? &convc_YCoCg_SSE2<unsigned short> : &convc_YCoCg_C<unsigned short>;
+            else
+                modeProcs[m] = sse2 ? &convc_YCoCg_SSE2<unsigned char> : &convc_YCoCg_C<unsigned char>;
+            modeProcNames[m] = sse2 ? "SSE2" : "C";
+        }
+        else if (nv)
+        {
+            // NV12/P010, u and v are read and written interleaved
+            if (bits > 14)
+            {
+                modeProcs[m] = sse2 ? &conv_YUV420P16W_SSE2<1> : &conv_YUV420P16W_C<1>;
+                modeProcNames[m] = sse2 ? "SSE2" : "C";
+            }
+            else if (bits > 8)
+            {
+                modeProcs[m] = sse2 ? (range ? &conv_YUV420P16_SSE2<true,1> : &conv_YUV420P16_SSE2<false,1>) : 
+                    &conv_YUV420P16_C<1>;
+                modeProcNames[m] = sse2 ? "SSE2" : "C";
+            }
+            else
+            {
+                modeProcs[m] = sse2 ? RC_KERNEL_NV(convx_YV12_SSE2, 1) : 
+                    (range ? &conv_NV12_C<true> : &conv_NV12_C<false>);
+                modeProcNames[m] = sse2 ? "SSE2 exact" : "C";
+            }
+        }
+        else if (gray)
+        {
+            // luma only, chroma is read for the c2/c3 terms but never written
+            const int ssw = vi.format->subSamplingW, ssh = vi.format->subSamplingH;
+            if (cpu&CPUF_SSE2)
+            {
+                modeProcs[m] = ssh ? (range ? &convl_YUVP8_SSE2<1,1,true> : &convl_YUVP8_SSE2<1,1,false>) :
+                    ssw == 2 ? (range ? &convl_YUVP8_SSE2<2,0,true> : &convl_YUVP8_SSE2<2,0,false>) :
+                    ssw ? (range ? &convl_YUVP8_SSE2<1,0,true> : &convl_YUVP8_SSE2<1,0,false>) :
+                    (range ? &convl_YUVP8_SSE2<0,0,true> : &convl_YUVP8_SSE2<0,0,false>);
+                modeProcNames[m] = "SSE2 exact";
+            }
+            else
+            {
+                modeProcs[m] = ssh ? (range ? &convl_YUVP8_C<1,1,true> : &convl_YUVP8_C<1,1,false>) :
+                    ssw == 2 ? (range ? &convl_YUVP8_C<2,0,true> : &convl_YUVP8_C<2,0,false>) :
+                    ssw ? (range ? &convl_YUVP8_C<1,0,true> : &convl_YUVP8_C<1,0,false>) :
+                    (range ? &convl_YUVP8_C<0,0,true> : &convl_YUVP8_C<0,0,false>);
+                modeProcNames[m] = "C";
+            }
+        }
+        else if (v210)
+        {
+            // unpacked, converted, and repacked in registers
+            modeProcs[m] = (cpu&CPUF_SSSE3) ? &conv_v210_SSSE3 : &conv_v210_C;
+            modeProcNames[m] = (cpu&CPUF_SSSE3) ? "SSSE3" : "C";
+        }
+        else if (yuy2)
+        {
+            modeProcs[m] = sse2 ? RC_KERNEL(conv_YUY2_SSE2) : RC_KERNEL(conv_YUY2_C);
+            modeProcNames[m] = sse2 ? "SSE2 exact" : "C";
+        }
+        else if (fp)
+        {
+            // float/half 4:4:4, fma needs avx2 for the ymm state anyway
+            const bool half = bits == 16;
+            if (depth < bits)
+            {
+                // 8 bit out, Sierra-lite is serial along the row so C only
+                if (!half && dither < 2 && (cpu&CPUF_SSE2))
+                {
+                    modeProcs[m] = dither ? &convn_YUV444PS_SSE2<true> : &convn_YUV444PS_SSE2<false>;
+                    modeProcNames[m] = "SSE2";
+                }
+                else
+                {
+                    modeProcs[m] = half ? (dither == 2 ? &convn_YUV444F_C<unsigned short,2> : 
+                        dither ? &convn_YUV444F_C<unsigned short,1> : &convn_YUV444F_C<unsigned short,0>) :
+                        (dither == 2 ? &convn_YUV444F_C<float,2> : 
+                        dither ? &convn_YUV444F_C<float,1> : &convn_YUV444F_C<float,0>);
+                    modeProcNames[m] = "C";
+                }
+            }
+            else
+#ifdef CM_AVX2
+            if ((cpu&CPUF_AVX2) && (cpu&CPUF_FMA3) && (!half || (cpu&CPUF_F16C)))
+            {
+                modeProcs[m] = half ? (clip ? &conv_YUV444F_AVX2<unsigned short,true> : &conv_YUV444F_AVX2<unsigned short,false>) :
+                    (clip ? &conv_YUV444F_AVX2<float,true> : &conv_YUV444F_AVX2<float,false>);
+                modeProcNames[m] = half ? "AVX2/FMA/F16C" : "AVX2/FMA";
+            }
+            else
+#endif
+            if (!half && (cpu&CPUF_SSE2))
+            {
+                modeProcs[m] = clip ? &conv_YUV444PS_SSE2<true> : &conv_YUV444PS_SSE2<false>;
+                modeProcNames[m] = "SSE2";
+            }
+            else
+            {
+                modeProcs[m] = half ? (clip ? &conv_YUV444F_C<unsigned short,true> : &conv_YUV444F_C<unsigned short,false>) :
+                    (clip ? &conv_YUV444F_C<float,true> : &conv_YUV444F_C<float,false>);
+                modeProcNames[m] = "C";
+            }
+        }
+        else if (depth > bits)
+        {
+            // 8 bit 4:2:0/4:2:2/4:4:4 in, 9-16 bit out
+            const int ssw = vi.format->subSamplingW, ssh = vi.format->subSamplingH;
+            if (cpu&CPUF_SSE2)
+            {
+                modeProcs[m] = ssh ? &convd_YUVP8_SSE2<1,1> : ssw ? &convd_YUVP8_SSE2<1,0> : &convd_YUVP8_SSE2<0,0>;
+                modeProcNames[m] = "SSE2 exact";
+            }
+            else
+            {
+                modeProcs[m] = ssh ? &convd_YUVP8_C<1,1> : ssw ? &convd_YUVP8_C<1,0> : &convd_YUVP8_C<0,0>;
+                modeProcNames[m] = "C";
+            }
+        }
+        else if (!yv12 && bits == 8)
+        {
+            // 4:1:1, 4:2:2, and 4:4:4, one luma line per chroma line
+            const int ssw = vi.format->subSamplingW;
+            if (cpu&CPUF_SSE2)
+            {
+                modeProcs[m] = ssw == 2 ? (range ? &convx_YUVP8_SSE2<2,true> : &convx_YUVP8_SSE2<2,false>) :
+                    ssw ? (range ? &convx_YUVP8_SSE2<1,true> : &convx_YUVP8_SSE2<1,false>) :
+                    (range ? &convx_YUVP8_SSE2<0,true> : &convx_YUVP8_SSE2<0,false>);
+                modeProcNames[m] = "SSE2 exact";
+            }
+            else
+            {
+                modeProcs[m] = ssw == 2 ? (range ? &conv_YUVP8_C<2,true> : &conv_YUVP8_C<2,false>) :
+                    ssw ? (range ? &conv_YUVP8_C<1,true> : &conv_YUVP8_C<1,false>) :
+                    (range ? &conv_YUVP8_C<0,true> : &conv_YUVP8_C<0,false>);
+                modeProcNames[m] = "C";
+            }
+        }
+        else if (bits > 8 && depth < bits)
+        {
+            // 8 bit out, Sierra-lite is serial along the row so C only
+            if (dither < 2 && (cpu&CPUF_SSE2))
+            {
+                modeProcs[m] = dither ? &convn_YUV420P16_SSE2<true> : &convn_YUV420P16_SSE2<false>;
+                modeProcNames[m] = "SSE2";
+            }
+            else
+            {
+                modeProcs[m] = dither == 2 ? &convn_YUV420P16_C<2> : 
+                    dither ? &convn_YUV420P16_C<1> : &convn_YUV420P16_C<0>;
+                modeProcNames[m] = "C";
+            }
+        }
+        else if (bits > 8)
+        {
+            // 15/16 bit sums need more than 32 bits at 2^-16
+            if (cpu&CPUF_SSE2)
+            {
+                modeProcs[m] = bits > 14 ? &conv_YUV420P16W_SSE2<0> : 
+                    range ? &conv_YUV420P16_SSE2<true,0> : &conv_YUV420P16_SSE2<false,0>;
+                modeProcNames[m] = "SSE2";
+            }
+            else
+            {
+                modeProcs[m] = bits > 14 ? &conv_YUV420P16W_C<0> : &conv_YUV420P16_C<0>;
+                modeProcNames[m] = "C";
+            }
+        }
+        else if ((cpu&CPUF_SSSE3) && approx && approx_fits(m))
+        {
+#ifdef CM_AVX2
+            if (cpu&CPUF_AVX2)
+            {
+                modeProcs[m] = RC_KERNEL(conva_YV12_AVX2);
+                modeProcNames[m] = "AVX2 approx";
+            }
+            else
+#endif
+            {
+                modeProcs[m] = RC_KERNEL(conva_YV12_SSSE3);
+                modeProcNames[m] = "SSSE3 approx";
+            }
+        }
+        else if ((cpu&CPUF_SSE2) && (exact || (range && !approx)))
+        {
+            // range changes were exact C before the generic kernel, they only 
+            // go through the rounded one with approx=true
+            modeProcs[m] = RC_KERNEL_NV(convx_YV12_SSE2, 0);
+            modeProcNames[m] = "SSE2 exact";
+        }
+        else if ((cpu&CPUF_SSE2) && !range && !clip && (simd = find_YV12_SIMD(m, true)))
+        {
+            modeProcs[m] = simd;
+            modeProcNames[m] = "SSE2";
+        }
+        else if ((cpu&CPUF_SSE2) && (!range || approx))
+        {
+            modeProcs[m] = RC_KERNEL(conv_YV12_SSE2);
+            modeProcNames[m] = "SSE2 generic";
+        }
+        else if ((cpu&CPUF_MMX) && !exact && !range && !clip && (simd = find_YV12_SIMD(m, false)))
+        {
+            modeProcs[m] = simd;
+            modeProcNames[m] = "MMX";
+        }
+        else
+        {
+            modeProcs[m] = RC_KERNEL(conv_YV12_C);
+            modeProcNames[m] = "C";
+        }
+    }
+#undef RGB_KERNEL
+    // the range luts only cover YUY2 and YV12, the rest goes through the dest->dest coefficients
+    rangeProc = yuy2 ? (clip ? &range_YUY2_C<true> : &range_YUY2_C<false>) : 
+        yv12 ? (clip ? &range_YV12_C<true> : &range_YV12_C<false>) : modeProcs[MODE(dest,dest)];
+    if (approx && debug && yv12 && (cpu&CPUF_SSE2) && vi.width > 0)
+    {
+        // what approx buys over the exact kernel for the modes that can end up at dest, 
+        // and how far off it is, a one-off check on a dummy frame at creation
+        for (int s=0; s<NUM_MATRICES; ++s)
+        {
+            const int m = MODE(s,dest);
+            const bool range = yuv_convert[m][0][0] != 65536;
+            const ConvFunc exactProc = RC_KERNEL_NV(convx_YV12_SSE2, 0);
+            CFS cs;
+            fill_cfs(m, cs);
+            const double ta = time_kernel(modeProcs[m], &cs);
+            const double tx = time_kernel(exactProc, &cs);
+            const double d = diff_kernels(modeProcs[m], exactProc, &cs);
+            fprintf(stderr, "ColorMatrix:%u:  %s->%s:  %s %.1f us, SSE2 exact %.1f us, max diff %.0f\n", 
+                GetCurrentThreadId(), MTS(s), MTS(dest), modeProcNames[m], ta, tx, d);
+        }
+    }
+#ifdef CM_AVX2
+    if (debug && fp && vi.width > 0)
+    {
+        // the fma kernels against the SSE2/C ones they replace, same one-off
+        // check on a dummy frame as for approx
+        const bool half = bits == 16;
+        for (int s=0; s<NUM_MATRICES; ++s)
+        {
+            const int m = MODE(s,dest);
+            if (strncmp(modeProcNames[m], "AVX2", 4))
+                continue;
+            const ConvFunc ref = half ? (clip ? &conv_YUV444F_C<unsigned short,true> : &conv_YUV444F_C<unsigned short,false>) :
+                (clip ? &conv_YUV444PS_SSE2<true> : &conv_YUV444PS_SSE2<false>);
+            CFS cs;
+            fill_cfs(m, cs);
+            fprintf(stderr, "ColorMatrix:%u:  %s->%s:  %s max diff %g against %s\n",
+                GetCurrentThreadId(), MTS(s), MTS(dest), modeProcNames[m],
+                diff_kernels(modeProcs[m], ref, &cs), half ? "C" : "SSE2");
+        }
+    }
+#endif
+    if (jit && yv12 && (cpu&CPUF_SSE2))
+        jit_kernels();
+    for (int m=0; m<NUM_MODES; ++m)
+        modeTables[m] = NULL;
+    if (lut && (yuy2 || yv12))
+        lut_kernels();
+    modeCFS = vs_aligned_malloc<CFS>((NUM_MODES+1)*sizeof(CFS), 16);
+    if (!modeCFS)
+        throw std::runtime_error(std::string("ColorMatrix:  malloc failure (modeCFS)!"));
+    for (int m=0; m<NUM_MODES; ++m)
+    {
+        fill_cfs(m, modeCFS[m]);
+        modeCFS[m].proc = modeProcs[m];
+        modeCFS[m].procName = modeProcNames[m];
+        modeCFS[m].uvtable = modeTables[m];
+    }
+    fill_cfs(-2, modeCFS[NUM_MODES]);
+    modeCFS[NUM_MODES].proc = rangeProc;
+    modeCFS[NUM_MODES].procName = yuy2 || yv12 ? "C" : modeProcNames[MODE(dest,dest)];
+    modeCFS[NUM_MODES].uvtable = NULL;
+}
+
+void ColorMatrix::load_coefficients(int modef, CFS &cs)
+{
+    if (fp)
+    {
+        // float:  the unrounded matrix as is, luma only needs the 16/255 offsets
+        const int rc[7][2] = { {0,0}, {0,1}, {0,2}, {1,1}, {1,2}, {2,1}, {2,2} };
+        for (int i=0; i<7; ++i)
+            cs.fc[i] = (float)yuv_convertd[modef][rc[i][0]][rc[i][1]];
+        double bias = 0.0;
+        if (!inputFR)
+            bias -= 16.0/255.0*yuv_convertd[modef][0][0];
+        if (!outputFR)
+            bias += 16.0/255.0;
+        cs.fc[7] = (float)bias;
+        return;
+    }
+    if (bits > 8)
+    {
+        // 9-16 bit:  2^-hshift units keep every sum within 32 bits, and full 
+        // range is 0-(2^bits-1) rather than 255<<(bits-8).  8 bit output 
+        // keeps the 255<<(bits-8) scale and is rounded (or dithered) by the 
+        // narrowing kernels instead.
+        const double fr = ((1<<bits)-1)/(255.0*(1<<(bits-8)));
+        const double scale = (outputFR && !cs.nshift ? fr : 1.0)/(inputFR ? fr : 1.0)*(1<<cs.hshift)/65536.0;
+        int *c[7] = { &cs.c1, &cs.c2, &cs.c3, &cs.c4, &cs.c5, &cs.c6, &cs.c7 };
+        const int rc[7][2] = { {0,0}, {0,1}, {0,2}, {1,1}, {1,2}, {2,1}, {2,2} };
+        const int lo = 16<<(bits-8);
+        if (cs.hshift > 14)
+        {
+            // 15/16 bit:  taken from the unrounded matrix, the 16.16 one is 
+            // already up to 1.25 LSB off at 16 bit.  y is centered like u and 
+            // v, the output comes out less half, and the luma bias needs 64 
+            // bits.  The SSE2 kernel splits the coefficients at bit 12, so the 
+            // high parts must stay well within a word.
+            const int half = 1<<(bits-1);
+            for (int i=0; i<7; ++i)
+            {
+                *c[i] = (int)floor(yuv_convertd[modef][rc[i][0]][rc[i][1]]*scale*65536.0+0.5);
+                if (abs(*c[i]) > (1<<24)-1)
+                    throw std::runtime_error(std::string("ColorMatrix:  conversion coefficients out of range (check kr/kb)!"));
+            }
+            cs.wc8 = (int64_t)(cs.c1-(1<<cs.hshift))*half + (1<<(cs.hshift-1));
+            if (!inputFR)
+                cs.wc8 -= (int64_t)lo*cs.c1;
+            if (!outputFR)
+                cs.wc8 += (int64_t)lo<<cs.hshift;
+            cs.cuv = 1<<(cs.hshift-1);
+            return;
+        }
+        for (int i=0; i<7; ++i)
+        {
+            *c[i] = (int)floor(yuv_convert[modef][rc[i][0]][rc[i][1]]*scale+0.5);
+            if (abs(*c[i]) > 32767)
+                throw std::runtime_error(std::string("ColorMatrix:  conversion coefficients out of range (check kr/kb)!"));
+        }
+        const int rnd = cs.nshift ? 0 : 1<<(cs.hshift-1);
+        cs.c8 = rnd;
+        if (!inputFR)
+            cs.c8 -= lo*cs.c1;
+        if (!outputFR)
+            cs.c8 += lo<<cs.hshift;
+        cs.cuv = (1<<(bits-1+cs.hshift)) + rnd;
+        return;
+    }
+    cs.c1 = yuv_convert[modef][0][0];
+    cs.c2 = yuv_convert[modef][0][1];
+    cs.c3 = yuv_convert[modef][0][2]; 
+    cs.c4 = yuv_convert[modef][1][1];
+    cs.c5 = yuv_convert[modef][1][2];
+    cs.c6 = yuv_convert[modef][2][1];
+    cs.c7 = yuv_convert[modef][2][2];
+    cs.c8 = 32768;
+    if (!inputFR)
+        cs.c8 -= 16*yuv_convert[modef][0][0];
+    if (!outputFR)
+        cs.c8 += 16*65536;
+    if (cs.dshift)
+    {
+        // depth:  the same sums only shifted less, full range output is 
+        // 0-(2^depth-1) rather than 255<<(depth-8).
+        if (outputFR)
+        {
+            const double fr = ((1<<depth)-1)/(255.0*(1<<(depth-8)));
+            int *c[7] = { &cs.c1, &cs.c2, &cs.c3, &cs.c4, &cs.c5, &cs.c6, &cs.c7 };
+            for (int i=0; i<7; ++i)
+                *c[i] = (int)floor(*c[i]*fr+0.5);
+        }
+        cs.c8 = 1<<(cs.dshift-1);
+        if (!inputFR)
+            cs.c8 -= 16*cs.c1;
+        if (!outputFR)
+            cs.c8 += 16*65536;
+        cs.cuv = 128*65536 + (1<<(cs.dshift-1));
+    }
+}
+
+// Whether the approx kernels stay within 1 LSB of the exact result for this mode.
+bool ColorMatrix::approx_fits(int modef)
+{
+    CFS cs;
+    fill_cfs(modef, cs);
+    return cs.approxFits;
+}
+
+void ColorMatrix::fill_cfs(int modef, CFS &cs)
+{
+    memset(&cs, 0, sizeof(CFS));
+    cs.modef = modef;
+    cs.cpu = cpu;
+    cs.debug = debug;
+    cs.limitHints = clamp > 1; // the hint is put after the output clamp and must stay inside it
+    const bool yuy2 = vi.format->id == pfCompatYUY2;
+    const bool yv12 = !yuy2 && !rgb && !gray && bits == 8 && depth == 8 && vi.format->subSamplingH == 1;
+    cs.format = yuy2 ? "YUY2" : yv12 ? "YV12" : nv ? (bits == 8 ? "NV12" : "P010") : v210 ? "v210" : vi.format->name;
+    cs.bits = bits;
+    cs.fp = fp;
+    if (rgb || ycocg)
+    {
+        // the inverse of the source matrix with the input range, the chroma 
+        // upsampling scale, and the output range folded in.  Integer output 
+        // gets the rounding in the offset and is truncated by the kernels.  
+        // ycocg goes through RGB one bit shallower than its output.
+        const int od = ycocg ? depth-1 : depth;
+        const double (*m)[3] = rgb_convertd[MODE_SRC(modef >= 0 ? modef : MODE(dest,dest))];
+        const int up = 1<<(vi.format->subSamplingW+2*vi.format->subSamplingH);
+        double ys, uvs, yoff;
+        if (fp)
+        {
+            ys = inputFR ? 1.0 : 255.0/219.0;
+            uvs = inputFR ? 1.0 : 255.0/224.0;
+            yoff = inputFR ? 0.0 : 16.0/255.0;
+        }
+        else
+        {
+            ys = inputFR ? 1.0/((1<<bits)-1) : 1.0/(219<<(bits-8));
+            uvs = (inputFR ? 1.0/((1<<bits)-1) : 1.0/(224<<(bits-8)))/up;
+            yoff = inputFR ? 0 : 16<<(bits-8);
+        }
+        const double os = od == 32 ? 1.0 : (1<<od)-1;
+        static const int row[3] = { 2, 0, 1 }; // the rgb matrices are in G, B, R order
+        for (int i=0; i<3; ++i)
+        {
+            const double *mr = m[row[i]];
+            cs.rc[4*i] = (float)(mr[0]*ys*os);
+            cs.rc[4*i+1] = (float)(mr[1]*uvs*os);
+            cs.rc[4*i+2] = (float)(mr[2]*uvs*os);
+            cs.rc[4*i+3] = (float)(-mr[0]*ys*yoff*os + (od == 32 ? 0.0 : 0.5));
+        }
+        for (int i=0; i<2; ++i)
+        {
+            if (fp)
+            {
+                cs.fclip[2*i] = clamp&1 ? (i ? -112.0f/255.0f : 16.0f/255.0f) : -FLT_MAX;
+                cs.fclip[2*i+1] = clamp&1 ? (i ? 112.0f/255.0f : 235.0f/255.0f) : FLT_MAX;
+            }
+            else
+            {
+                cs.inmin[i] = clamp&1 ? 16<<(bits-8) : 0;
+                cs.inmax[i] = clamp&1 ? (i ? 240 : 235)<<(bits-8) : (1<<bits)-1;
+                cs.fclip[2*i] = (float)cs.inmin[i];
+                cs.fclip[2*i+1] = (float)cs.inmax[i];
+            }
+        }
+        cs.rclip[0] = cs.fclip[0];
+        cs.rclip[1] = cs.fclip[1];
+        cs.rclip[2] = od == 32 && clamp < 2 ? -FLT_MAX : 0.0f;
+        cs.rclip[3] = od == 32 ? (clamp > 1 ? 1.0f : FLT_MAX) : (float)(os+0.5);
+        cs.rgb = od;
+        init_simd_constants(&cs);
+        return;
+    }
+    if (rgbin || ycocgin)
+    {
+        // the dest matrix with the input range and the output range folded 
+        // in, rgb input chroma is taken from the sum of a 2x2 block so its 
+        // factors carry the 1/4.  Integer output is rounded like above.  
+        // YCoCg input is lifted back to RGB one bit shallower than itself.
+        const int ib = ycocgin ? bits-1 : bits;
+        const double (*m)[3] = yuv_coeffd[MODE_DST(modef >= 0 ? modef : MODE(dest,dest))];
+        const double is = fp ? 1.0 : 1.0/((1<<ib)-1);
+        const bool fo = depth == 32;
+        const double ys = fo ? (outputFR ? 1.0 : 219.0/255.0) : outputFR ? (1<<depth)-1 : 219<<(depth-8);
+        const double uvs = (fo ? (outputFR ? 1.0 : 224.0/255.0) : outputFR ? (1<<depth)-1 : 224<<(depth-8))/(rgbin ? 4 : 1);
+        const double yoff = fo ? (outputFR ? 0.0 : 16.0/255.0) : outputFR ? 0 : 16<<(depth-8);
+        const double uvoff = fo ? 0.0 : 1<<(depth-1);
+        static const int col[3] = { 2, 0, 1 }; // the yuv matrices take G, B, R
+        for (int i=0; i<3; ++i)
+        {
+            const double sc = i ? uvs : ys;
+            for (int j=0; j<3; ++j)
+                cs.rc[4*i+j] = (float)(m[i][col[j]]*is*sc);
+            cs.rc[4*i+3] = (float)((i ? uvoff : yoff) + (fo ? 0.0 : 0.5));
+        }
+        cs.fclip[0] = fp ? (clamp&1 ? 0.0f : -FLT_MAX) : 0.0f;
+        cs.fclip[1] = fp ? (clamp&1 ? 1.0f : FLT_MAX) : (float)((1<<ib)-1);
+        for (int i=0; i<2; ++i)
+        {
+            if (fo)
+            {
+                cs.rclip[2*i] = clamp>1 ? (i ? -112.0f/255.0f : 16.0f/255.0f) : -FLT_MAX;
+                cs.rclip[2*i+1] = clamp>1 ? (i ? 112.0f/255.0f : 235.0f/255.0f) : FLT_MAX;
+            }
+            else
+            {
+                cs.rclip[2*i] = (float)(clamp>1 ? 16<<(depth-8) : 0);
+                cs.rclip[2*i+1] = (float)((clamp>1 ? (i ? 240 : 235)<<(depth-8) : (1<<depth)-1) + 0.5);
+            }
+        }
+        cs.rgbin = ib;
+        init_simd_constants(&cs);
+        return;
+    }
+    if (fp)
+    {
+        for (int i=0; i<2; ++i)
+        {
+            const float lo = i ? -112.0f/255.0f : 16.0f/255.0f;
+            const float hi = i ? 112.0f/255.0f : 235.0f/255.0f;
+            cs.fclip[2*i] = clamp&1 ? lo : -FLT_MAX;
+            cs.fclip[2*i+1] = clamp&1 ? hi : FLT_MAX;
+            cs.fclip[4+2*i] = clamp>1 ? lo : -FLT_MAX;
+            cs.fclip[5+2*i] = clamp>1 ? hi : FLT_MAX;
+        }
+        if (depth < bits)
+            cs.nshift = 16;
+    }
+    else if (depth > bits)
+    {
+        cs.dshift = 24-depth;
+        for (int i=0; i<2; ++i)
+        {
+            cs.outmin[i] = clamp>1 ? 16<<(depth-8) : 0;
+            cs.outmax[i] = clamp>1 ? (i ? 240 : 235)<<(depth-8) : (1<<depth)-1;
+        }
+    }
+    else if (bits > 8)
+    {
+        // 2^-12 and 2^-13 leave 16 and 15 bit output LSBs off, the W kernels 
+        // take 2^-20 and sum in 64 bits (or split halves)
+        cs.hshift = bits > 14 && depth == bits ? 20 : (std::min)(14, 28-bits);
+        for (int i=0; i<2; ++i)
+        {
+            cs.inmin[i] = clamp&1 ? 16<<(bits-8) : 0;
+            cs.inmax[i] = clamp&1 ? (i ? 240 : 235)<<(bits-8) : (1<<bits)-1;
+            cs.outmin[i] = clamp>1 ? 16<<(bits-8) : 0;
+            cs.outmax[i] = clamp>1 ? (i ? 240 : 235)<<(bits-8) : (1<<bits)-1;
+        }
+        if (depth < bits)
+            cs.nshift = cs.hshift+bits-8;
+    }
+    else if (nv)
+    {
+        // NV12 clamps in the kernels, its chroma rows sit below luma
+        for (int i=0; i<2; ++i)
+        {
+            cs.inmin[i] = clamp&1 ? 16 : 0;
+            cs.inmax[i] = clamp&1 ? (i ? 240 : 235) : 255;
+            cs.outmin[i] = clamp>1 ? 16 : 0;
+            cs.outmax[i] = clamp>1 ? (i ? 240 : 235) : 255;
+        }
+    }
+    else if (gray)
+    {
+        // the gray kernels apply the luma clamp themselves
+        cs.outmin[0] = clamp>1 ? 16 : 0;
+        cs.outmax[0] = clamp>1 ? 235 : 255;
+    }
+    if (bits == 8 && !nv && !rgb && !ycocg && (yuy2 || vi.format->colorFamily == cmYUV))
+    {
+        // all 8 bit kernels clamp themselves, the YV12/YUY2 ones only in 
+        // their CLAMP instances
+        for (int i=0; i<2; ++i)
+        {
+            cs.inmin[i] = clamp&1 ? 16 : 0;
+            cs.inmax[i] = clamp&1 ? (i ? 240 : 235) : 255;
+            if (depth == 8 && !gray)
+            {
+                cs.outmin[i] = clamp>1 ? 16 : 0;
+                cs.outmax[i] = clamp>1 ? (i ? 240 : 235) : 255;
             }
         }
-        VSFrameRef *dst = vsapi->newVideoFrame(vi.format, vi.width, vi.height, src, core); //env->NewVideoFrame(vi);
-        const int src_pitch = vsapi->getStride(src, 0);// src->GetPitch();
-        const int src_width = vsapi->getFrameWidth(src, 0) * vi.format->bytesPerSample; // src->GetRowSize();
-        const int src_height = vsapi->getFrameHeight(src, 0); // src->GetHeight();
-        const int dst_pitch = vsapi->getStride(dst, 0); // dst->GetPitch();
-        const int dst_width = vsapi->getFrameWidth(dst, 0) * vi.format->bytesPerSample; // dst->GetRowSize();
-        const int dst_height = vsapi->getFrameHeight(dst, 0); // dst->GetHeight();
-        if (modef >= 0)
-        {
-            css.c1 = yuv_convert[modef][0][0];
-            css.c2 = yuv_convert[modef][0][1];
-            css.c3 = yuv_convert[modef][0][2]; 
-            css.c4 = yuv_convert[modef][1][1];
-            css.c5 = yuv_convert[modef][1][2];
-            css.c6 = yuv_convert[modef][2][1];
-            css.c7 = yuv_convert[modef][2][2];
-            css.c8 = 32768;
-            if (!inputFR)
-                css.c8 -= 16*yuv_convert[modef][0][0];
-            if (!outputFR)
-                css.c8 += 16*65536;
+    }
+    if (cs.nshift)
+    {
+        // narrowing to 8 bit, the output clamp is applied after rounding
+        for (int i=0; i<2; ++i)
+        {
+            cs.outmin[i] = clamp>1 ? 16 : 0;
+            cs.outmax[i] = clamp>1 ? (i ? 240 : 235) : 255;
         }
-        css.modef = modef;
-        css.n = n;
-        if (vi.format->id == pfCompatYUY2)
+    }
+    // without range luts, range only conversion uses the dest->dest coefficients
+    if (modef >= 0 || !(yuy2 || yv12))
+    {
+        load_coefficients(modef >= 0 ? modef : MODE(dest,dest), cs);
+        init_simd_constants(&cs);
+    }
+}
+
+// Builds the (u,v) tables for every mode that can end up at dest.  With 
+// lut=2 the table kernel is only used if it beats the exact arithmetic 
+// kernel on this cpu, and that one is used otherwise, so the output never 
+// depends on which of the two won.
+void ColorMatrix::lut_kernels()
+{
+    const bool yuy2 = vi.format->id == pfCompatYUY2;
+    const bool clip = clamp != 0;
+    uvTables = (UVLUT*)malloc(NUM_MATRICES*65536*sizeof(UVLUT));
+    if (!uvTables)
+        throw std::runtime_error(std::string("ColorMatrix:  malloc failure (uvTables)!"));
+    for (int s=0; s<NUM_MATRICES; ++s)
+    {
+        const int m = MODE(s,dest);
+        UVLUT *t = uvTables+s*65536;
+        CFS cs;
+        fill_cfs(m, cs);
+        // the chroma clamps go into the table, they are 0/255 without clamp
+        for (int u=0; u<256; ++u)
         {
-            for (int b=0; b<vi.format->numPlanes; ++b)
+            const int cu = clampi(u, cs.inmin[1], cs.inmax[1])-128;
+            for (int v=0; v<256; ++v)
             {
-                const unsigned char* srcp = vsapi->getReadPtr(src, b); // src->GetReadPtr();
-                unsigned char* dstp = vsapi->getWritePtr(dst, b); // dst->GetWritePtr();
-                const int hslice = src_height/threads;
-                const int hremain = src_height%threads;
-                for (int tc=0; tc<threads; ++tc)
-                {
-                    pssInfo[tc]->width = src_width;
-                    if (thrdmthd == 1)
-                    {
-                        pssInfo[tc]->dst_pitch = dst_pitch*threads;
-                        pssInfo[tc]->src_pitch = src_pitch*threads;
-                        pssInfo[tc]->dstp = dstp+tc*dst_pitch;
-                        pssInfo[tc]->srcp = srcp+tc*src_pitch;
-                        pssInfo[tc]->height = tc < hremain ? hslice+1 : hslice;
-                    }
-                    else
-                    {
-                        pssInfo[tc]->dst_pitch = dst_pitch;
-                        pssInfo[tc]->src_pitch = src_pitch;
-                        pssInfo[tc]->dstp = dstp+hslice*tc*dst_pitch;
-                        pssInfo[tc]->srcp = srcp+hslice*tc*src_pitch;
-                        pssInfo[tc]->height = tc == threads-1 ? hslice+hremain : hslice;
-                    }
-                    ResetEvent(pssInfo[tc]->jobFinished);
-                    SetEvent(pssInfo[tc]->nextJob);
-                }
-                for (int tc=0; tc<threads; ++tc)
-                    WaitForSingleObject(pssInfo[tc]->jobFinished,INFINITE);
+                const int cv = clampi(v, cs.inmin[1], cs.inmax[1])-128;
+                t[(u<<8)|v].uvval = cs.c2*cu + cs.c3*cv + cs.c8;
+                t[(u<<8)|v].u = clampi((cs.c4*cu + cs.c5*cv + 8421376) >> 16, cs.outmin[1], cs.outmax[1]);
+                t[(u<<8)|v].v = clampi((cs.c6*cu + cs.c7*cv + 8421376) >> 16, cs.outmin[1], cs.outmax[1]);
             }
         }
-        if (vi.format->id == pfYUV420P8)
+        modeTables[m] = t;
+    }
+    for (int s=0; s<NUM_MATRICES; ++s)
+    {
+        const int m = MODE(s,dest);
+        const bool range = yuv_convert[m][0][0] != 65536;
+        ConvFunc proc = yuy2 ? RC_KERNEL(lut_YUY2_C) : RC_KERNEL(lut_YV12_C);
+        if (lut == 2 && vi.width > 0)
         {
-            const unsigned char* srcp = vsapi->getReadPtr(src, PLANAR_Y); // src->GetReadPtr(PLANAR_Y);
-            const unsigned char* srcpV = vsapi->getReadPtr(src, PLANAR_V); // src->GetReadPtr(PLANAR_V);
-            const unsigned char* srcpU = vsapi->getReadPtr(src, PLANAR_U); // src->GetReadPtr(PLANAR_U);
-
-            int row_size = vsapi->getFrameWidth(src, PLANAR_Y) * vi.format->bytesPerSample;
-            int r = (row_size + 32 - 1) & (~(32 - 1)); // Aligned rowsize
-            if (r > vsapi->getStride(src, PLANAR_Y))
-                r = row_size;
-
-            const int src_widtha = r; // src->GetRowSize(PLANAR_Y_ALIGNED);
-            const int src_pitchUV = vsapi->getStride(src, PLANAR_U); // src->GetPitch(PLANAR_U);
-            const int src_widthUV = vsapi->getFrameWidth(src, PLANAR_U) * vi.format->bytesPerSample; // src->GetRowSize(PLANAR_U);
-            const int src_heightUV = vsapi->getFrameHeight(src, PLANAR_U); // src->GetHeight(PLANAR_U);
-            unsigned char* dstp = vsapi->getWritePtr(dst, PLANAR_Y); // dst->GetWritePtr(PLANAR_Y);
-            unsigned char* dstpV = vsapi->getWritePtr(dst, PLANAR_V); // dst->GetWritePtr(PLANAR_V);
-            unsigned char* dstpU = vsapi->getWritePtr(dst, PLANAR_U); // dst->GetWritePtr(PLANAR_U);
-            const int dst_pitchUV = vsapi->getStride(dst, PLANAR_U); // dst->GetPitch(PLANAR_U);
-            const int hslice = (src_height>>1)/threads;
-            const int hremain = (src_height>>1)%threads;
-            for (int tc=0; tc<threads; ++tc)
+            // the other SIMD kernels can be 1 off, so they don't get to race
+            const ConvFunc exactProc = !(cpu&CPUF_SSE2) ? (yuy2 ? RC_KERNEL(conv_YUY2_C) : RC_KERNEL(conv_YV12_C)) :
+                yuy2 ? RC_KERNEL(conv_YUY2_SSE2) : RC_KERNEL_NV(convx_YV12_SSE2, 0);
+            const char *exactName = (cpu&CPUF_SSE2) ? "SSE2 exact" : "C";
+            CFS cs;
+            fill_cfs(m, cs);
+            cs.uvtable = modeTables[m];
+            const double tl = time_kernel(proc, &cs);
+            const double ta = time_kernel(exactProc, &cs);
+            if (debug)
             {
-                pssInfo[tc]->width = src_width;
-                pssInfo[tc]->widtha = src_widtha;
-                if (thrdmthd == 1)
-                {
-                    pssInfo[tc]->dst_pitch = dst_pitch*threads;
-                    pssInfo[tc]->dst_pitchR = dst_pitch;
-                    pssInfo[tc]->dst_pitchUV = dst_pitchUV*threads;
-                    pssInfo[tc]->src_pitch = src_pitch*threads;
-                    pssInfo[tc]->src_pitchR = src_pitch;
-                    pssInfo[tc]->src_pitchUV = src_pitchUV*threads;
-                    pssInfo[tc]->dstp = dstp+tc*dst_pitch*2;
-                    pssInfo[tc]->dstpn = pssInfo[tc]->dstp+dst_pitch;
-                    pssInfo[tc]->dstpU = dstpU+tc*dst_pitchUV;
-                    pssInfo[tc]->dstpV = dstpV+tc*dst_pitchUV;
-                    pssInfo[tc]->srcp = srcp+tc*src_pitch*2;
-                    pssInfo[tc]->srcpn = pssInfo[tc]->srcp+src_pitch;
-                    pssInfo[tc]->srcpU = srcpU+tc*src_pitchUV;
-                    pssInfo[tc]->srcpV = srcpV+tc*src_pitchUV;
-                    pssInfo[tc]->height = tc < hremain ? (hslice+1)*2 : hslice*2;
-                }
-                else
-                {
-                    pssInfo[tc]->dst_pitch = dst_pitch;
-                    pssInfo[tc]->dst_pitchR = dst_pitch;
-                    pssInfo[tc]->dst_pitchUV = dst_pitchUV;
-                    pssInfo[tc]->src_pitch = src_pitch;
-                    pssInfo[tc]->src_pitchR = src_pitch;
-                    pssInfo[tc]->src_pitchUV = src_pitchUV;
-                    pssInfo[tc]->dstp = dstp+hslice*tc*dst_pitch*2;
-                    pssInfo[tc]->dstpn = pssInfo[tc]->dstp+dst_pitch;
-                    pssInfo[tc]->dstpU = dstpU+hslice*tc*dst_pitchUV;
-                    pssInfo[tc]->dstpV = dstpV+hslice*tc*dst_pitchUV;
-                    pssInfo[tc]->srcp = srcp+hslice*tc*src_pitch*2;
-                    pssInfo[tc]->srcpn = pssInfo[tc]->srcp+src_pitch;
-                    pssInfo[tc]->srcpU = srcpU+hslice*tc*src_pitchUV;
-                    pssInfo[tc]->srcpV = srcpV+hslice*tc*src_pitchUV;
-                    pssInfo[tc]->height = tc == threads-1 ? (hslice+hremain)*2 : hslice*2;
-                }
-                ResetEvent(pssInfo[tc]->jobFinished);
-                SetEvent(pssInfo[tc]->nextJob);
+                fprintf(stderr, "ColorMatrix:%u:  %s->%s:  lut %.1f us, %s %.1f us\n", 
+                    GetCurrentThreadId(), MTS(s), MTS(dest), tl, exactName, ta);
+            }
+            if (tl >= ta)
+            {
+                modeProcs[m] = exactProc;
+                modeProcNames[m] = exactName;
+                continue;
             }
-            for (int tc=0; tc<threads; ++tc)
-                WaitForSingleObject(pssInfo[tc]->jobFinished,INFINITE);
         }
-        // Release the source frame
-        vsapi->freeFrame(src);
-        return dst;
+        modeProcs[m] = proc;
+        modeProcNames[m] = "C lut";
     }
-    return NULL;
 }
 
-void ColorMatrix::getHint(const unsigned char *srcp, int &color)
+// Best of a few runs of a kernel over a 32 line dummy frame, in microseconds.
+double ColorMatrix::time_kernel(ConvFunc proc, const CFS *cs)
 {
-    color = -1;
-    unsigned int i, hint = 0, magic_number = 0;
-    for (i=0; i<32; ++i)
+    const bool yuy2 = vi.format->id == pfCompatYUY2;
+    const int width = yuy2 ? vi.width*2 : vi.width;
+    const int pitch = (width+31)&~31;
+    const int pitchUV = yuy2 ? 0 : ((vi.width>>1)+31)&~31;
+    const int lines = 32;
+    const int size = pitch*lines + pitchUV*lines;
+    unsigned char *src = vs_aligned_malloc<unsigned char>(size, 32);
+    unsigned char *dst = vs_aligned_malloc<unsigned char>(size, 32);
+    int *uvval = vs_aligned_malloc<int>(pitch*sizeof(int), 16);
+    if (!src || !dst || !uvval)
     {
-        magic_number |= ((*srcp++ & 1) << i);
+        vs_aligned_free(src);
+        vs_aligned_free(dst);
+        vs_aligned_free(uvval);
+        throw std::runtime_error(std::string("ColorMatrix:  malloc failure (time_kernel)!"));
     }
-    if (magic_number != MAGIC_NUMBER) return;
-    for (i=0; i<32; ++i)
+    // smooth ramps, random chroma would make the table look worse than it is
+    for (int i=0; i<size; ++i)
+        src[i] = (unsigned char)((i%pitch)/3 + (i/pitch)*5);
+    // zeroed so that the fields the timing doesn't need are still defined
+    PS_INFO *pss = (PS_INFO*)calloc(1, sizeof(PS_INFO));
+    if (!pss)
     {
-        hint |= ((*srcp++ & 1) << i);
+        vs_aligned_free(src);
+        vs_aligned_free(dst);
+        vs_aligned_free(uvval);
+        throw std::runtime_error(std::string("ColorMatrix:  malloc failure (time_kernel)!"));
     }
-    if (hint&0xFFFFFFE0) return; // this will need to be changed if more hint fields are added
-    color = (hint&COLORIMETRY)>>COLORIMETRY_SHIFT;
-    if (color != 1 && (color < 4 || color > 7))
-        color = -1;
-}
-
-void ColorMatrix::checkMode(const char *md, const VSAPI *vsapi)
-{
-    source = dest = -1;
-    if (lstrcmpi(md, "Rec.709->Rec.709") == 0) { source = 0; dest = 0; }
-    if (lstrcmpi(md, "Rec.709->FCC") == 0) { source = 0; dest = 1; }
-    if (lstrcmpi(md, "Rec.709->Rec.601") == 0) { source = 0; dest = 2; }
-    if (lstrcmpi(md, "Rec.709->SMPTE 240M") == 0) { source = 0; dest = 3; }
-    if (lstrcmpi(md, "FCC->Rec.709") == 0) { source = 1; dest = 0; }
-    if (lstrcmpi(md, "FCC->FCC") == 0) { source = 1; dest = 1; }
-    if (lstrcmpi(md, "FCC->Rec.601") == 0) { source = 1; dest = 2; }
-    if (lstrcmpi(md, "FCC->SMPTE 240M") == 0) { source = 1; dest = 3; }
-    if (lstrcmpi(md, "Rec.601->Rec.709") == 0) { source = 2; dest = 0; }
-    if (lstrcmpi(md, "Rec.601->FCC") == 0) { source = 2; dest = 1; }
-    if (lstrcmpi(md, "Rec.601->Rec.601") == 0) { source = 2; dest = 2; }
-    if (lstrcmpi(md, "Rec.601->SMPTE 240M") == 0) { source = 2; dest = 3; }
-    if (lstrcmpi(md, "SMPTE 240M->Rec.709") == 0) { source = 3; dest = 0; }
-    if (lstrcmpi(md, "SMPTE 240M->FCC") == 0) { source = 3; dest = 1; }
-    if (lstrcmpi(md, "SMPTE 240M->Rec.601") == 0) { source = 3; dest = 2; }
-    if (lstrcmpi(md, "SMPTE 240M->SMPTE 240M") == 0) { source = 3; dest = 3; }
-    if (source == -1 || dest == -1)
-        throw std::runtime_error(std::string("ColorMatrix:  invalid mode string!"));
+    pss->cs = cs;
+    pss->uvval = uvval;
+    pss->hint = -1;
+    pss->linestep = 1;
+    pss->ylut = range_luts[inputFR][0];
+    pss->uvlut = range_luts[inputFR][1];
+    pss->width = width;
+    pss->widtha = pitch;
+    pss->height = lines;
+    pss->srcp = src;
+    pss->dstp = dst;
+    pss->src_pitch = pss->src_pitchR = pitch;
+    pss->dst_pitch = pss->dst_pitchR = pitch;
+    pss->srcpn = src+pitch;
+    pss->dstpn = dst+pitch;
+    pss->srcpU = src+pitch*lines;
+    pss->dstpU = dst+pitch*lines;
+    pss->srcpV = pss->srcpU+pitchUV*(lines>>1);
+    pss->dstpV = pss->dstpU+pitchUV*(lines>>1);
+    pss->src_pitchUV = pss->dst_pitchUV = pitchUV;
+    LARGE_INTEGER freq, start, end;
+    QueryPerformanceFrequency(&freq);
+    double best = DBL_MAX;
+    for (int r=0; r<5; ++r)
+    {
+        QueryPerformanceCounter(&start);
+        for (int i=0; i<4; ++i)
+            proc(pss);
+        QueryPerformanceCounter(&end);
+        best = (std::min)(best, (end.QuadPart-start.QuadPart)*1000000.0/freq.QuadPart);
+    }
+    free(pss);
+    vs_aligned_free(src);
+    vs_aligned_free(dst);
+    vs_aligned_free(uvval);
+    return best;
 }
 
-int ColorMatrix::findMode(int color)
+// Largest difference between the output of a kernel and a reference kernel
+// over the same 32 line dummy frame, YV12 in 8 bit steps or float/half 4:4:4
+// in float units.  Only the debug output at creation uses it.
+double ColorMatrix::diff_kernels(ConvFunc proc, ConvFunc ref, const CFS *cs)
 {
-    if (color == 1 && dest != 0) 
-        return dest;
-    else if (color == 4 && dest != 1)
-        return 4+dest;
-    else if ((color == 5 || color == 6) && dest != 2)
-        return 8+dest;
-    else if (color == 7 && dest != 3)
-        return 12+dest;
-    if (inputFR != outputFR)
-        return -2;
-    return -1;
+    const int bps = fp ? bits/8 : 1;
+    const int ss = fp ? 0 : 1;
+    const int width = vi.width*bps;
+    const int widthUV = (vi.width>>ss)*bps;
+    const int pitch = (width+31)&~31;
+    const int pitchUV = (widthUV+31)&~31;
+    const int lines = 32, linesUV = lines>>ss;
+    const int size = pitch*lines + pitchUV*linesUV*2;
+    unsigned char *src = vs_aligned_malloc<unsigned char>(size, 32);
+    unsigned char *dst[2] = { vs_aligned_malloc<unsigned char>(size, 32), vs_aligned_malloc<unsigned char>(size, 32) };
+    int *uvval = vs_aligned_malloc<int>(pitch*sizeof(int), 16);
+    PS_INFO *pss = (PS_INFO*)calloc(1, sizeof(PS_INFO));
+    if (!src || !dst[0] || !dst[1] || !uvval || !pss)
+    {
+        vs_aligned_free(src);
+        vs_aligned_free(dst[0]);
+        vs_aligned_free(dst[1]);
+        vs_aligned_free(uvval);
+        free(pss);
+        throw std::runtime_error(std::string("ColorMatrix:  malloc failure (diff_kernels)!"));
+    }
+    // the same ramps as time_kernel, luma 0-1 and chroma -0.5-0.5 for float
+    for (int i=0; i<size; ++i)
+    {
+        const int p = i < pitch*lines ? 0 : 1;
+        const int off = p ? i-pitch*lines : i;
+        const int pt = p ? pitchUV : pitch;
+        if (!fp)
+            src[i] = (unsigned char)((i%pitch)/3 + (i/pitch)*5);
+        else if (i%bps == 0)
+        {
+            const float f = ((off%pt)/bps + (off/pt)*7)%256/255.0f - (p ? 0.5f : 0.0f);
+            if (bps == 4)
+                *(float*)(src+i) = f;
+            else
+                *(unsigned short*)(src+i) = float_to_half(f);
+        }
+    }
+    memset(dst[0], 0, size);
+    memset(dst[1], 0, size);
+    pss->cs = cs;
+    pss->uvval = uvval;
+    pss->hint = -1;
+    pss->linestep = 1;
+    pss->ylut = range_luts[inputFR][0];
+    pss->uvlut = range_luts[inputFR][1];
+    pss->width = width;
+    pss->widtha = pitch;
+    pss->height = lines;
+    pss->srcp = src;
+    pss->src_pitch = pss->src_pitchR = pitch;
+    pss->dst_pitch = pss->dst_pitchR = pitch;
+    pss->srcpn = src+pitch;
+    pss->srcpU = src+pitch*lines;
+    pss->srcpV = pss->srcpU+pitchUV*linesUV;
+    pss->src_pitchUV = pss->dst_pitchUV = pitchUV;
+    for (int k=0; k<2; ++k)
+    {
+        pss->dstp = dst[k];
+        pss->dstpn = dst[k]+pitch;
+        pss->dstpU = dst[k]+pitch*lines;
+        pss->dstpV = pss->dstpU+pitchUV*linesUV;
+        (k ? ref : proc)(pss);
+    }
+    double diff = 0.0;
+    for (int p=0; p<3; ++p)
+    {
+        const int base = p ? pitch*lines + pitchUV*linesUV*(p-1) : 0;
+        const int pt = p ? pitchUV : pitch;
+        for (int y=0; y<(p ? linesUV : lines); ++y)
+        {
+            for (int x=0; x<(p ? widthUV : width); x+=bps)
+            {
+                const unsigned char *a = dst[0]+base+y*pt+x, *b = dst[1]+base+y*pt+x;
+                const double d = !fp ? abs(*a-*b) : bps == 4 ? fabs(*(const float*)a-*(const float*)b) :
+                    fabs(half_to_float(*(const unsigned short*)a)-half_to_float(*(const unsigned short*)b));
+                diff = (std::max)(diff, d);
+            }
+        }
+    }
+    free(pss);
+    vs_aligned_free(src);
+    vs_aligned_free(dst[0]);
+    vs_aligned_free(dst[1]);
+    vs_aligned_free(uvval);
+    return diff;
 }
 
-void (*find_YV12_SIMD(int modef, bool sse2))(void *ps)
+// Generates a kernel with the coefficients and the line width baked in for 
+// every mode that can end up at dest (hints and d2v only ever vary the 
+// source).  The output is identical to exact=true.  Modes the jit could not 
+// handle keep the kernel picked above.
+void ColorMatrix::jit_kernels()
 {
-    if (modef == 1 || modef == 2 || modef == 3 || 
-        modef == 13 || modef == 14)
-    {
-        if (sse2) return &conv1_YV12_SSE2;
-        return &conv1_YV12_MMX;
-    }
-    else if (modef == 4 || modef == 7 || modef == 8 || 
-        modef == 11 || modef == 12)
+    if (vi.width <= 0)
+        return;
+    const int widtha = (vi.width+31)&~31;
+    jitCode = (unsigned char*)VirtualAlloc(NULL, NUM_MATRICES*JIT_KERNEL_SIZE, 
+        MEM_COMMIT|MEM_RESERVE, PAGE_READWRITE);
+    if (!jitCode)
+        throw std::runtime_error(std::string("ColorMatrix:  VirtualAlloc failure (jit)!"));
+    int count = 0, size[NUM_MATRICES];
+    for (int s=0; s<NUM_MATRICES; ++s)
     {
-        if (sse2) return &conv2_YV12_SSE2;
-        return &conv2_YV12_MMX;
+        const int m = MODE(s,dest);
+        const int offset = s*JIT_KERNEL_SIZE;
+        CFS cs;
+        fill_cfs(m, cs);
+        int unwind = 0;
+        size[s] = jit_YV12_SSE2(jitCode+offset, JIT_KERNEL_SIZE, &cs, widtha, unwind);
+        if (size[s] > 0)
+        {
+#ifdef _M_X64
+            jitFuncs[count].BeginAddress = offset;
+            jitFuncs[count].EndAddress = offset+size[s];
+            jitFuncs[count].UnwindData = offset+unwind;
+#endif
+            ++count;
+        }
     }
-    else if (modef == 6)
+    // the kernels are only published once they are executable and unwindable, 
+    // the SSE2 intrinsic kernels stay otherwise
+    DWORD old;
+    bool ok = count && VirtualProtect(jitCode, NUM_MATRICES*JIT_KERNEL_SIZE, PAGE_EXECUTE_READ, &old);
+#ifdef _M_X64
+    ok = ok && RtlAddFunctionTable(jitFuncs, count, (DWORD64)jitCode);
+#endif
+    if (!ok)
     {
-        if (sse2) return &conv3_YV12_SSE2;
-        return &conv3_YV12_MMX;
+        VirtualFree(jitCode, 0, MEM_RELEASE);
+        jitCode = NULL;
+        return;
     }
-    else if (modef == 9)
+    FlushInstructionCache(GetCurrentProcess(), jitCode, NUM_MATRICES*JIT_KERNEL_SIZE);
+    for (int s=0; s<NUM_MATRICES; ++s)
     {
-        if (sse2) return &conv4_YV12_SSE2;
-        return &conv4_YV12_MMX;
+        if (size[s] > 0)
+        {
+            modeProcs[MODE(s,dest)] = (ConvFunc)(jitCode+s*JIT_KERNEL_SIZE);
+            modeProcNames[MODE(s,dest)] = "SSE2 jit";
+        }
     }
-    return NULL;
 }
 
 int ColorMatrix::parseD2V(const char *d2v)
@@ -964,14 +3616,64 @@ void ColorMatrix::solve_coefficients(double cm[3][3], double rgb[3][3], double y
     }
 }
 
-void ColorMatrix::calc_coefficients(const VSAPI *vsapi)
+void ColorMatrix::init_tables()
+{
+    for (int r=0; r<4; ++r)
+        calc_coefficients(std_convert[r], std_convertd[r], (r&1) != 0, (r&2) != 0, 0.0, 0.0, false);
+    for (int fr=0; fr<2; ++fr)
+    {
+        double c0y, c1y, c0uv, c1uv;
+        if (fr)
+        {
+            c0y = 219.0/255.0;
+            c1y = 16.0+0.5;
+            c0uv = 224.0/255.0;
+        }
+        else
+        {
+            c0y = 255.0/219.0;
+            c1y = -16.0*255.0/219.0+0.5;
+            c0uv = 255.0/224.0;
+        }
+        c1uv = -128.0*c0uv+128.0+0.5;
+        for (int j=0; j<256; ++j)
+        {
+            range_luts[fr][0][j] = CB((int)(j*c0y+c1y));
+            range_luts[fr][1][j] = CB((int)(j*c0uv+c1uv));
+        }
+    }
+    // bit reversed interleave of x^y and y gives the recursive Bayer pattern
+    for (int y=0; y<16; ++y)
+    {
+        for (int x=0; x<16; ++x)
+        {
+            int v = 0;
+            for (int b=0; b<4; ++b)
+                v |= (((x^y)>>b)&1)<<(2*(3-b)+1) | ((y>>b)&1)<<(2*(3-b));
+            dither_matrix[y][x] = (unsigned char)v;
+        }
+    }
+}
+
+// RGB->YUV (yuvd) and YUV->RGB (rgbd) for every matrix, with RGB and Y in 
+// 0-1 and U/V in -0.5-0.5.  The custom matrix comes from kr/kb.
+void ColorMatrix::calc_rgb_coefficients(double yuv_coeff[NUM_MATRICES][3][3], 
+    double rgb_coeffd[NUM_MATRICES][3][3], double kr, double kb)
 {
-    double yuv_coeff[4][3][3];
-    for (int i=0; i<4; ++i)
+    for (int i=0; i<NUM_MATRICES; ++i)
     {
-        yuv_coeff[i][0][0] = yuv_coeffs_luma[i][0];
-        yuv_coeff[i][0][1] = yuv_coeffs_luma[i][1];
-        yuv_coeff[i][0][2] = yuv_coeffs_luma[i][2];
+        if (i == MATRIX_CUSTOM)
+        {
+            yuv_coeff[i][0][0] = 1.0-kr-kb;
+            yuv_coeff[i][0][1] = kb;
+            yuv_coeff[i][0][2] = kr;
+        }
+        else
+        {
+            yuv_coeff[i][0][0] = yuv_coeffs_luma[i][0];
+            yuv_coeff[i][0][1] = yuv_coeffs_luma[i][1];
+            yuv_coeff[i][0][2] = yuv_coeffs_luma[i][2];
+        }
         const double bscale = .5/(1.0-yuv_coeff[i][0][1]);
         const double rscale = .5/(1.0-yuv_coeff[i][0][2]);
         yuv_coeff[i][1][0] = -yuv_coeff[i][0][0]*bscale;
@@ -981,10 +3683,18 @@ void ColorMatrix::calc_coefficients(const VSAPI *vsapi)
         yuv_coeff[i][2][1] = -yuv_coeff[i][0][1]*rscale;
         yuv_coeff[i][2][2] = (1.0-yuv_coeff[i][0][2])*rscale;
     }
-    double rgb_coeffd[4][3][3];
-    double yuv_convertd[16][3][3];
-    for (int i=0; i<4; ++i)
+    for (int i=0; i<NUM_MATRICES; ++i)
         inverse3x3(rgb_coeffd[i], yuv_coeff[i]);
+}
+
+// Fills cv (16.16) and cvd (unrounded) for the conversions between the 
+// built-in matrices, or with custom set only for the ones to or from the 
+// kr/kb matrix.
+void ColorMatrix::calc_coefficients(int cv[NUM_MODES][3][3], double cvd[NUM_MODES][3][3], 
+    bool inputFR, bool outputFR, double kr, double kb, bool custom)
+{
+    double yuv_coeff[NUM_MATRICES][3][3], rgb_coeffd[NUM_MATRICES][3][3];
+    calc_rgb_coefficients(yuv_coeff, rgb_coeffd, kr, kb);
     double yiscale = 1.0/255.0, uviscale = 1.0/255.0;
     double yoscale = 255.0, uvoscale = 255.0;
     if (!inputFR)
@@ -997,23 +3707,31 @@ void ColorMatrix::calc_coefficients(const VSAPI *vsapi)
         yoscale = 219.0;
         uvoscale = 224.0;
     }
-    int v = 0;
-    for (int i=0; i<4; ++i)
+    for (int i=0; i<NUM_MATRICES; ++i)
     {
-        for (int j=0; j<4; ++j)
+        for (int j=0; j<NUM_MATRICES; ++j)
         {
-            solve_coefficients(yuv_convertd[v], rgb_coeffd[i], yuv_coeff[j],
+            const int v = MODE(i,j);
+            if ((i == MATRIX_CUSTOM || j == MATRIX_CUSTOM) != custom)
+                continue;
+            solve_coefficients(cvd[v], rgb_coeffd[i], yuv_coeff[j],
                 yiscale, uviscale, yoscale, uvoscale);
             for (int k=0; k<3; ++k)
             {
-                yuv_convert[v][k][0] = ns(yuv_convertd[v][k][0]);
-                yuv_convert[v][k][1] = ns(yuv_convertd[v][k][1]);
-                yuv_convert[v][k][2] = ns(yuv_convertd[v][k][2]);
+                cv[v][k][0] = ns(cvd[v][k][0]);
+                cv[v][k][1] = ns(cvd[v][k][1]);
+                cv[v][k][2] = ns(cvd[v][k][2]);
             }
-            if ((yuv_convert[v][0][0] != 65536 && inputFR == outputFR) || 
-                yuv_convert[v][1][0] != 0 || yuv_convert[v][2][0] != 0)
+            if ((cv[v][0][0] != 65536 && inputFR == outputFR) || 
+                cv[v][1][0] != 0 || cv[v][2][0] != 0)
                 throw std::runtime_error(std::string("ColorMatrix:  error calculating conversion coefficients!"));
-            ++v;
+            for (int k=0; k<3; ++k)
+            {
+                // the simd kernels can only represent magnitudes below 2.0
+                if (abs(cv[v][k][1]) >= 131070 || abs(cv[v][k][2]) >= 131070 || 
+                    cv[v][k][0] >= 131070)
+                    throw std::runtime_error(std::string("ColorMatrix:  conversion coefficients out of range (check kr/kb)!"));
+            }
         }
     }
 }
@@ -1021,82 +3739,169 @@ void ColorMatrix::calc_coefficients(const VSAPI *vsapi)
 void VS_CC Create_ColorMatrix(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) 
 {
     int err;
+    CM_ARGS args;
     VSNodeRef *return_clip = vsapi->propGetNode(in, "clip", 0, NULL);
     const VSVideoInfo *vi = vsapi->getVideoInfo(return_clip);
-    const char *mode = vsapi->propGetData(in, "mode", 0, &err);
+    args.mode = vsapi->propGetData(in, "mode", 0, &err);
+    if (err)
+    {
+        args.mode = "";
+    }
+    args.source = vsapi->propGetInt(in, "source", 0, &err);
+    if (err)
+    {
+        args.source = 0;
+    }
+    args.dest = vsapi->propGetInt(in, "dest", 0, &err);
+    if (err)
+    {
+        args.dest = 2;
+    }
+    args.clamp = vsapi->propGetInt(in, "clamp", 0, &err);
+    if (err)
+    {
+        args.clamp = vi->format->sampleType == stFloat ? 0 : 3; // float chains are left unclipped unless asked
+    }
+    args.interlaced = false;
+    if (vsapi->propGetInt(in, "interlaced", 0, &err) && vi->format->id != pfCompatYUY2 && 
+        (vi->format->subSamplingH == 1 || vi->format->colorFamily == cmRGB)) // rgb input gives 4:2:0 output
+    {
+        args.interlaced = true;
+    }
+    args.inputFR = vsapi->propGetInt(in, "inputFR", 0, &err);
+    if (err)
+    {
+        args.inputFR = false;
+    }
+    args.outputFR = vsapi->propGetInt(in, "outputFR", 0, &err);
+    if (err)
+    {
+        args.outputFR = false;
+    }
+    args.hints = vsapi->propGetInt(in, "hints", 0, &err);
+    if (err)
+    {
+        args.hints = false;
+    }
+    args.d2v = vsapi->propGetData(in, "d2v", 0, &err);
+    if (err)
+    {
+        args.d2v = "";
+    }
+    args.debug = vsapi->propGetInt(in, "debug", 0, &err);
+    if (err)
+    {
+        args.debug = false;
+    }
+    args.threads = vsapi->propGetInt(in, "threads", 0, &err);
+    if (err)
+    {
+        args.threads = 1;
+    }
+    args.thrdmthd = vsapi->propGetInt(in, "thrdmthd", 0, &err);
+    if (err)
+    {
+        args.thrdmthd = 0;
+    }
+    args.opt = vsapi->propGetInt(in, "opt", 0, &err);
+    if (err)
+    {
+        args.opt = 3;
+    }
+    args.writehints = vsapi->propGetInt(in, "writehints", 0, &err);
+    if (err)
+    {
+        args.writehints = false;
+    }
+    args.hintcache = vsapi->propGetInt(in, "hintcache", 0, &err);
+    if (err)
+    {
+        args.hintcache = 0;
+    }
+    args.kr = vsapi->propGetFloat(in, "kr", 0, &err);
+    if (err)
+    {
+        args.kr = 0.0;
+    }
+    args.kb = vsapi->propGetFloat(in, "kb", 0, &err);
     if (err)
     {
-        mode = "";
+        args.kb = 0.0;
     }
-    int source = vsapi->propGetInt(in, "source", 0, &err);
+    args.exact = vsapi->propGetInt(in, "exact", 0, &err);
     if (err)
     {
-        source = 0;
+        args.exact = false;
     }
-    int dest = vsapi->propGetInt(in, "dest", 0, &err);
+    args.jit = vsapi->propGetInt(in, "jit", 0, &err);
     if (err)
     {
-        dest = 2;
+        args.jit = false;
     }
-    int clamp = vsapi->propGetInt(in, "clamp", 0, &err);
+    args.lut = vsapi->propGetInt(in, "lut", 0, &err);
     if (err)
     {
-        clamp = 3;
+        args.lut = 0;
     }
-    bool interlaced = false;
-    if (vsapi->propGetInt(in, "interlaced", 0, &err) && vi->format->id == pfYUV420P8)
+    args.approx = vsapi->propGetInt(in, "approx", 0, &err);
+    if (err)
     {
-        interlaced = true;
+        args.approx = false;
     }
-    bool inputFR = vsapi->propGetInt(in, "inputFR", 0, &err);
+    args.rgb = vsapi->propGetInt(in, "rgb", 0, &err);
     if (err)
     {
-        inputFR = false;
+        args.rgb = false;
     }
-    bool outputFR = vsapi->propGetInt(in, "outputFR", 0, &err);
+    args.ycocg = vsapi->propGetInt(in, "ycocg", 0, &err);
     if (err)
     {
-        outputFR = false;
+        args.ycocg = false;
     }
-    bool hints = vsapi->propGetInt(in, "hints", 0, &err);
+    args.nv = vsapi->propGetInt(in, "nv", 0, &err);
     if (err)
     {
-        hints = false;
+        args.nv = false;
     }
-    const char *d2v = vsapi->propGetData(in, "d2v", 0, &err);
+    args.v210 = vsapi->propGetInt(in, "v210", 0, &err);
     if (err)
     {
-        d2v = "";
+        args.v210 = false;
     }
-    bool debug = vsapi->propGetInt(in, "debug", 0, &err);
+    args.gray = vsapi->propGetInt(in, "gray", 0, &err);
     if (err)
     {
-        debug = false;
+        args.gray = false;
     }
-    int threads = vsapi->propGetInt(in, "threads", 0, &err);
+    args.dupcache = vsapi->propGetInt(in, "dupcache", 0, &err);
     if (err)
     {
-        threads = 1;
+        args.dupcache = 0;
     }
-    int thrdmthd = vsapi->propGetInt(in, "thrdmthd", 0, &err);
+    args.depth = vsapi->propGetInt(in, "depth", 0, &err);
     if (err)
     {
-        thrdmthd = 0;
+        args.depth = vi->format->id == pfCompatYUY2 ? 8 : args.v210 ? 10 : vi->format->bitsPerSample;
+        if (args.rgb)
+            args.depth = vi->format->sampleType == stFloat ? 32 : args.depth > 8 ? 16 : 8;
+        else if (args.ycocg)
+            args.depth = (std::min)(args.depth+1, 16); // lossless for up to 15 bit input
+        else if (vi->format->colorFamily == cmYCoCg)
+            args.depth -= 1;
     }
-    int opt = vsapi->propGetInt(in, "opt", 0, &err);
+    args.dither = vsapi->propGetInt(in, "dither", 0, &err);
     if (err)
     {
-        opt = 3;
+        args.dither = 0;
     }
 
     try
     {
-        ColorMatrix *instance = new ColorMatrix(return_clip, mode, source, dest, clamp, interlaced, inputFR,
-            outputFR, hints, d2v, debug, threads, thrdmthd, opt, vsapi, core);
+        ColorMatrix *instance = new ColorMatrix(return_clip, args, vsapi, core);
         vsapi->createFilter(in, out, "colormatrix", ColorMatrix::ColorMatrixInit, ColorMatrix::ColorMatrixGetFrame, ColorMatrix::ColorMatrixFree, fmSerial, 0, instance, core);
         VSNodeRef *cref = vsapi->propGetNode(out, "clip", 0, 0);
 
-        if (interlaced) // interlaced
+        if (args.interlaced) // interlaced
         {
             VSPlugin *findPlugin = vsapi->getPluginId("com.vapoursynth.std", core);
             if (!findPlugin)
@@ -1128,30 +3933,6 @@ void VS_CC Create_ColorMatrix(const VSMap *in, VSMap *out, void *userData, VSCor
             //    env->ThrowError("ColorMatrix:  avisynth error invoking Weave (%s)!", e.msg);
             //}
         }
-        if (clamp>1) // clip output to 16-235/16-240 range
-        {
-            VSPlugin *findPlugin = vsapi->getPluginId("com.vapoursynth.avisynth", core);
-            if (!findPlugin)
-            {
-                throw std::runtime_error(std::string("Avisynth filters are not present."));
-            }
-            VSMap *args = vsapi->newMap();
-            vsapi->propSetNode(args, "c1", cref, 0);
-            VSMap *ret = vsapi->invoke(findPlugin, "Limiter", args);
-            cref = vsapi->propGetNode(ret, "clip", 0, 0);
-            //try
-            //{
-            //    return_clip = env->Invoke("Limiter", return_clip).AsClip();
-            //}
-            //catch (AvisynthCompat::IScriptEnvironment::NotFound)
-            //{
-            //    env->ThrowError("ColorMatrix:  error invoking Limiter (not found)!");
-            //}
-            //catch (AvisynthCompat::AvisynthError e)
-            //{
-            //    env->ThrowError("ColorMatrix:  avisynth error invoking Limiter (%s)!", e.msg);
-            //}
-        }
         vsapi->propSetNode(out, "clip", cref, 0);
         vsapi->freeNode(cref);
     }
@@ -1164,8 +3945,12 @@ void VS_CC Create_ColorMatrix(const VSMap *in, VSMap *out, void *userData, VSCor
 
 VS_EXTERNAL_API(void) VapourSynthPluginInit(VSConfigPlugin configFunc, VSRegisterFunction registerFunc, VSPlugin *plugin) 
 {
+    ColorMatrix::init_tables();
     configFunc("fake.domain.colormatrix", "colormatrix", "ColorMatrix", VAPOURSYNTH_API_VERSION, 1, plugin);
     registerFunc("ColorMatrix", "clip:clip;mode:data:opt;source:int:opt;dest:int:opt;clamp:int:opt;interlaced:int:opt;" \
-        "inputFR:int:opt;outputFR:int:opt;hints:int:opt;d2v:data:opt;debug:int:opt;threads:int:opt;thrdmthd:int:opt;opt:int:opt;", 
+        "inputFR:int:opt;outputFR:int:opt;hints:int:opt;d2v:data:opt;debug:int:opt;threads:int:opt;thrdmthd:int:opt;opt:int:opt;" \
+        "writehints:int:opt;hintcache:int:opt;kr:float:opt;kb:float:opt;exact:int:opt;jit:int:opt;lut:int:opt;" \
+        "approx:int:opt;depth:int:opt;dither:int:opt;rgb:int:opt;ycocg:int:opt;nv:int:opt;v210:int:opt;gray:int:opt;" \
+        "dupcache:int:opt;", 
         Create_ColorMatrix, NULL, plugin);
 }
\ No newline at end of file
@@ -30,7 +30,9 @@
 #include <process.h>
 #endif
 #include <xmmintrin.h>
+#include <emmintrin.h>
 #include <cfloat>
+#include <cmath>
 #include <cstdio>
 #include <stdexcept>
 #include <algorithm>
@@ -47,6 +49,11 @@
 #define MAGIC_NUMBER 0xdeadbeef
 #define COLORIMETRY 0x0000001C
 #define COLORIMETRY_SHIFT 2
+#define RANGE_FULL 0
+#define RANGE_LIMITED 1
+#define HINT_UNKNOWN 0
+#define HINT_MISSING 0xFF
+#define HINT_AHEAD 8 // hintcache=2:  hint frames requested past the current one
 #define CTS(n) n == 1 ? "Rec.709" : \
     n == 4 ? "FCC" : \
     n == 5 ? "Rec.601" : \
@@ -54,55 +61,139 @@
     n == 7 ? "SMPTE 240M" : \
     n == -1 ? "no hint found" : \
     "unknown"
-#define CTS2(n) n == 1 ? "Rec.709->FCC" : \
-    n == 2 ? "Rec.709->Rec.601" : \
-    n == 3 ? "Rec.709->SMPTE 240M" : \
-    n == 4 ? "FCC->Rec.709" : \
-    n == 6 ? "FCC->Rec.601" : \
-    n == 7 ? "FCC->SMPTE 240M" : \
-    n == 8 ? "Rec.601->Rec.709" : \
-    n == 9 ? "Rec.601->FCC" : \
-    n == 11 ? "Rec.601->SMPTE 240M" : \
-    n == 12 ? "SMPTE 240M->Rec.709" : \
-    n == 13 ? "SMPTE 240M->FCC" : \
-    n == 14 ? "SMPTE 240M->Rec.601" : \
-    "unknown"
+#define MTS(n) matrix_names[n]
+#define NUM_MATRICES 6
+#define MATRIX_CUSTOM 5
+#define NUM_MODES (NUM_MATRICES*NUM_MATRICES)
+#define MODE(s,d) ((s)*NUM_MATRICES+(d))
+#define MODE_SRC(n) ((n)/NUM_MATRICES)
+#define MODE_DST(n) ((n)%NUM_MATRICES)
 #define ns(n) n < 0 ? int(n*65536.0-0.5+DBL_EPSILON) : int(n*65536.0+0.5)
 #define CB(n) (std::max)((std::min)((n),255),0)
-#define simd_scale(n) n >= 65536 ? (n+2)>>2 : n >= 32768 ? (n+1)>>1 : n;
+#define JIT_KERNEL_SIZE 16384
+// 65535 has to take the >>2 branch, (65535+1)>>1 would not fit a signed word
+#define simd_scale(n) ((n) >= 65535 ? ((n)+2)>>2 : (n) >= 32768 ? ((n)+1)>>1 : (n))
+
+// VS2012 is the first compiler with AVX2 intrinsics.  The Release and Debug 
+// configurations (v100) build without the AVX2 kernels, ReleaseAVX2 (v110) 
+// builds them and picks them at runtime when the cpu and os support AVX2.
+#if defined(_MSC_VER) && _MSC_VER >= 1700
+#define CM_AVX2
+#endif
 
-static double yuv_coeffs_luma[4][3] =
+// the custom matrix (5) is filled in from the kr/kb arguments
+static double yuv_coeffs_luma[NUM_MATRICES-1][3] =
 { 
     +0.7152, +0.0722, +0.2126, // Rec.709 (0)
     +0.5900, +0.1100, +0.3000, // FCC (1)
     +0.5870, +0.1140, +0.2990, // Rec.601 (ITU-R BT.470-2/SMPTE 170M) (2)
     +0.7010, +0.0870, +0.2120, // SMPTE 240M (3)
+    +0.6780, +0.0593, +0.2627, // Rec.2020 non-constant luminance (4)
+};
+
+static const char *matrix_names[NUM_MATRICES] = 
+{ 
+    "Rec.709", "FCC", "Rec.601", "SMPTE 240M", "Rec.2020", "Custom" 
 };
 
+// colorimetry codes (as used by hints, d2v files, and _Matrix) for each matrix,
+// 2 is 'unspecified'.  Hints only have room for codes up to 7.
+static const int matrix_colorimetry[NUM_MATRICES] = { 1, 4, 6, 7, 9, 2 };
+
 __declspec(align(16)) const int64_t Q32[2] = { 0x0020002000200020, 0x0020002000200020 };
 __declspec(align(16)) const int64_t Q64[2] = { 0x0040004000400040, 0x0040004000400040 };
 __declspec(align(16)) const int64_t Q128[2] = { 0x0080008000800080, 0x0080008000800080 };
 __declspec(align(16)) const int64_t Q8224[2] = { 0x2020202020202020, 0x2020202020202020 };
 __declspec(align(16)) const int64_t Q8 = 0x0000000000000008;
 
+typedef void (*ConvFunc)(void *ps);
+
+// Everything the chroma part of a conversion produces for one (u,v) pair.
+struct UVLUT {
+    int uvval;
+    unsigned char u, v;
+};
+
+// A converted frame kept for dupcache.  src stays referenced so that a hash 
+// match can be confirmed byte for byte before dst is handed out again.
+struct DupEntry {
+    uint64_t hash[2];
+    int modef;
+    const VSFrameRef *src, *dst;
+};
+
+// One immutable block per mode (plus one for range only conversion), built 
+// at init and handed to the workers by pointer.  The simd constants are 
+// broadcast once here instead of at the start of every slice.
 struct CFS {
+    __m128i sse2v[6];            // conv1-conv4:  |c2|-|c7| in simd_scale units
+    __m128i fact[6], shift[6];   // generic:  signed pmulhw factors and pre-shifts for c2-c7
+    __m128i fact_YY, bias_Y;     // generic:  luma scale and bias in 1/64 units
+    __m128i xhi[4], xlo[4];      // exact:  pmaddwd halves of (c2,c3) (c4,c5) (c6,c7) (c1,0)
+    __m128i xbias_Y;
+    __m128i aq[3], abias[3], ak[3];  // approx:  pmaddubsw pairs, -128 fixup and pmulhrsw scale for Y U V
+    __m128i afact_YY, abias_Y;       // approx:  luma scale and bias in 1/16 units
+    __m128i hq[4], hbias_Y, hbias_UV; // 9-16 bit:  pmaddwd pairs (c2,c3) (c4,c5) (c6,c7) (c1,0) and biases
+    __m128i hhalf, hclip[8];          // 9-16 bit:  in/out min/max for luma and chroma, less half
+    __m128i hlo[4], hlbias_Y, hlbias_UV; // 15/16 bit:  low 12 bits of the coefficients and biases, hq and hbias keep the rest
+    __m128 fv[8], fclipv[8];          // float:  fc and fclip broadcast
+    __m128i dbias[2], dclip[4];       // depth:  Y/UV biases and out min/max, less 32768
+    __m128i nclip[4];                 // narrow:  8 bit out min/max for luma and chroma
+    __m128 rcv[12], rclipv[4];        // rgb/rgbin:  rc and rclip broadcast
+    int64_t mmxv[6];
     int c1, c2, c3, c4;
     int c5, c6, c7, c8;
-    int n, modef;
+    int bits, hshift, cuv;  // 9-16 bit:  c1-c8 and the chroma bias cuv are in 2^-hshift units
+    int64_t wc8;            // 15/16 bit:  the luma bias at hshift 20 for centered y, u, v, and output, c8 is unused
+    bool fp;                // float or half, only fc and fclip are used then
+    int dshift;             // depth:  8 bit in, 24-dshift bit out, c1-c8 and cuv stay 16.16
+    int nshift;             // narrow:  9-16 bit or float in, 8 bit out, fraction bits of the sums
+    int rgb;                // rgb:  output depth (8, 16, or 32 for float), 0 for YUV output, ycocg:  the RGB depth inside
+    int rgbin;              // rgbin:  input depth (8-16, or 32 for float), 0 for YUV input, ycocgin:  the RGB depth inside
+    int inmin[2], inmax[2], outmin[2], outmax[2]; // integer:  luma/chroma clamps
+    float fc[8];     // float:  c1-c7 straight from the double matrix and the luma bias
+    float fclip[8];  // float:  in/out min/max for luma and chroma (chroma is centered on 0)
+    float rc[12];    // rgb:  Y, U, V factors and offset for R, G, and B, rgbin:  the other way round
+    float rclip[4];  // rgb:  luma in min/max and out min/max, rgbin:  luma and chroma out min/max
+    int modef;
+    bool approxFits; // every approx pair quantizes finely enough for the 1 LSB bound
     int64_t cpu;
-    bool debug;
+    bool debug, limitHints;
+    ConvFunc proc;
+    const char *procName, *format;
+    const UVLUT *uvtable;
+};
+
+// The filter arguments, filled in with their defaults by Create_ColorMatrix.
+struct CM_ARGS {
+    const char *mode, *d2v;
+    int source, dest, clamp;
+    bool interlaced, inputFR, outputFR, hints, debug;
+    int threads, thrdmthd, opt;
+    bool writehints;
+    int hintcache;
+    double kr, kb;
+    bool exact, jit, approx;
+    int lut, depth, dither;
+    bool rgb, ycocg, nv, v210, gray;
+    int dupcache;
 };
 
 struct PS_INFO {
-    int ylut[256], uvlut[256];
+    const int *ylut, *uvlut;
     const unsigned char *srcp, *srcpn;
     const unsigned char *srcpU, *srcpV;
-    int src_pitch, src_pitchR, src_pitchUV;
+    int src_pitch, src_pitchR, src_pitchUV, src_pitchUVR;
     int height, width, widtha;
     unsigned char *dstp, *dstpn;
     unsigned char *dstpU, *dstpV;
     int dst_pitch, dst_pitchR, dst_pitchUV;
-    CFS *cs;
+    int *uvval; // one line of chroma terms for the C kernels
+    int *dith;  // narrow:  sum rows and Sierra-lite error rows, rgb:  upsampled chroma rows
+    int line0, linestep; // first chroma line of the slice and the step to the next one
+    int linesUV;         // chroma lines in the frame
+    const CFS *cs;
+    int n, hint;
     HANDLE nextJob, jobFinished;
     bool finished;
 };
@@ -128,12 +219,27 @@ enum {
     CPUF_X86_64         = 0xA0,     // Hammer (note: equiv. to 3DNow + SSE2, which only Hammer
                                     // will have anyway)
     CPUF_SSE3		    = 0x100,    // Some P4 & Athlon 64.
+    CPUF_SSSE3          = 0x200,    // Core 2
+    CPUF_AVX2           = 0x2000,   // Haswell
+    CPUF_FMA3           = 0x4000,   // Haswell
+    CPUF_F16C           = 0x8000,   // Ivy Bridge
 };
 
+extern unsigned char dither_matrix[16][16];
+extern const uint64_t hash_secret[16];
+
 int num_processors();
-unsigned VS_CC processFrame_YUY2(void *ps);
-unsigned VS_CC processFrame_YV12(void *ps);
+int64_t cpu_extensions();
+void putHint(unsigned char *dstp, int color, bool limit);
+unsigned VS_CC processFrame(void *ps);
+template <bool CLAMP> void range_YUY2_C(void *ps);
+template <bool CLAMP> void range_YV12_C(void *ps);
+bool neutral_chroma_C(const unsigned char *srcp, int pitch, int width, int height);
+bool neutral_chroma_SSE2(const unsigned char *srcp, int pitch, int width, int height);
+void hash_plane_C(const unsigned char *srcp, int pitch, int width, int height, uint64_t acc[2]);
+void hash_plane_SSE2(const unsigned char *srcp, int pitch, int width, int height, uint64_t acc[2]);
 void (*find_YV12_SIMD(int modef, bool sse2))(void *ps);
+#ifdef _M_IX86
 void conv1_YV12_MMX(void *ps);
 void conv2_YV12_MMX(void *ps);
 void conv3_YV12_MMX(void *ps);
@@ -142,45 +248,109 @@ void conv1_YV12_SSE2(void *ps);
 void conv2_YV12_SSE2(void *ps);
 void conv3_YV12_SSE2(void *ps);
 void conv4_YV12_SSE2(void *ps);
+#endif
+template <bool RANGE, bool CLAMP> void conv_YV12_SSE2(void *ps);
+template <bool RANGE, int NV, bool CLAMP> void convx_YV12_SSE2(void *ps);
+template <bool RANGE, bool CLAMP> void conv_YUY2_SSE2(void *ps);
+template <int SSW, bool RANGE> void convx_YUVP8_SSE2(void *ps);
+template <int SSW, int SSH, bool RANGE> void convl_YUVP8_SSE2(void *ps);
+template <bool RANGE, bool CLAMP> void conva_YV12_SSSE3(void *ps);
+void conv_v210_SSSE3(void *ps);
+template <bool RANGE, int NV> void conv_YUV420P16_SSE2(void *ps);
+template <int NV> void conv_YUV420P16W_SSE2(void *ps);
+template <bool CLAMP> void conv_YUV444PS_SSE2(void *ps);
+template <bool ORDERED> void convn_YUV420P16_SSE2(void *ps);
+template <bool ORDERED> void convn_YUV444PS_SSE2(void *ps);
+template <int SSW, int SSH> void convd_YUVP8_SSE2(void *ps);
+template <typename T, int SSW, int SSH, typename D> void convr_YUVP_SSE2(void *ps);
+template <typename D> void convr_YUV444PS_SSE2(void *ps);
+template <typename T, typename D> void convy_RGB_SSE2(void *ps);
+template <typename T> void convc_YUV444_SSE2(void *ps);
+template <typename D> void convc_YCoCg_SSE2(void *ps);
+#ifdef CM_AVX2
+template <bool RANGE, bool CLAMP> void conva_YV12_AVX2(void *ps);
+template <typename T, bool CLAMP> void conv_YUV444F_AVX2(void *ps);
+#endif
+template <bool RANGE, bool CLAMP> void lut_YUY2_C(void *ps);
+template <bool RANGE, bool CLAMP> void lut_YV12_C(void *ps);
+void init_simd_constants(CFS *cs);
+int jit_YV12_SSE2(unsigned char *code, int maxsize, const CFS *cs, int widtha, int &unwind);
 
 class ColorMatrix
 {
 private:
-    int yuv_convert[16][3][3];
+    const int (*yuv_convert)[3][3];
+    int (*custom_convert)[3][3];
+    const double (*yuv_convertd)[3][3];
+    double (*custom_convertd)[3][3];
     const char *mode, *d2v;
     unsigned char *d2vArray;
-    bool hints, interlaced, debug;
+    unsigned char *hintArray;
+    bool hints, interlaced, debug, writehints, exact, jit, approx;
     bool inputFR, outputFR;
     int source, dest, modei, clamp;
-    int opt, threads, thrdmthd;
+    double kr, kb;
+    int opt, threads, thrdmthd, hintcache, lut, dupcache;
+    int bits, depth, dither;
+    bool neutral; // 8 bit planar in and out, frames with all chroma at 128 can skip the conversion
+    bool fp, rgb, rgbin, ycocg, ycocgin, nv, v210, gray;
+    double rgb_convertd[NUM_MATRICES][3][3], yuv_coeffd[NUM_MATRICES][3][3];
+    const VSFormat *dstFormat;
+    int hintFrames, hintKnown;
     VSNodeRef *child;
     VSNodeRef *hintClip;
     VSVideoInfo vi;
-    CFS css;
+    int64_t cpu;
+    CFS *modeCFS;
     unsigned *tids;
     HANDLE *thds;
     PS_INFO **pssInfo;
+    ConvFunc modeProcs[NUM_MODES], rangeProc;
+    const char *modeProcNames[NUM_MODES];
+    unsigned char *jitCode;
+#ifdef _M_X64
+    RUNTIME_FUNCTION jitFuncs[NUM_MATRICES]; // unwind info of the jit kernels, registered while jitCode is set
+#endif
+    UVLUT *uvTables;
+    const UVLUT *modeTables[NUM_MODES];
+    DupEntry *dupCache;
+    int dupNext, dupHits, dupFrames;
     int max_luma;
     int min_luma;
     int max_chroma;
     int min_chroma;
 
     void getHint(const unsigned char *srcp, int &color);
+    int getCachedHint(int hn, const VSFrameRef *hintf, const VSAPI *vsapi);
+    void printHintRuns();
     void checkMode(const char *md, const VSAPI *vsapi);
     int findMode(int color);
+    void hashFrame(const VSFrameRef *src, uint64_t hash[2], const VSAPI *vsapi);
+    bool sameFrame(const VSFrameRef *a, const VSFrameRef *b, const VSAPI *vsapi);
+    void setFrameProps(VSFrameRef *dst, const VSAPI *vsapi);
+    VSFrameRef *shareFrame(const VSFrameRef *src, int hint, bool clampLuma, VSCore *core, const VSAPI *vsapi);
     int parseD2V(const char *d2v);
-    void inverse3x3(double im[3][3], double m[3][3]);
-    void solve_coefficients(double cm[3][3], double rgb[3][3], double yuv[3][3],
+    static void inverse3x3(double im[3][3], double m[3][3]);
+    static void solve_coefficients(double cm[3][3], double rgb[3][3], double yuv[3][3],
         double yiscale, double uviscale, double yoscale, double uvoscale);
-    void calc_coefficients(const VSAPI *vsapi);
+    static void calc_rgb_coefficients(double yuv_coeff[NUM_MATRICES][3][3], 
+        double rgb_coeffd[NUM_MATRICES][3][3], double kr, double kb);
+    static void calc_coefficients(int cv[NUM_MODES][3][3], double cvd[NUM_MODES][3][3], 
+        bool inputFR, bool outputFR, double kr, double kb, bool custom);
+    void load_coefficients(int modef, CFS &cs);
+    void fill_cfs(int modef, CFS &cs);
+    bool approx_fits(int modef);
+    void select_kernels();
+    void jit_kernels();
+    void lut_kernels();
+    double time_kernel(ConvFunc proc, const CFS *cs);
+    double diff_kernels(ConvFunc proc, ConvFunc ref, const CFS *cs);
     static int get_num_processors();
 
 public:
-    ColorMatrix(VSNodeRef *_child, const char* _mode, int _source, int _dest, 
-        int _clamp, bool _interlaced, bool _inputFR, bool _outputFR, bool _hints, 
-        const char* _d2v, bool _debug, int _threads, int _thrdmthd, int _opt, 
-        const VSAPI *vsapi, VSCore *core);
+    ColorMatrix(VSNodeRef *_child, const CM_ARGS &args, const VSAPI *vsapi, VSCore *core);
     ~ColorMatrix();
+    static void init_tables();
     static const VSFrameRef *VS_CC ColorMatrixGetFrame(int n, int activationReason, void **instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi);
     const VSFrameRef *getFrame(int n, int activationReason, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi);
     static void VS_CC ColorMatrixInit(VSMap *in, VSMap *out, void **instanceData, VSNode *node, VSCore *core, const VSAPI *vsapi);
@@ -29,6 +29,10 @@
 
 #pragma warning(disable : 4311 4312)
 
+// MSVC only takes inline asm in x86 builds, x64 uses the intrinsic kernels 
+// and the jit instead.
+#ifdef _M_IX86
+
 #define GETPTRS() \
     const PS_INFO *pss = (PS_INFO*)ps; \
     const unsigned char *srcpY = pss->srcp; \
@@ -50,49 +54,15 @@
 
 #define GETMMXVS() \
     int loopctr = width>>3; \
-    __int64 fact_YU, fact_YV, fact_UU; \
-    __int64 fact_UV, fact_VV, fact_VU; \
-    getmmxv(fact_YU, pss->cs->c2); \
-    getmmxv(fact_YV, pss->cs->c3); \
-    getmmxv(fact_UU, pss->cs->c4); \
-    getmmxv(fact_UV, pss->cs->c5); \
-    getmmxv(fact_VU, pss->cs->c6); \
-    getmmxv(fact_VV, pss->cs->c7); \
-
-void getmmxv(__int64 &v, int c)
-{
-    c = abs(c);
-    c = simd_scale(c);
-    v = (c<<16)+c;
-    v += v<<32;
-}
+    const __int64 fact_YU = pss->cs->mmxv[0], fact_YV = pss->cs->mmxv[1]; \
+    const __int64 fact_UU = pss->cs->mmxv[2], fact_UV = pss->cs->mmxv[3]; \
+    const __int64 fact_VU = pss->cs->mmxv[4], fact_VV = pss->cs->mmxv[5]; \
 
 #define GETSSE2VS() \
     int loopctr = width>>4; \
-    __m128 fact_YU, fact_YV, fact_UU; \
-    __m128 fact_UV, fact_VV, fact_VU; \
-    getsse2v(&fact_YU, pss->cs->c2); \
-    getsse2v(&fact_YV, pss->cs->c3); \
-    getsse2v(&fact_UU, pss->cs->c4); \
-    getsse2v(&fact_UV, pss->cs->c5); \
-    getsse2v(&fact_VU, pss->cs->c6); \
-    getsse2v(&fact_VV, pss->cs->c7); \
-
-void getsse2v(__m128 *v, int c)
-{
-    __int64 t[2];
-    c = abs(c);
-    c = simd_scale(c);
-    t[0] = (c<<16)+c;
-    t[0] += t[0]<<32;
-    t[1] = t[0];
-    __asm
-    {
-        mov eax,v
-            movdqu xmm0,t
-            movdqa [eax],xmm0
-    }
-}
+    const __m128i fact_YU = pss->cs->sse2v[0], fact_YV = pss->cs->sse2v[1]; \
+    const __m128i fact_UU = pss->cs->sse2v[2], fact_UV = pss->cs->sse2v[3]; \
+    const __m128i fact_VU = pss->cs->sse2v[4], fact_VV = pss->cs->sse2v[5]; \
 
 void conv1_YV12_MMX(void *ps)
 {
@@ -1095,4 +1065,6 @@ xloop:
 end:
         emms
     }
-}
\ No newline at end of file
+}
+
+#endif // _M_IX86
@@ -0,0 +1,428 @@
+/*
+**                 ColorMatrix v2.5 for Avisynth 2.5.x
+**
+**   ColorMatrix 2.0 is based on the original ColorMatrix filter by Wilbert
+**   Dijkhof.  It adds the ability to convert between any of: Rec.709, FCC,
+**   Rec.601, and SMPTE 240M. It also makes pre and post clipping optional,
+**   adds range expansion/contraction, and more...
+**
+**   Copyright (C) 2006-2009 Kevin Stone
+**
+**   ColorMatrix 1.x is Copyright (C) Wilbert Dijkhof
+**
+**   This program is free software; you can redistribute it and/or modify
+**   it under the terms of the GNU General Public License as published by
+**   the Free Software Foundation; either version 2 of the License, or
+**   (at your option) any later version.
+**
+**   This program is distributed in the hope that it will be useful,
+**   but WITHOUT ANY WARRANTY; without even the implied warranty of
+**   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**   GNU General Public License for more details.
+**
+**   You should have received a copy of the GNU General Public License
+**   along with this program; if not, write to the Free Software
+**   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "ColorMatrix.h"
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__)
+
+// Minimal x86-64 SSE2 emitter.  Only the handful of instructions needed by
+// the YV12 kernel are supported, and every memory operand uses a 32 bit
+// displacement so that the encodings stay uniform.
+enum { RAX=0, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+#define NOINDEX -1
+#define RIP -2
+
+class JitEmitter
+{
+public:
+    std::vector<unsigned char> code;
+    std::vector<int> pool; // broadcast dwords, one 16 byte entry each
+    std::vector<std::pair<int,int> > fixups; // (disp32 position, pool entry)
+
+    void b(int v) { code.push_back((unsigned char)v); }
+    void d(int v) { for (int i=0; i<4; ++i) b((v>>(i*8))&0xFF); }
+    int pos() const { return (int)code.size(); }
+
+    void rex(bool w, int reg, int index, int base, bool force=false)
+    {
+        const int r = 0x40 | (w ? 8 : 0) | ((reg&8) ? 4 : 0) |
+            (index >= 0 && (index&8) ? 2 : 0) | (base >= 0 && (base&8) ? 1 : 0);
+        if (r != 0x40 || force)
+            b(r);
+    }
+    void modrm_reg(int reg, int rm) { b(0xC0 | ((reg&7)<<3) | (rm&7)); }
+    void modrm_mem(int reg, int base, int index, int scale, int disp, int entry=-1)
+    {
+        if (base == RIP)
+        {
+            b(((reg&7)<<3) | 5);
+            fixups.push_back(std::make_pair(pos(), entry));
+            d(0);
+            return;
+        }
+        if (index == NOINDEX && (base&7) != RSP)
+        {
+            b(0x80 | ((reg&7)<<3) | (base&7));
+        }
+        else
+        {
+            b(0x80 | ((reg&7)<<3) | 4);
+            const int ss = scale == 8 ? 3 : scale == 4 ? 2 : scale == 2 ? 1 : 0;
+            b((ss<<6) | ((index == NOINDEX ? RSP : index)&7)<<3 | (base&7));
+        }
+        d(disp);
+    }
+
+    // 66 0F op xmm, xmm
+    void sse(int op, int dst, int src) { b(0x66); rex(false, dst, NOINDEX, src); b(0x0F); b(op); modrm_reg(dst, src); }
+    // 66 0F op xmm, [pool entry]
+    void ssek(int op, int dst, int entry) { b(0x66); rex(false, dst, NOINDEX, RIP); b(0x0F); b(op); modrm_mem(dst, RIP, NOINDEX, 1, 0, entry); }
+    void ssem(int pfx, int op, int reg, int base, int index, int scale, int disp)
+    {
+        b(pfx); rex(false, reg, index, base); b(0x0F); b(op); modrm_mem(reg, base, index, scale, disp);
+    }
+    void shift(int ext, int dst, int imm) { b(0x66); rex(false, 0, NOINDEX, dst); b(0x0F); b(0x72); modrm_reg(ext, dst); b(imm); }
+
+    void movdqa(int dst, int src) { sse(0x6F, dst, src); }
+    void movdqa_load(int dst, int base, int index, int scale, int disp) { ssem(0x66, 0x6F, dst, base, index, scale, disp); }
+    void movdqa_store(int base, int index, int scale, int disp, int src) { ssem(0x66, 0x7F, src, base, index, scale, disp); }
+    void movq_load(int dst, int base, int index, int scale, int disp) { ssem(0xF3, 0x7E, dst, base, index, scale, disp); }
+    void movq_store(int base, int index, int scale, int disp, int src) { ssem(0x66, 0xD6, src, base, index, scale, disp); }
+    void punpcklbw(int dst, int src) { sse(0x60, dst, src); }
+    void punpckhbw(int dst, int src) { sse(0x68, dst, src); }
+    void punpcklwd(int dst, int src) { sse(0x61, dst, src); }
+    void punpckhwd(int dst, int src) { sse(0x69, dst, src); }
+    void punpckldq(int dst, int src) { sse(0x62, dst, src); }
+    void punpckhdq(int dst, int src) { sse(0x6A, dst, src); }
+    void packssdw(int dst, int src) { sse(0x6B, dst, src); }
+    void packuswb(int dst, int src) { sse(0x67, dst, src); }
+    void paddd(int dst, int src) { sse(0xFE, dst, src); }
+    void pxor(int dst, int src) { sse(0xEF, dst, src); }
+    void pslld(int dst, int imm) { shift(6, dst, imm); }
+    void psrad(int dst, int imm) { shift(4, dst, imm); }
+    void pmaddwd_k(int dst, int entry) { ssek(0xF5, dst, entry); }
+    void paddd_k(int dst, int entry) { ssek(0xFE, dst, entry); }
+    void pmaxub_k(int dst, int entry) { ssek(0xDE, dst, entry); }
+    void pminub_k(int dst, int entry) { ssek(0xDA, dst, entry); }
+
+    // general purpose, always 64 bit operand size
+    void mov_load(int dst, int base, int disp) { rex(true, dst, NOINDEX, base); b(0x8B); modrm_mem(dst, base, NOINDEX, 1, disp); }
+    void movsxd_load(int dst, int base, int disp) { rex(true, dst, NOINDEX, base); b(0x63); modrm_mem(dst, base, NOINDEX, 1, disp); }
+    void mov(int dst, int src) { rex(true, src, NOINDEX, dst); b(0x89); modrm_reg(src, dst); }
+    void add(int dst, int src) { rex(true, src, NOINDEX, dst); b(0x01); modrm_reg(src, dst); }
+    void addi(int dst, int imm) { rex(true, 0, NOINDEX, dst); b(0x81); modrm_reg(0, dst); d(imm); }
+    void subi(int dst, int imm) { rex(true, 0, NOINDEX, dst); b(0x81); modrm_reg(5, dst); d(imm); }
+    void movi(int dst, int imm) { rex(true, 0, NOINDEX, dst); b(0xC7); modrm_reg(0, dst); d(imm); }
+    void sar1(int dst) { rex(true, 0, NOINDEX, dst); b(0xD1); modrm_reg(7, dst); }
+    void dec(int dst) { rex(true, 0, NOINDEX, dst); b(0xFF); modrm_reg(1, dst); }
+    void test(int a) { rex(true, a, NOINDEX, a); b(0x85); modrm_reg(a, a); }
+    void push(int r) { if (r&8) b(0x41); b(0x50 | (r&7)); }
+    void pop(int r) { if (r&8) b(0x41); b(0x58 | (r&7)); }
+    void ret() { b(0xC3); }
+    int jcc(int cc) { b(0x0F); b(0x80 | cc); d(0); return pos(); }
+    void jcc_back(int cc, int target) { b(0x0F); b(0x80 | cc); d(target-(pos()+4)); }
+    void patch(int at) { const int rel = pos()-at; memcpy(&code[at-4], &rel, 4); }
+
+    int constant(int v)
+    {
+        for (int i=0; i<(int)pool.size(); ++i)
+        {
+            if (pool[i] == v)
+                return i;
+        }
+        pool.push_back(v);
+        return (int)pool.size()-1;
+    }
+    static int pair(int lo, int hi) { return (lo&0xFFFF) | (hi<<16); }
+
+    // Lays out the constant pool behind the code and resolves the rip
+    // relative operands.
+    void finish()
+    {
+        while (code.size()&15)
+            b(0xCC);
+        const int base = pos();
+        for (int i=0; i<(int)pool.size(); ++i)
+            for (int k=0; k<4; ++k)
+                d(pool[i]);
+        for (int i=0; i<(int)fixups.size(); ++i)
+        {
+            const int at = fixups[i].first;
+            const int rel = base+fixups[i].second*16-(at+4);
+            memcpy(&code[at], &rel, 4);
+        }
+    }
+};
+
+#define JE 0x4
+#define JNE 0x5
+#define JLE 0xE
+
+static inline bool fits16(int c) { return c >= -32768 && c <= 32767; }
+
+// dst = ca*a + cb*b for (a,b) word pairs in src, evaluated exactly in 32 bits.
+// Coefficients that fit in a word need a single pmaddwd, otherwise they are
+// split as hi*256 + lo and the all-zero halves are skipped.
+static void emit_madd(JitEmitter &e, int dst, int src, int tmp, int ca, int cb)
+{
+    if (ca == 0 && cb == 0)
+    {
+        e.pxor(dst, dst);
+        return;
+    }
+    if (fits16(ca) && fits16(cb))
+    {
+        e.movdqa(dst, src);
+        e.pmaddwd_k(dst, e.constant(JitEmitter::pair(ca, cb)));
+        return;
+    }
+    const int hi = JitEmitter::pair(ca>>8, cb>>8);
+    const int lo = JitEmitter::pair(ca&0xFF, cb&0xFF);
+    if (hi)
+    {
+        e.movdqa(dst, src);
+        e.pmaddwd_k(dst, e.constant(hi));
+        e.pslld(dst, 8);
+    }
+    if (lo)
+    {
+        e.movdqa(hi ? tmp : dst, src);
+        e.pmaddwd_k(hi ? tmp : dst, e.constant(lo));
+        if (hi)
+            e.paddd(dst, tmp);
+    }
+}
+
+static void emit_bias(JitEmitter &e, int dst, int bias)
+{
+    if (bias)
+        e.paddd_k(dst, e.constant(bias));
+}
+
+// Clamps the bytes of reg to [lo,hi], the sides that don't clamp anything 
+// are left out, so without clamp nothing is emitted.
+static void emit_clamp(JitEmitter &e, int reg, int lo, int hi)
+{
+    if (lo > 0)
+        e.pmaxub_k(reg, e.constant((int)(0x01010101u*lo)));
+    if (hi < 255)
+        e.pminub_k(reg, e.constant((int)(0x01010101u*hi)));
+}
+
+// One 16 pixel wide, two line high block.  rcx holds the (negative) chroma
+// offset, the plane pointers have been moved to the end of the line.
+static void emit_block(JitEmitter &e, const CFS *cs, bool range, int j)
+{
+    const int Z = 15;
+    // u/v are used unsigned, the -128 is folded into the biases
+    const int bias_Y = cs->c8-128*(cs->c2+cs->c3);
+    const int bias_U = 8421376-128*(cs->c4+cs->c5);
+    const int bias_V = 8421376-128*(cs->c6+cs->c7);
+    e.movq_load(0, R10, RCX, 1, j*8);
+    e.movq_load(1, R11, RCX, 1, j*8);
+    emit_clamp(e, 0, cs->inmin[1], cs->inmax[1]);
+    emit_clamp(e, 1, cs->inmin[1], cs->inmax[1]);
+    e.punpcklbw(0, Z);
+    e.punpcklbw(1, Z);
+    e.movdqa(2, 0);
+    e.punpcklwd(0, 1);
+    e.punpckhwd(2, 1);
+    // new u and v
+    const int pcoef[2][2] = { { cs->c4, cs->c5 }, { cs->c6, cs->c7 } };
+    const int pbias[2] = { bias_U, bias_V };
+    const int pbase[2] = { R14, R15 };
+    for (int p=0; p<2; ++p)
+    {
+        emit_madd(e, 3, 0, 11, pcoef[p][0], pcoef[p][1]);
+        emit_madd(e, 4, 2, 11, pcoef[p][0], pcoef[p][1]);
+        emit_bias(e, 3, pbias[p]);
+        emit_bias(e, 4, pbias[p]);
+        e.psrad(3, 16);
+        e.psrad(4, 16);
+        e.packssdw(3, 4);
+        e.packuswb(3, 3);
+        emit_clamp(e, 3, cs->outmin[1], cs->outmax[1]);
+        e.movq_store(pbase[p], RCX, 1, j*8, 3);
+    }
+    // chroma part of y, duplicated for the two horizontal luma samples
+    emit_madd(e, 3, 0, 11, cs->c2, cs->c3);
+    emit_madd(e, 4, 2, 11, cs->c2, cs->c3);
+    emit_bias(e, 3, bias_Y);
+    emit_bias(e, 4, bias_Y);
+    e.movdqa(5, 3);
+    e.movdqa(6, 4);
+    e.punpckldq(3, 3);
+    e.punpckhdq(5, 5);
+    e.punpckldq(4, 4);
+    e.punpckhdq(6, 6);
+    const int uvval[4] = { 3, 5, 4, 6 };
+    const int ybase[2][2] = { { R8, R12 }, { R9, R13 } };
+    for (int r=0; r<2; ++r)
+    {
+        e.movdqa_load(0, ybase[r][0], RCX, 2, j*16);
+        emit_clamp(e, 0, cs->inmin[0], cs->inmax[0]);
+        e.movdqa(1, 0);
+        e.punpcklbw(0, Z);
+        e.punpckhbw(1, Z);
+        for (int i=0; i<4; ++i)
+        {
+            const int t = 7+i;
+            const int yw = i>>1;
+            if (range)
+            {
+                e.movdqa(t, yw);
+                if (i&1) e.punpckhwd(t, Z);
+                else e.punpcklwd(t, Z);
+                emit_madd(e, 12, t, 11, cs->c1, 0);
+                e.movdqa(t, 12);
+            }
+            else
+            {
+                // (0,y) word pairs are y<<16 as dwords
+                e.pxor(t, t);
+                if (i&1) e.punpckhwd(t, yw);
+                else e.punpcklwd(t, yw);
+            }
+            e.paddd(t, uvval[i]);
+            e.psrad(t, 16);
+        }
+        e.packssdw(7, 8);
+        e.packssdw(9, 10);
+        e.packuswb(7, 9);
+        emit_clamp(e, 7, cs->outmin[0], cs->outmax[0]);
+        e.movdqa_store(ybase[r][1], RCX, 2, j*16, 7);
+    }
+}
+
+// Win64 UNWIND_INFO for the prologue of jit_YV12_SSE2, ends[] holds the 
+// offset just past each of its 19 instructions.  The codes go in reverse 
+// order:  the xmm saves (UWOP_SAVE_XMM128, offset/16), the stack allocation 
+// (UWOP_ALLOC_LARGE, size/8), and the pushes (UWOP_PUSH_NONVOL).
+static void emit_unwind(JitEmitter &e, const int *saved, const int *ends, int alloc)
+{
+    while (e.code.size()&3)
+        e.b(0xCC);
+    e.b(0x01); // version 1, no flags
+    e.b(ends[18]);
+    e.b(10*2+2+8);
+    e.b(0x00); // no frame register
+    for (int i=9; i>=0; --i)
+    {
+        e.b(ends[9+i]); e.b(0x08 | ((6+i)<<4));
+        e.b(i); e.b(0);
+    }
+    e.b(ends[8]); e.b(0x01);
+    e.b((alloc>>3)&0xFF); e.b(alloc>>11);
+    for (int i=7; i>=0; --i)
+    {
+        e.b(ends[i]); e.b(saved[i]<<4);
+    }
+}
+
+// Returns the size of the kernel, unwind gets the offset of its UNWIND_INFO 
+// which follows the kernel in code.
+int jit_YV12_SSE2(unsigned char *code, int maxsize, const CFS *cs, int widtha, int &unwind)
+{
+    static const int saved[8] = { RBX, RBP, RSI, RDI, R12, R13, R14, R15 };
+    const int alloc = 10*16+8;
+    const bool range = cs->c1 != 65536;
+    const int blocks = widtha>>4;
+    if (blocks <= 0)
+        return 0;
+    const int unroll = blocks%4 == 0 ? 4 : blocks%2 == 0 ? 2 : 1;
+    JitEmitter e;
+    int ends[19];
+    for (int i=0; i<8; ++i)
+    {
+        e.push(saved[i]);
+        ends[i] = e.pos();
+    }
+    // xmm6-xmm15 are callee saved on win64
+    e.subi(RSP, alloc);
+    ends[8] = e.pos();
+    for (int i=0; i<10; ++i)
+    {
+        e.ssem(0xF3, 0x7F, 6+i, RSP, NOINDEX, 1, i*16);
+        ends[9+i] = e.pos();
+    }
+#ifdef _WIN64
+    e.mov(RAX, RCX);
+#else
+    e.mov(RAX, RDI);
+#endif
+    e.mov_load(R8, RAX, offsetof(PS_INFO, srcp));
+    e.mov_load(R9, RAX, offsetof(PS_INFO, srcpn));
+    e.mov_load(R10, RAX, offsetof(PS_INFO, srcpU));
+    e.mov_load(R11, RAX, offsetof(PS_INFO, srcpV));
+    e.mov_load(R12, RAX, offsetof(PS_INFO, dstp));
+    e.mov_load(R13, RAX, offsetof(PS_INFO, dstpn));
+    e.mov_load(R14, RAX, offsetof(PS_INFO, dstpU));
+    e.mov_load(R15, RAX, offsetof(PS_INFO, dstpV));
+    e.movsxd_load(RSI, RAX, offsetof(PS_INFO, src_pitch));
+    e.movsxd_load(RDI, RAX, offsetof(PS_INFO, dst_pitch));
+    e.movsxd_load(RBP, RAX, offsetof(PS_INFO, src_pitchUV));
+    e.movsxd_load(RBX, RAX, offsetof(PS_INFO, dst_pitchUV));
+    e.movsxd_load(RAX, RAX, offsetof(PS_INFO, height));
+    e.add(RSI, RSI);
+    e.add(RDI, RDI);
+    e.sar1(RAX);
+    e.addi(R8, widtha);
+    e.addi(R9, widtha);
+    e.addi(R12, widtha);
+    e.addi(R13, widtha);
+    e.addi(R10, widtha>>1);
+    e.addi(R11, widtha>>1);
+    e.addi(R14, widtha>>1);
+    e.addi(R15, widtha>>1);
+    e.pxor(15, 15);
+    e.test(RAX);
+    const int skip = e.jcc(JLE);
+    const int row = e.pos();
+    e.movi(RCX, -(widtha>>1));
+    const int col = e.pos();
+    for (int j=0; j<unroll; ++j)
+        emit_block(e, cs, range, j);
+    e.addi(RCX, unroll*8);
+    e.jcc_back(JNE, col);
+    e.add(R8, RSI);
+    e.add(R9, RSI);
+    e.add(R12, RDI);
+    e.add(R13, RDI);
+    e.add(R10, RBP);
+    e.add(R11, RBP);
+    e.add(R14, RBX);
+    e.add(R15, RBX);
+    e.dec(RAX);
+    e.jcc_back(JNE, row);
+    e.patch(skip);
+    for (int i=0; i<10; ++i)
+        e.ssem(0xF3, 0x6F, 6+i, RSP, NOINDEX, 1, i*16);
+    e.addi(RSP, alloc);
+    for (int i=7; i>=0; --i)
+        e.pop(saved[i]);
+    e.ret();
+    e.finish();
+    const int size = e.pos();
+    emit_unwind(e, saved, ends, alloc);
+    if ((int)e.code.size() > maxsize)
+        return 0;
+    memcpy(code, &e.code[0], e.code.size());
+    unwind = (size+3)&~3;
+    return size;
+}
+
+#else
+
+int jit_YV12_SSE2(unsigned char *code, int maxsize, const CFS *cs, int widtha, int &unwind)
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,2154 @@
+/*
+**                 ColorMatrix v2.5 for Avisynth 2.5.x
+**
+**   ColorMatrix 2.0 is based on the original ColorMatrix filter by Wilbert 
+**   Dijkhof.  It adds the ability to convert between any of: Rec.709, FCC, 
+**   Rec.601, and SMPTE 240M. It also makes pre and post clipping optional,
+**   adds range expansion/contraction, and more...
+**
+**   Copyright (C) 2006-2009 Kevin Stone
+**
+**   ColorMatrix 1.x is Copyright (C) Wilbert Dijkhof
+**
+**   This program is free software; you can redistribute it and/or modify
+**   it under the terms of the GNU General Public License as published by
+**   the Free Software Foundation; either version 2 of the License, or
+**   (at your option) any later version.
+**
+**   This program is distributed in the hope that it will be useful,
+**   but WITHOUT ANY WARRANTY; without even the implied warranty of
+**   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**   GNU General Public License for more details.
+**
+**   You should have received a copy of the GNU General Public License
+**   along with this program; if not, write to the Free Software
+**   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "ColorMatrix.h"
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#ifdef CM_AVX2
+#include <immintrin.h>
+#endif
+
+// Converts a 16.16 coefficient into a signed word for pmulhw plus the number 
+// of bits the (x-128)*64 input has to be shifted up to make up for the 
+// simd_scale scaling.  This lets one kernel handle any sign combination.
+static void getsse2c(int c, __m128i &fact, __m128i &shift)
+{
+    const int a = abs(c);
+    const int w = simd_scale(a);
+    fact = _mm_set1_epi16((short)(c < 0 ? -w : w));
+    shift = _mm_cvtsi32_si128(a >= 65535 ? 2 : a >= 32768 ? 1 : 0);
+}
+
+// Generic YV12 kernel driven purely by the coefficients in CFS.  Works in 
+// 1/64 units like the conv1-conv4 kernels, but also handles c1 != 65536 
+// (RANGE, range expansion/contraction) so that it can be used for every mode.  
+// CLAMP applies the clamps to the loaded and the packed bytes.
+template <bool RANGE, bool CLAMP>
+void conv_YV12_SSE2(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned char *srcpY = pss->srcp;
+    const unsigned char *srcpU = pss->srcpU;
+    const unsigned char *srcpV = pss->srcpV;
+    const int src_pitchY = pss->src_pitch;
+    const int src_pitchR = pss->src_pitchR;
+    const int src_pitchUV = pss->src_pitchUV;
+    unsigned char *dstpY = pss->dstp;
+    unsigned char *dstpU = pss->dstpU;
+    unsigned char *dstpV = pss->dstpV;
+    const int dst_pitchY = pss->dst_pitch;
+    const int dst_pitchR = pss->dst_pitchR;
+    const int dst_pitchUV = pss->dst_pitchUV;
+    const int width = pss->widtha;
+    const int height = pss->height;
+    const __m128i fact_YU = cs->fact[0], shift_YU = cs->shift[0];
+    const __m128i fact_YV = cs->fact[1], shift_YV = cs->shift[1];
+    const __m128i fact_UU = cs->fact[2], shift_UU = cs->shift[2];
+    const __m128i fact_UV = cs->fact[3], shift_UV = cs->shift[3];
+    const __m128i fact_VU = cs->fact[4], shift_VU = cs->shift[4];
+    const __m128i fact_VV = cs->fact[5], shift_VV = cs->shift[5];
+    const __m128i fact_YY = cs->fact_YY;
+    const __m128i bias_Y = cs->bias_Y;
+    const __m128i bias_UV = _mm_set1_epi16(8224); // 8421376 in 1/64 units
+    const __m128i q128 = _mm_set1_epi16(128);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i inmin_Y = _mm_set1_epi8((char)cs->inmin[0]), inmax_Y = _mm_set1_epi8((char)cs->inmax[0]);
+    const __m128i inmin_UV = _mm_set1_epi8((char)cs->inmin[1]), inmax_UV = _mm_set1_epi8((char)cs->inmax[1]);
+    const __m128i outmin_Y = _mm_set1_epi8((char)cs->outmin[0]), outmax_Y = _mm_set1_epi8((char)cs->outmax[0]);
+    const __m128i outmin_UV = _mm_set1_epi8((char)cs->outmin[1]), outmax_UV = _mm_set1_epi8((char)cs->outmax[1]);
+    for (int h=0; h<height; h+=2)
+    {
+        for (int x=0; x<width; x+=16)
+        {
+            __m128i u = _mm_loadl_epi64((const __m128i*)(srcpU+(x>>1)));
+            __m128i v = _mm_loadl_epi64((const __m128i*)(srcpV+(x>>1)));
+            if (CLAMP)
+            {
+                u = _mm_min_epu8(_mm_max_epu8(u, inmin_UV), inmax_UV);
+                v = _mm_min_epu8(_mm_max_epu8(v, inmin_UV), inmax_UV);
+            }
+            u = _mm_unpacklo_epi8(u, zero);
+            v = _mm_unpacklo_epi8(v, zero);
+            u = _mm_slli_epi16(_mm_sub_epi16(u, q128), 6);
+            v = _mm_slli_epi16(_mm_sub_epi16(v, q128), 6);
+            const __m128i yadj = _mm_adds_epi16(bias_Y, _mm_adds_epi16(
+                _mm_mulhi_epi16(_mm_sll_epi16(u, shift_YU), fact_YU),
+                _mm_mulhi_epi16(_mm_sll_epi16(v, shift_YV), fact_YV)));
+            const __m128i yadjlo = _mm_unpacklo_epi16(yadj, yadj);
+            const __m128i yadjhi = _mm_unpackhi_epi16(yadj, yadj);
+            for (int r=0; r<2; ++r)
+            {
+                __m128i y = _mm_load_si128((const __m128i*)(srcpY+r*src_pitchR+x));
+                if (CLAMP)
+                    y = _mm_min_epu8(_mm_max_epu8(y, inmin_Y), inmax_Y);
+                __m128i ylo = _mm_unpacklo_epi8(y, zero);
+                __m128i yhi = _mm_unpackhi_epi8(y, zero);
+                if (RANGE)
+                {
+                    ylo = _mm_mulhi_epu16(_mm_slli_epi16(ylo, 8), fact_YY);
+                    yhi = _mm_mulhi_epu16(_mm_slli_epi16(yhi, 8), fact_YY);
+                }
+                else
+                {
+                    ylo = _mm_slli_epi16(ylo, 6);
+                    yhi = _mm_slli_epi16(yhi, 6);
+                }
+                ylo = _mm_srai_epi16(_mm_adds_epi16(ylo, yadjlo), 6);
+                yhi = _mm_srai_epi16(_mm_adds_epi16(yhi, yadjhi), 6);
+                __m128i yo = _mm_packus_epi16(ylo, yhi);
+                if (CLAMP)
+                    yo = _mm_min_epu8(_mm_max_epu8(yo, outmin_Y), outmax_Y);
+                _mm_store_si128((__m128i*)(dstpY+r*dst_pitchR+x), yo);
+            }
+            __m128i nu = _mm_adds_epi16(bias_UV, _mm_adds_epi16(
+                _mm_mulhi_epi16(_mm_sll_epi16(u, shift_UU), fact_UU),
+                _mm_mulhi_epi16(_mm_sll_epi16(v, shift_UV), fact_UV)));
+            __m128i nv = _mm_adds_epi16(bias_UV, _mm_adds_epi16(
+                _mm_mulhi_epi16(_mm_sll_epi16(u, shift_VU), fact_VU),
+                _mm_mulhi_epi16(_mm_sll_epi16(v, shift_VV), fact_VV)));
+            nu = _mm_srai_epi16(nu, 6);
+            nv = _mm_srai_epi16(nv, 6);
+            __m128i uvo = _mm_packus_epi16(nu, nv);
+            if (CLAMP)
+                uvo = _mm_min_epu8(_mm_max_epu8(uvo, outmin_UV), outmax_UV);
+            _mm_storel_epi64((__m128i*)(dstpU+(x>>1)), uvo);
+            _mm_storel_epi64((__m128i*)(dstpV+(x>>1)), _mm_srli_si128(uvo, 8));
+        }
+        srcpY += src_pitchY*2;
+        dstpY += dst_pitchY*2;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+}
+
+// Splits a 16.16 coefficient pair into hi*256+lo halves laid out for pmaddwd 
+// on interleaved (a,b) words.  Summing (pmaddwd(x,hi)<<8) + pmaddwd(x,lo) 
+// gives ca*a + cb*b with full 32-bit precision.
+static void getsse2p(int ca, int cb, __m128i &hi, __m128i &lo)
+{
+    hi = _mm_set1_epi32(((ca>>8)&0xFFFF) | ((cb>>8)<<16));
+    lo = _mm_set1_epi32((ca&0xFF) | ((cb&0xFF)<<16));
+}
+
+static inline __m128i madd32(const __m128i &x, const __m128i &hi, const __m128i &lo)
+{
+    return _mm_add_epi32(_mm_slli_epi32(_mm_madd_epi16(x, hi), 8), _mm_madd_epi16(x, lo));
+}
+
+// Bit-exact YV12 kernel.  Evaluates (c*x + c8) >> 16 with 32-bit accumulation 
+// exactly like the C path, so the output is identical to opt=0.  For NV12 
+// (NV=1) the interleaved chroma row already holds the (u,v) pairs pmaddwd 
+// wants and the results are interleaved back with one unpack.  CLAMP applies 
+// the clamps to the loaded and the packed bytes.
+template <bool RANGE, int NV, bool CLAMP>
+void convx_YV12_SSE2(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned char *srcpY = pss->srcp;
+    const unsigned char *srcpU = pss->srcpU;
+    const unsigned char *srcpV = pss->srcpV;
+    const int src_pitchY = pss->src_pitch;
+    const int src_pitchR = pss->src_pitchR;
+    const int src_pitchUV = pss->src_pitchUV;
+    unsigned char *dstpY = pss->dstp;
+    unsigned char *dstpU = pss->dstpU;
+    unsigned char *dstpV = pss->dstpV;
+    const int dst_pitchY = pss->dst_pitch;
+    const int dst_pitchR = pss->dst_pitchR;
+    const int dst_pitchUV = pss->dst_pitchUV;
+    const int width = pss->widtha;
+    const int height = pss->height;
+    const __m128i fact_Y_hi = cs->xhi[0], fact_Y_lo = cs->xlo[0];
+    const __m128i fact_U_hi = cs->xhi[1], fact_U_lo = cs->xlo[1];
+    const __m128i fact_V_hi = cs->xhi[2], fact_V_lo = cs->xlo[2];
+    const __m128i fact_YY_hi = cs->xhi[3], fact_YY_lo = cs->xlo[3];
+    const __m128i bias_Y = cs->xbias_Y;
+    const __m128i bias_UV = _mm_set1_epi32(8421376);
+    const __m128i q128 = _mm_set1_epi16(128);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i inmin_Y = _mm_set1_epi8((char)cs->inmin[0]), inmax_Y = _mm_set1_epi8((char)cs->inmax[0]);
+    const __m128i inmin_UV = _mm_set1_epi8((char)cs->inmin[1]), inmax_UV = _mm_set1_epi8((char)cs->inmax[1]);
+    const __m128i outmin_Y = _mm_set1_epi8((char)cs->outmin[0]), outmax_Y = _mm_set1_epi8((char)cs->outmax[0]);
+    const __m128i outmin_UV = _mm_set1_epi8((char)cs->outmin[1]), outmax_UV = _mm_set1_epi8((char)cs->outmax[1]);
+    for (int h=0; h<height; h+=2)
+    {
+        for (int x=0; x<width; x+=16)
+        {
+            __m128i uvlo, uvhi;
+            if (NV)
+            {
+                __m128i uv = _mm_load_si128((const __m128i*)(srcpU+x));
+                if (CLAMP)
+                    uv = _mm_min_epu8(_mm_max_epu8(uv, inmin_UV), inmax_UV);
+                uvlo = _mm_sub_epi16(_mm_unpacklo_epi8(uv, zero), q128);
+                uvhi = _mm_sub_epi16(_mm_unpackhi_epi8(uv, zero), q128);
+            }
+            else
+            {
+                __m128i u = _mm_loadl_epi64((const __m128i*)(srcpU+(x>>1)));
+                __m128i v = _mm_loadl_epi64((const __m128i*)(srcpV+(x>>1)));
+                if (CLAMP)
+                {
+                    u = _mm_min_epu8(_mm_max_epu8(u, inmin_UV), inmax_UV);
+                    v = _mm_min_epu8(_mm_max_epu8(v, inmin_UV), inmax_UV);
+                }
+                u = _mm_sub_epi16(_mm_unpacklo_epi8(u, zero), q128);
+                v = _mm_sub_epi16(_mm_unpacklo_epi8(v, zero), q128);
+                uvlo = _mm_unpacklo_epi16(u, v);
+                uvhi = _mm_unpackhi_epi16(u, v);
+            }
+            const __m128i uvvallo = _mm_add_epi32(madd32(uvlo, fact_Y_hi, fact_Y_lo), bias_Y);
+            const __m128i uvvalhi = _mm_add_epi32(madd32(uvhi, fact_Y_hi, fact_Y_lo), bias_Y);
+            const __m128i uvval[4] = {
+                _mm_unpacklo_epi32(uvvallo, uvvallo), _mm_unpackhi_epi32(uvvallo, uvvallo),
+                _mm_unpacklo_epi32(uvvalhi, uvvalhi), _mm_unpackhi_epi32(uvvalhi, uvvalhi) };
+            for (int r=0; r<2; ++r)
+            {
+                __m128i y = _mm_load_si128((const __m128i*)(srcpY+r*src_pitchR+x));
+                if (CLAMP)
+                    y = _mm_min_epu8(_mm_max_epu8(y, inmin_Y), inmax_Y);
+                const __m128i yw[2] = { _mm_unpacklo_epi8(y, zero), _mm_unpackhi_epi8(y, zero) };
+                __m128i yd[4];
+                for (int i=0; i<4; ++i)
+                {
+                    const __m128i t = i&1 ? _mm_unpackhi_epi16(yw[i>>1], zero) : 
+                        _mm_unpacklo_epi16(yw[i>>1], zero);
+                    yd[i] = RANGE ? madd32(t, fact_YY_hi, fact_YY_lo) : _mm_slli_epi32(t, 16);
+                    yd[i] = _mm_srai_epi32(_mm_add_epi32(yd[i], uvval[i]), 16);
+                }
+                __m128i yo = _mm_packus_epi16(_mm_packs_epi32(yd[0], yd[1]), _mm_packs_epi32(yd[2], yd[3]));
+                if (CLAMP)
+                    yo = _mm_min_epu8(_mm_max_epu8(yo, outmin_Y), outmax_Y);
+                _mm_store_si128((__m128i*)(dstpY+r*dst_pitchR+x), yo);
+            }
+            const __m128i nu = _mm_packs_epi32(
+                _mm_srai_epi32(_mm_add_epi32(madd32(uvlo, fact_U_hi, fact_U_lo), bias_UV), 16),
+                _mm_srai_epi32(_mm_add_epi32(madd32(uvhi, fact_U_hi, fact_U_lo), bias_UV), 16));
+            const __m128i nv = _mm_packs_epi32(
+                _mm_srai_epi32(_mm_add_epi32(madd32(uvlo, fact_V_hi, fact_V_lo), bias_UV), 16),
+                _mm_srai_epi32(_mm_add_epi32(madd32(uvhi, fact_V_hi, fact_V_lo), bias_UV), 16));
+            __m128i uvo = NV ? _mm_packus_epi16(_mm_unpacklo_epi16(nu, nv), _mm_unpackhi_epi16(nu, nv)) : 
+                _mm_packus_epi16(nu, nv);
+            if (CLAMP)
+                uvo = _mm_min_epu8(_mm_max_epu8(uvo, outmin_UV), outmax_UV);
+            if (NV)
+                _mm_store_si128((__m128i*)(dstpU+x), uvo);
+            else
+            {
+                _mm_storel_epi64((__m128i*)(dstpU+(x>>1)), uvo);
+                _mm_storel_epi64((__m128i*)(dstpV+(x>>1)), _mm_srli_si128(uvo, 8));
+            }
+        }
+        srcpY += src_pitchY*2;
+        dstpY += dst_pitchY*2;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+}
+
+// Bit-exact YUY2 kernel, the same sums as conv_YUY2_C on 8 pixels at a time.  
+// The chroma bytes of a Y0 U Y1 V group are already the (u,v) word pair 
+// pmaddwd wants once shifted down.  The clamp constants alternate luma and 
+// chroma bytes like the samples.
+template <bool RANGE, bool CLAMP>
+void conv_YUY2_SSE2(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned char *srcp = pss->srcp;
+    const int src_pitch = pss->src_pitch;
+    unsigned char *dstp = pss->dstp;
+    const int dst_pitch = pss->dst_pitch;
+    const int width = (pss->width+15)&~15;
+    const int height = pss->height;
+    const __m128i fact_Y_hi = cs->xhi[0], fact_Y_lo = cs->xlo[0];
+    const __m128i fact_U_hi = cs->xhi[1], fact_U_lo = cs->xlo[1];
+    const __m128i fact_V_hi = cs->xhi[2], fact_V_lo = cs->xlo[2];
+    const __m128i fact_YY_hi = cs->xhi[3], fact_YY_lo = cs->xlo[3];
+    const __m128i bias_Y = cs->xbias_Y;
+    const __m128i bias_UV = _mm_set1_epi32(8421376);
+    const __m128i q128 = _mm_set1_epi16(128);
+    const __m128i lumamask = _mm_set1_epi16(0x00FF);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i inmin = _mm_set1_epi16((short)(cs->inmin[0] | (cs->inmin[1]<<8)));
+    const __m128i inmax = _mm_set1_epi16((short)(cs->inmax[0] | (cs->inmax[1]<<8)));
+    const __m128i outmin = _mm_set1_epi16((short)(cs->outmin[0] | (cs->outmin[1]<<8)));
+    const __m128i outmax = _mm_set1_epi16((short)(cs->outmax[0] | (cs->outmax[1]<<8)));
+    for (int h=0; h<height; ++h)
+    {
+        for (int x=0; x<width; x+=16)
+        {
+            __m128i p = _mm_load_si128((const __m128i*)(srcp+x));
+            if (CLAMP)
+                p = _mm_min_epu8(_mm_max_epu8(p, inmin), inmax);
+            const __m128i yw = _mm_and_si128(p, lumamask);
+            const __m128i uv = _mm_sub_epi16(_mm_srli_epi16(p, 8), q128);
+            const __m128i uvval = _mm_add_epi32(madd32(uv, fact_Y_hi, fact_Y_lo), bias_Y);
+            const __m128i uvvald[2] = { _mm_unpacklo_epi32(uvval, uvval), _mm_unpackhi_epi32(uvval, uvval) };
+            __m128i yd[2];
+            for (int i=0; i<2; ++i)
+            {
+                const __m128i t = i ? _mm_unpackhi_epi16(yw, zero) : _mm_unpacklo_epi16(yw, zero);
+                yd[i] = RANGE ? madd32(t, fact_YY_hi, fact_YY_lo) : _mm_slli_epi32(t, 16);
+                yd[i] = _mm_srai_epi32(_mm_add_epi32(yd[i], uvvald[i]), 16);
+            }
+            const __m128i nu = _mm_srai_epi32(_mm_add_epi32(madd32(uv, fact_U_hi, fact_U_lo), bias_UV), 16);
+            const __m128i nv = _mm_srai_epi32(_mm_add_epi32(madd32(uv, fact_V_hi, fact_V_lo), bias_UV), 16);
+            // u0 u1 u2 u3 v0 v1 v2 v3 to u0 v0 u1 v1 ..., then the bytes are 
+            // interleaved back with the luma
+            const __m128i c = _mm_packs_epi32(nu, nv);
+            const __m128i cw = _mm_unpacklo_epi16(c, _mm_srli_si128(c, 8));
+            const __m128i r = _mm_packus_epi16(_mm_packs_epi32(yd[0], yd[1]), cw);
+            __m128i d = _mm_unpacklo_epi8(r, _mm_srli_si128(r, 8));
+            if (CLAMP)
+                d = _mm_min_epu8(_mm_max_epu8(d, outmin), outmax);
+            _mm_store_si128((__m128i*)(dstp+x), d);
+        }
+        srcp += src_pitch;
+        dstp += dst_pitch;
+    }
+}
+
+// Quantizes a 16.16 coefficient pair to signed bytes for pmaddubsw on (a,b) 
+// byte pairs, using the finest 2^-s step (s >= 8) that keeps |qa|+|qb| <= 128 
+// so the word sum can't saturate.  bias removes the -128 offsets (plus rnd, in 
+// 1/16 units) and k is the pmulhrsw factor that brings the sum to 1/16 units.  
+// Returns false if the pair is too large for any such step.
+static bool getssse3p(int ca, int cb, int rnd, __m128i &q, __m128i &bias, __m128i &k)
+{
+    for (int s=14; s>=8; --s)
+    {
+        const int qa = (int)((((int64_t)ca<<s)+32768)>>16);
+        const int qb = (int)((((int64_t)cb<<s)+32768)>>16);
+        if (abs(qa) > 127 || abs(qb) > 127 || abs(qa)+abs(qb) > 128)
+            continue;
+        q = _mm_set1_epi16((short)((qa&0xFF) | ((qb&0xFF)<<8)));
+        bias = _mm_set1_epi16((short)(-128*(qa+qb) + (rnd<<(s-4))));
+        k = _mm_set1_epi16((short)(1<<(19-s)));
+        return true;
+    }
+    q = bias = k = _mm_setzero_si128();
+    return false;
+}
+
+// Bit-exact 4:1:1 (SSW=2), 4:2:2 (SSW=1), and 4:4:4 (SSW=0) kernel, one luma 
+// line per chroma line.  Same arithmetic as convx_YV12_SSE2, for 4:4:4 each 
+// chroma term just goes to one luma sample instead of two and for 4:1:1 it 
+// is broadcast to four, 32 luma pixels at a time so that all 8 chroma lanes 
+// are used.  Both clamps are applied here.
+template <int SSW, bool RANGE>
+void convx_YUVP8_SSE2(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned char *srcpY = pss->srcp;
+    const unsigned char *srcpU = pss->srcpU;
+    const unsigned char *srcpV = pss->srcpV;
+    const int src_pitchY = pss->src_pitch;
+    const int src_pitchUV = pss->src_pitchUV;
+    unsigned char *dstpY = pss->dstp;
+    unsigned char *dstpU = pss->dstpU;
+    unsigned char *dstpV = pss->dstpV;
+    const int dst_pitchY = pss->dst_pitch;
+    const int dst_pitchUV = pss->dst_pitchUV;
+    const int width = pss->widtha;
+    const int height = pss->height;
+    const __m128i fact_Y_hi = cs->xhi[0], fact_Y_lo = cs->xlo[0];
+    const __m128i fact_U_hi = cs->xhi[1], fact_U_lo = cs->xlo[1];
+    const __m128i fact_V_hi = cs->xhi[2], fact_V_lo = cs->xlo[2];
+    const __m128i fact_YY_hi = cs->xhi[3], fact_YY_lo = cs->xlo[3];
+    const __m128i bias_Y = cs->xbias_Y;
+    const __m128i bias_UV = _mm_set1_epi32(8421376);
+    const __m128i q128 = _mm_set1_epi16(128);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i inmin_Y = _mm_set1_epi8((char)cs->inmin[0]), inmax_Y = _mm_set1_epi8((char)cs->inmax[0]);
+    const __m128i inmin_UV = _mm_set1_epi8((char)cs->inmin[1]), inmax_UV = _mm_set1_epi8((char)cs->inmax[1]);
+    const __m128i outmin_Y = _mm_set1_epi8((char)cs->outmin[0]), outmax_Y = _mm_set1_epi8((char)cs->outmax[0]);
+    const __m128i outmin_UV = _mm_set1_epi8((char)cs->outmin[1]), outmax_UV = _mm_set1_epi8((char)cs->outmax[1]);
+    for (int h=0; h<height; ++h)
+    {
+        for (int x=0; x<width; x+=(SSW == 2 ? 32 : 16))
+        {
+            // 8 chroma samples per group, one group for 4:1:1 and 4:2:2 and 
+            // two for 4:4:4
+            __m128i uvval[8], nu[2], nv[2];
+            for (int g=0; g<(SSW ? 1 : 2); ++g)
+            {
+                const __m128i u = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_min_epu8(_mm_max_epu8(
+                    _mm_loadl_epi64((const __m128i*)(srcpU+(x>>SSW)+8*g)), inmin_UV), inmax_UV), zero), q128);
+                const __m128i v = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_min_epu8(_mm_max_epu8(
+                    _mm_loadl_epi64((const __m128i*)(srcpV+(x>>SSW)+8*g)), inmin_UV), inmax_UV), zero), q128);
+                const __m128i uvlo = _mm_unpacklo_epi16(u, v);
+                const __m128i uvhi = _mm_unpackhi_epi16(u, v);
+                const __m128i uvvallo = _mm_add_epi32(madd32(uvlo, fact_Y_hi, fact_Y_lo), bias_Y);
+                const __m128i uvvalhi = _mm_add_epi32(madd32(uvhi, fact_Y_hi, fact_Y_lo), bias_Y);
+                if (SSW == 2)
+                {
+                    uvval[0] = _mm_shuffle_epi32(uvvallo, 0x00);
+                    uvval[1] = _mm_shuffle_epi32(uvvallo, 0x55);
+                    uvval[2] = _mm_shuffle_epi32(uvvallo, 0xAA);
+                    uvval[3] = _mm_shuffle_epi32(uvvallo, 0xFF);
+                    uvval[4] = _mm_shuffle_epi32(uvvalhi, 0x00);
+                    uvval[5] = _mm_shuffle_epi32(uvvalhi, 0x55);
+                    uvval[6] = _mm_shuffle_epi32(uvvalhi, 0xAA);
+                    uvval[7] = _mm_shuffle_epi32(uvvalhi, 0xFF);
+                }
+                else if (SSW)
+                {
+                    uvval[0] = _mm_unpacklo_epi32(uvvallo, uvvallo);
+                    uvval[1] = _mm_unpackhi_epi32(uvvallo, uvvallo);
+                    uvval[2] = _mm_unpacklo_epi32(uvvalhi, uvvalhi);
+                    uvval[3] = _mm_unpackhi_epi32(uvvalhi, uvvalhi);
+                }
+                else
+                {
+                    uvval[2*g] = uvvallo;
+                    uvval[2*g+1] = uvvalhi;
+                }
+                nu[g] = _mm_packs_epi32(
+                    _mm_srai_epi32(_mm_add_epi32(madd32(uvlo, fact_U_hi, fact_U_lo), bias_UV), 16),
+                    _mm_srai_epi32(_mm_add_epi32(madd32(uvhi, fact_U_hi, fact_U_lo), bias_UV), 16));
+                nv[g] = _mm_packs_epi32(
+                    _mm_srai_epi32(_mm_add_epi32(madd32(uvlo, fact_V_hi, fact_V_lo), bias_UV), 16),
+                    _mm_srai_epi32(_mm_add_epi32(madd32(uvhi, fact_V_hi, fact_V_lo), bias_UV), 16));
+            }
+            for (int b=0; b<(SSW == 2 ? 2 : 1); ++b)
+            {
+                const __m128i y = _mm_min_epu8(_mm_max_epu8(
+                    _mm_load_si128((const __m128i*)(srcpY+x+16*b)), inmin_Y), inmax_Y);
+                const __m128i yw[2] = { _mm_unpacklo_epi8(y, zero), _mm_unpackhi_epi8(y, zero) };
+                __m128i yd[4];
+                for (int i=0; i<4; ++i)
+                {
+                    const __m128i t = i&1 ? _mm_unpackhi_epi16(yw[i>>1], zero) : 
+                        _mm_unpacklo_epi16(yw[i>>1], zero);
+                    yd[i] = RANGE ? madd32(t, fact_YY_hi, fact_YY_lo) : _mm_slli_epi32(t, 16);
+                    yd[i] = _mm_srai_epi32(_mm_add_epi32(yd[i], uvval[4*b+i]), 16);
+                }
+                const __m128i yo = _mm_packus_epi16(_mm_packs_epi32(yd[0], yd[1]), _mm_packs_epi32(yd[2], yd[3]));
+                _mm_store_si128((__m128i*)(dstpY+x+16*b), _mm_min_epu8(_mm_max_epu8(yo, outmin_Y), outmax_Y));
+            }
+            if (SSW)
+            {
+                _mm_storel_epi64((__m128i*)(dstpU+(x>>SSW)), _mm_min_epu8(_mm_max_epu8(
+                    _mm_packus_epi16(nu[0], zero), outmin_UV), outmax_UV));
+                _mm_storel_epi64((__m128i*)(dstpV+(x>>SSW)), _mm_min_epu8(_mm_max_epu8(
+                    _mm_packus_epi16(nv[0], zero), outmin_UV), outmax_UV));
+            }
+            else
+            {
+                _mm_store_si128((__m128i*)(dstpU+x), _mm_min_epu8(_mm_max_epu8(
+                    _mm_packus_epi16(nu[0], nu[1]), outmin_UV), outmax_UV));
+                _mm_store_si128((__m128i*)(dstpV+x), _mm_min_epu8(_mm_max_epu8(
+                    _mm_packus_epi16(nv[0], nv[1]), outmin_UV), outmax_UV));
+            }
+        }
+        srcpY += src_pitchY;
+        dstpY += dst_pitchY;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+}
+
+// Gray output, the luma half of convx_YV12_SSE2 (SSH=1) and convx_YUVP8_SSE2 
+// with both clamps always applied.
+template <int SSW, int SSH, bool RANGE>
+void convl_YUVP8_SSE2(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned char *srcpY = pss->srcp;
+    const unsigned char *srcpU = pss->srcpU;
+    const unsigned char *srcpV = pss->srcpV;
+    const int src_pitchY = pss->src_pitch;
+    const int src_pitchR = pss->src_pitchR;
+    const int src_pitchUV = pss->src_pitchUV;
+    unsigned char *dstpY = pss->dstp;
+    const int dst_pitchY = pss->dst_pitch;
+    const int dst_pitchR = pss->dst_pitchR;
+    const int width = pss->widtha;
+    const int height = pss->height;
+    const __m128i fact_Y_hi = cs->xhi[0], fact_Y_lo = cs->xlo[0];
+    const __m128i fact_YY_hi = cs->xhi[3], fact_YY_lo = cs->xlo[3];
+    const __m128i bias_Y = cs->xbias_Y;
+    const __m128i q128 = _mm_set1_epi16(128);
+    const __m128i lo = _mm_set1_epi8((char)cs->outmin[0]);
+    const __m128i hi = _mm_set1_epi8((char)cs->outmax[0]);
+    const __m128i inmin_Y = _mm_set1_epi8((char)cs->inmin[0]), inmax_Y = _mm_set1_epi8((char)cs->inmax[0]);
+    const __m128i inmin_UV = _mm_set1_epi8((char)cs->inmin[1]), inmax_UV = _mm_set1_epi8((char)cs->inmax[1]);
+    const __m128i zero = _mm_setzero_si128();
+    for (int h=0; h<height; h+=1<<SSH)
+    {
+        for (int x=0; x<width; x+=16)
+        {
+            __m128i uvval[4];
+            for (int g=0; g<(SSW ? 1 : 2); ++g)
+            {
+                const __m128i u = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_min_epu8(_mm_max_epu8(SSW == 2 ? 
+                    _mm_cvtsi32_si128(*(const int*)(srcpU+(x>>2))) :
+                    _mm_loadl_epi64((const __m128i*)(srcpU+(x>>SSW)+8*g)), inmin_UV), inmax_UV), zero), q128);
+                const __m128i v = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_min_epu8(_mm_max_epu8(SSW == 2 ? 
+                    _mm_cvtsi32_si128(*(const int*)(srcpV+(x>>2))) :
+                    _mm_loadl_epi64((const __m128i*)(srcpV+(x>>SSW)+8*g)), inmin_UV), inmax_UV), zero), q128);
+                const __m128i uvvallo = _mm_add_epi32(madd32(_mm_unpacklo_epi16(u, v), 
+                    fact_Y_hi, fact_Y_lo), bias_Y);
+                const __m128i uvvalhi = _mm_add_epi32(madd32(_mm_unpackhi_epi16(u, v), 
+                    fact_Y_hi, fact_Y_lo), bias_Y);
+                if (SSW == 2)
+                {
+                    uvval[0] = _mm_shuffle_epi32(uvvallo, 0x00);
+                    uvval[1] = _mm_shuffle_epi32(uvvallo, 0x55);
+                    uvval[2] = _mm_shuffle_epi32(uvvallo, 0xAA);
+                    uvval[3] = _mm_shuffle_epi32(uvvallo, 0xFF);
+                }
+                else if (SSW)
+                {
+                    uvval[0] = _mm_unpacklo_epi32(uvvallo, uvvallo);
+                    uvval[1] = _mm_unpackhi_epi32(uvvallo, uvvallo);
+                    uvval[2] = _mm_unpacklo_epi32(uvvalhi, uvvalhi);
+                    uvval[3] = _mm_unpackhi_epi32(uvvalhi, uvvalhi);
+                }
+                else
+                {
+                    uvval[2*g] = uvvallo;
+                    uvval[2*g+1] = uvvalhi;
+                }
+            }
+            for (int r=0; r<=SSH; ++r)
+            {
+                const __m128i y = _mm_min_epu8(_mm_max_epu8(
+                    _mm_load_si128((const __m128i*)(srcpY+r*src_pitchR+x)), inmin_Y), inmax_Y);
+                const __m128i yw[2] = { _mm_unpacklo_epi8(y, zero), _mm_unpackhi_epi8(y, zero) };
+                __m128i yd[4];
+                for (int i=0; i<4; ++i)
+                {
+                    const __m128i t = i&1 ? _mm_unpackhi_epi16(yw[i>>1], zero) : 
+                        _mm_unpacklo_epi16(yw[i>>1], zero);
+                    yd[i] = RANGE ? madd32(t, fact_YY_hi, fact_YY_lo) : _mm_slli_epi32(t, 16);
+                    yd[i] = _mm_srai_epi32(_mm_add_epi32(yd[i], uvval[i]), 16);
+                }
+                const __m128i d = _mm_packus_epi16(_mm_packs_epi32(yd[0], yd[1]), 
+                    _mm_packs_epi32(yd[2], yd[3]));
+                _mm_store_si128((__m128i*)(dstpY+r*dst_pitchR+x), _mm_min_epu8(_mm_max_epu8(d, lo), hi));
+            }
+        }
+        srcpY += src_pitchY<<SSH;
+        dstpY += dst_pitchY<<SSH;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+    }
+}
+
+// Approximate YV12 kernel.  The chroma terms are evaluated with pmaddubsw on 
+// interleaved (u,v) bytes, two products per word, and scaled with pmulhrsw 
+// into 1/16 units.  Chroma only gets c4-1 and c7-1 from the table, the 
+// identity part is added back exactly.  Quantizing the coefficients to 2^-8 
+// or finer keeps the term within 0.5 of its exact value, and with the 
+// 1/32 roundings the result is never more than 1 LSB from exact=true.  On 
+// random frames about 2-14% of the Y and 2-9% of the U/V samples are off by 
+// that 1 LSB depending on mode and range, the rest match exactly.  Modes 
+// with larger coefficients (approxFits false) don't use this kernel.  CLAMP 
+// applies the clamps to the loaded and the packed bytes.
+template <bool RANGE, bool CLAMP>
+void conva_YV12_SSSE3(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned char *srcpY = pss->srcp;
+    const unsigned char *srcpU = pss->srcpU;
+    const unsigned char *srcpV = pss->srcpV;
+    const int src_pitchY = pss->src_pitch;
+    const int src_pitchR = pss->src_pitchR;
+    const int src_pitchUV = pss->src_pitchUV;
+    unsigned char *dstpY = pss->dstp;
+    unsigned char *dstpU = pss->dstpU;
+    unsigned char *dstpV = pss->dstpV;
+    const int dst_pitchY = pss->dst_pitch;
+    const int dst_pitchR = pss->dst_pitchR;
+    const int dst_pitchUV = pss->dst_pitchUV;
+    const int width = pss->widtha;
+    const int height = pss->height;
+    const __m128i q_Y = cs->aq[0], b_Y = cs->abias[0], k_Y = cs->ak[0];
+    const __m128i q_U = cs->aq[1], b_U = cs->abias[1], k_U = cs->ak[1];
+    const __m128i q_V = cs->aq[2], b_V = cs->abias[2], k_V = cs->ak[2];
+    const __m128i fact_YY = cs->afact_YY;
+    const __m128i bias_Y = cs->abias_Y;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i inmin_Y = _mm_set1_epi8((char)cs->inmin[0]), inmax_Y = _mm_set1_epi8((char)cs->inmax[0]);
+    const __m128i inmin_UV = _mm_set1_epi8((char)cs->inmin[1]), inmax_UV = _mm_set1_epi8((char)cs->inmax[1]);
+    const __m128i outmin_Y = _mm_set1_epi8((char)cs->outmin[0]), outmax_Y = _mm_set1_epi8((char)cs->outmax[0]);
+    const __m128i outmin_UV = _mm_set1_epi8((char)cs->outmin[1]), outmax_UV = _mm_set1_epi8((char)cs->outmax[1]);
+    for (int h=0; h<height; h+=2)
+    {
+        for (int x=0; x<width; x+=16)
+        {
+            __m128i u = _mm_loadl_epi64((const __m128i*)(srcpU+(x>>1)));
+            __m128i v = _mm_loadl_epi64((const __m128i*)(srcpV+(x>>1)));
+            if (CLAMP)
+            {
+                u = _mm_min_epu8(_mm_max_epu8(u, inmin_UV), inmax_UV);
+                v = _mm_min_epu8(_mm_max_epu8(v, inmin_UV), inmax_UV);
+            }
+            const __m128i uv = _mm_unpacklo_epi8(u, v);
+            const __m128i dy = _mm_add_epi16(_mm_mulhrs_epi16(
+                _mm_add_epi16(_mm_maddubs_epi16(uv, q_Y), b_Y), k_Y), bias_Y);
+            const __m128i du = _mm_mulhrs_epi16(_mm_add_epi16(_mm_maddubs_epi16(uv, q_U), b_U), k_U);
+            const __m128i dv = _mm_mulhrs_epi16(_mm_add_epi16(_mm_maddubs_epi16(uv, q_V), b_V), k_V);
+            const __m128i dylo = _mm_unpacklo_epi16(dy, dy);
+            const __m128i dyhi = _mm_unpackhi_epi16(dy, dy);
+            for (int r=0; r<2; ++r)
+            {
+                __m128i y = _mm_load_si128((const __m128i*)(srcpY+r*src_pitchR+x));
+                if (CLAMP)
+                    y = _mm_min_epu8(_mm_max_epu8(y, inmin_Y), inmax_Y);
+                __m128i ylo = _mm_unpacklo_epi8(y, zero);
+                __m128i yhi = _mm_unpackhi_epi8(y, zero);
+                if (RANGE)
+                {
+                    ylo = _mm_mulhrs_epi16(_mm_slli_epi16(ylo, 7), fact_YY);
+                    yhi = _mm_mulhrs_epi16(_mm_slli_epi16(yhi, 7), fact_YY);
+                }
+                else
+                {
+                    ylo = _mm_slli_epi16(ylo, 4);
+                    yhi = _mm_slli_epi16(yhi, 4);
+                }
+                ylo = _mm_srai_epi16(_mm_add_epi16(ylo, dylo), 4);
+                yhi = _mm_srai_epi16(_mm_add_epi16(yhi, dyhi), 4);
+                __m128i yo = _mm_packus_epi16(ylo, yhi);
+                if (CLAMP)
+                    yo = _mm_min_epu8(_mm_max_epu8(yo, outmin_Y), outmax_Y);
+                _mm_store_si128((__m128i*)(dstpY+r*dst_pitchR+x), yo);
+            }
+            const __m128i nu = _mm_srai_epi16(_mm_add_epi16(
+                _mm_slli_epi16(_mm_unpacklo_epi8(u, zero), 4), du), 4);
+            const __m128i nv = _mm_srai_epi16(_mm_add_epi16(
+                _mm_slli_epi16(_mm_unpacklo_epi8(v, zero), 4), dv), 4);
+            __m128i nuv = _mm_packus_epi16(nu, nv);
+            if (CLAMP)
+                nuv = _mm_min_epu8(_mm_max_epu8(nuv, outmin_UV), outmax_UV);
+            _mm_storel_epi64((__m128i*)(dstpU+(x>>1)), nuv);
+            _mm_storel_epi64((__m128i*)(dstpV+(x>>1)), _mm_unpackhi_epi64(nuv, nuv));
+        }
+        srcpY += src_pitchY*2;
+        dstpY += dst_pitchY*2;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+}
+
+#ifdef CM_AVX2
+// Same math as conva_YV12_SSSE3 on 32 pixels at a time.  The (u,v) words are 
+// built with vpmovzxbw so the chroma terms come out in order, only the 
+// luma duplication and the final packs need to fix up the lanes.
+template <bool RANGE, bool CLAMP>
+void conva_YV12_AVX2(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned char *srcpY = pss->srcp;
+    const unsigned char *srcpU = pss->srcpU;
+    const unsigned char *srcpV = pss->srcpV;
+    const int src_pitchY = pss->src_pitch;
+    const int src_pitchR = pss->src_pitchR;
+    const int src_pitchUV = pss->src_pitchUV;
+    unsigned char *dstpY = pss->dstp;
+    unsigned char *dstpU = pss->dstpU;
+    unsigned char *dstpV = pss->dstpV;
+    const int dst_pitchY = pss->dst_pitch;
+    const int dst_pitchR = pss->dst_pitchR;
+    const int dst_pitchUV = pss->dst_pitchUV;
+    const int width = pss->widtha;
+    const int height = pss->height;
+    const __m256i q_Y = _mm256_broadcastsi128_si256(cs->aq[0]);
+    const __m256i q_U = _mm256_broadcastsi128_si256(cs->aq[1]);
+    const __m256i q_V = _mm256_broadcastsi128_si256(cs->aq[2]);
+    const __m256i b_Y = _mm256_broadcastsi128_si256(cs->abias[0]);
+    const __m256i b_U = _mm256_broadcastsi128_si256(cs->abias[1]);
+    const __m256i b_V = _mm256_broadcastsi128_si256(cs->abias[2]);
+    const __m256i k_Y = _mm256_broadcastsi128_si256(cs->ak[0]);
+    const __m256i k_U = _mm256_broadcastsi128_si256(cs->ak[1]);
+    const __m256i k_V = _mm256_broadcastsi128_si256(cs->ak[2]);
+    const __m256i fact_YY = _mm256_broadcastsi128_si256(cs->afact_YY);
+    const __m256i bias_Y = _mm256_broadcastsi128_si256(cs->abias_Y);
+    const __m256i inmin_Y = _mm256_set1_epi8((char)cs->inmin[0]), inmax_Y = _mm256_set1_epi8((char)cs->inmax[0]);
+    const __m128i inmin_UV = _mm_set1_epi8((char)cs->inmin[1]), inmax_UV = _mm_set1_epi8((char)cs->inmax[1]);
+    const __m256i outmin_Y = _mm256_set1_epi8((char)cs->outmin[0]), outmax_Y = _mm256_set1_epi8((char)cs->outmax[0]);
+    const __m256i outmin_UV = _mm256_set1_epi8((char)cs->outmin[1]), outmax_UV = _mm256_set1_epi8((char)cs->outmax[1]);
+    for (int h=0; h<height; h+=2)
+    {
+        for (int x=0; x<width; x+=32)
+        {
+            __m128i u8 = _mm_load_si128((const __m128i*)(srcpU+(x>>1)));
+            __m128i v8 = _mm_load_si128((const __m128i*)(srcpV+(x>>1)));
+            if (CLAMP)
+            {
+                u8 = _mm_min_epu8(_mm_max_epu8(u8, inmin_UV), inmax_UV);
+                v8 = _mm_min_epu8(_mm_max_epu8(v8, inmin_UV), inmax_UV);
+            }
+            const __m256i u = _mm256_cvtepu8_epi16(u8);
+            const __m256i v = _mm256_cvtepu8_epi16(v8);
+            const __m256i uv = _mm256_or_si256(u, _mm256_slli_epi16(v, 8));
+            __m256i dy = _mm256_add_epi16(_mm256_mulhrs_epi16(
+                _mm256_add_epi16(_mm256_maddubs_epi16(uv, q_Y), b_Y), k_Y), bias_Y);
+            const __m256i du = _mm256_mulhrs_epi16(_mm256_add_epi16(_mm256_maddubs_epi16(uv, q_U), b_U), k_U);
+            const __m256i dv = _mm256_mulhrs_epi16(_mm256_add_epi16(_mm256_maddubs_epi16(uv, q_V), b_V), k_V);
+            dy = _mm256_permute4x64_epi64(dy, 0xD8);
+            const __m256i dylo = _mm256_unpacklo_epi16(dy, dy);
+            const __m256i dyhi = _mm256_unpackhi_epi16(dy, dy);
+            for (int r=0; r<2; ++r)
+            {
+                __m256i y = _mm256_load_si256((const __m256i*)(srcpY+r*src_pitchR+x));
+                if (CLAMP)
+                    y = _mm256_min_epu8(_mm256_max_epu8(y, inmin_Y), inmax_Y);
+                __m256i ylo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(y));
+                __m256i yhi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(y, 1));
+                if (RANGE)
+                {
+                    ylo = _mm256_mulhrs_epi16(_mm256_slli_epi16(ylo, 7), fact_YY);
+                    yhi = _mm256_mulhrs_epi16(_mm256_slli_epi16(yhi, 7), fact_YY);
+                }
+                else
+                {
+                    ylo = _mm256_slli_epi16(ylo, 4);
+                    yhi = _mm256_slli_epi16(yhi, 4);
+                }
+                ylo = _mm256_srai_epi16(_mm256_add_epi16(ylo, dylo), 4);
+                yhi = _mm256_srai_epi16(_mm256_add_epi16(yhi, dyhi), 4);
+                __m256i yo = _mm256_packus_epi16(ylo, yhi);
+                if (CLAMP)
+                    yo = _mm256_min_epu8(_mm256_max_epu8(yo, outmin_Y), outmax_Y);
+                _mm256_store_si256((__m256i*)(dstpY+r*dst_pitchR+x), _mm256_permute4x64_epi64(yo, 0xD8));
+            }
+            const __m256i nu = _mm256_srai_epi16(_mm256_add_epi16(_mm256_slli_epi16(u, 4), du), 4);
+            const __m256i nv = _mm256_srai_epi16(_mm256_add_epi16(_mm256_slli_epi16(v, 4), dv), 4);
+            __m256i nuv = _mm256_packus_epi16(nu, nv);
+            if (CLAMP)
+                nuv = _mm256_min_epu8(_mm256_max_epu8(nuv, outmin_UV), outmax_UV);
+            nuv = _mm256_permute4x64_epi64(nuv, 0xD8);
+            _mm_store_si128((__m128i*)(dstpU+(x>>1)), _mm256_castsi256_si128(nuv));
+            _mm_store_si128((__m128i*)(dstpV+(x>>1)), _mm256_extracti128_si256(nuv, 1));
+        }
+        srcpY += src_pitchY*2;
+        dstpY += dst_pitchY*2;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+    _mm256_zeroupper();
+}
+#endif
+
+// 9-16 bit 4:2:0 with 32 bit pmaddwd accumulation, same results as 
+// conv_YUV420P16_C.  Samples are centered on half so they fit signed words 
+// at 16 bit, the clamps run on the centered values and packssdw supplies 
+// the 16 bit saturation for free.  Works on 16 pixels (32 bytes) at a time.  
+// For P010 (NV=1) the two interleaved chroma loads are the (u,v) pairs.
+template <bool RANGE, int NV>
+void conv_YUV420P16_SSE2(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned char *srcpY = pss->srcp;
+    const unsigned char *srcpU = pss->srcpU;
+    const unsigned char *srcpV = pss->srcpV;
+    const int src_pitchY = pss->src_pitch;
+    const int src_pitchR = pss->src_pitchR;
+    const int src_pitchUV = pss->src_pitchUV;
+    unsigned char *dstpY = pss->dstp;
+    unsigned char *dstpU = pss->dstpU;
+    unsigned char *dstpV = pss->dstpV;
+    const int dst_pitchY = pss->dst_pitch;
+    const int dst_pitchR = pss->dst_pitchR;
+    const int dst_pitchUV = pss->dst_pitchUV;
+    const int width = pss->widtha;
+    const int height = pss->height;
+    const __m128i fact_Y = cs->hq[0], fact_U = cs->hq[1], fact_V = cs->hq[2], fact_YY = cs->hq[3];
+    const __m128i bias_Y = cs->hbias_Y, bias_UV = cs->hbias_UV;
+    const __m128i half = cs->hhalf;
+    const __m128i inmin_Y = cs->hclip[0], inmax_Y = cs->hclip[1];
+    const __m128i inmin_UV = cs->hclip[2], inmax_UV = cs->hclip[3];
+    const __m128i outmin_Y = cs->hclip[4], outmax_Y = cs->hclip[5];
+    const __m128i outmin_UV = cs->hclip[6], outmax_UV = cs->hclip[7];
+    const __m128i shift = _mm_cvtsi32_si128(cs->hshift);
+    const __m128i yshift = _mm_cvtsi32_si128(16-cs->hshift);
+    const __m128i zero = _mm_setzero_si128();
+    for (int h=0; h<height; h+=2)
+    {
+        for (int x=0; x<width; x+=32)
+        {
+            __m128i uvlo, uvhi;
+            if (NV)
+            {
+                uvlo = _mm_min_epi16(_mm_max_epi16(_mm_sub_epi16(
+                    _mm_load_si128((const __m128i*)(srcpU+x)), half), inmin_UV), inmax_UV);
+                uvhi = _mm_min_epi16(_mm_max_epi16(_mm_sub_epi16(
+                    _mm_load_si128((const __m128i*)(srcpU+x+16)), half), inmin_UV), inmax_UV);
+            }
+            else
+            {
+                const __m128i u = _mm_min_epi16(_mm_max_epi16(_mm_sub_epi16(
+                    _mm_load_si128((const __m128i*)(srcpU+(x>>1))), half), inmin_UV), inmax_UV);
+                const __m128i v = _mm_min_epi16(_mm_max_epi16(_mm_sub_epi16(
+                    _mm_load_si128((const __m128i*)(srcpV+(x>>1))), half), inmin_UV), inmax_UV);
+                uvlo = _mm_unpacklo_epi16(u, v);
+                uvhi = _mm_unpackhi_epi16(u, v);
+            }
+            const __m128i uvvallo = _mm_add_epi32(_mm_madd_epi16(uvlo, fact_Y), bias_Y);
+            const __m128i uvvalhi = _mm_add_epi32(_mm_madd_epi16(uvhi, fact_Y), bias_Y);
+            const __m128i uvval[4] = {
+                _mm_unpacklo_epi32(uvvallo, uvvallo), _mm_unpackhi_epi32(uvvallo, uvvallo),
+                _mm_unpacklo_epi32(uvvalhi, uvvalhi), _mm_unpackhi_epi32(uvvalhi, uvvalhi) };
+            for (int r=0; r<2; ++r)
+            {
+                for (int j=0; j<2; ++j)
+                {
+                    const __m128i y = _mm_min_epi16(_mm_max_epi16(_mm_sub_epi16(_mm_load_si128(
+                        (const __m128i*)(srcpY+r*src_pitchR+x+16*j)), half), inmin_Y), inmax_Y);
+                    __m128i ylo, yhi;
+                    if (RANGE)
+                    {
+                        ylo = _mm_madd_epi16(_mm_unpacklo_epi16(y, zero), fact_YY);
+                        yhi = _mm_madd_epi16(_mm_unpackhi_epi16(y, zero), fact_YY);
+                    }
+                    else
+                    {
+                        ylo = _mm_sra_epi32(_mm_unpacklo_epi16(zero, y), yshift);
+                        yhi = _mm_sra_epi32(_mm_unpackhi_epi16(zero, y), yshift);
+                    }
+                    ylo = _mm_sra_epi32(_mm_add_epi32(ylo, uvval[2*j]), shift);
+                    yhi = _mm_sra_epi32(_mm_add_epi32(yhi, uvval[2*j+1]), shift);
+                    const __m128i yd = _mm_min_epi16(_mm_max_epi16(_mm_packs_epi32(ylo, yhi), outmin_Y), outmax_Y);
+                    _mm_store_si128((__m128i*)(dstpY+r*dst_pitchR+x+16*j), _mm_add_epi16(yd, half));
+                }
+            }
+            __m128i nu = _mm_packs_epi32(
+                _mm_sra_epi32(_mm_add_epi32(_mm_madd_epi16(uvlo, fact_U), bias_UV), shift),
+                _mm_sra_epi32(_mm_add_epi32(_mm_madd_epi16(uvhi, fact_U), bias_UV), shift));
+            __m128i nv = _mm_packs_epi32(
+                _mm_sra_epi32(_mm_add_epi32(_mm_madd_epi16(uvlo, fact_V), bias_UV), shift),
+                _mm_sra_epi32(_mm_add_epi32(_mm_madd_epi16(uvhi, fact_V), bias_UV), shift));
+            nu = _mm_min_epi16(_mm_max_epi16(nu, outmin_UV), outmax_UV);
+            nv = _mm_min_epi16(_mm_max_epi16(nv, outmin_UV), outmax_UV);
+            if (NV)
+            {
+                _mm_store_si128((__m128i*)(dstpU+x), _mm_add_epi16(_mm_unpacklo_epi16(nu, nv), half));
+                _mm_store_si128((__m128i*)(dstpU+x+16), _mm_add_epi16(_mm_unpackhi_epi16(nu, nv), half));
+            }
+            else
+            {
+                _mm_store_si128((__m128i*)(dstpU+(x>>1)), _mm_add_epi16(nu, half));
+                _mm_store_si128((__m128i*)(dstpV+(x>>1)), _mm_add_epi16(nv, half));
+            }
+        }
+        srcpY += src_pitchY*2;
+        dstpY += dst_pitchY*2;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+}
+
+// (h*4096 + l) >> 20 of a split sum, exact for any l since 
+// floor((h*4096+l)/4096) is h + (l>>12).
+static inline __m128i sum_hl(const __m128i &h, const __m128i &l)
+{
+    return _mm_srai_epi32(_mm_add_epi32(h, _mm_srai_epi32(l, 12)), 8);
+}
+
+// Like getsse2p but split at bit 12 for the 2^-20 coefficients.
+static void getsse2w(int ca, int cb, __m128i &hi, __m128i &lo)
+{
+    hi = _mm_set1_epi32(((ca>>12)&0xFFFF) | ((cb>>12)<<16));
+    lo = _mm_set1_epi32((ca&0xFFF) | ((cb&0xFFF)<<16));
+}
+
+// 15/16 bit 4:2:0 with 2^-20 coefficients, same results as 
+// conv_YUV420P16W_C.  Each coefficient and bias is split into c>>12 and 
+// c&4095, and the two 32 bit sums are combined by sum_hl instead of 
+// widening to 64 bits.  Layout and clamps are those of 
+// conv_YUV420P16_SSE2.
+template <int NV>
+void conv_YUV420P16W_SSE2(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned char *srcpY = pss->srcp;
+    const unsigned char *srcpU = pss->srcpU;
+    const unsigned char *srcpV = pss->srcpV;
+    const int src_pitchY = pss->src_pitch;
+    const int src_pitchR = pss->src_pitchR;
+    const int src_pitchUV = pss->src_pitchUV;
+    unsigned char *dstpY = pss->dstp;
+    unsigned char *dstpU = pss->dstpU;
+    unsigned char *dstpV = pss->dstpV;
+    const int dst_pitchY = pss->dst_pitch;
+    const int dst_pitchR = pss->dst_pitchR;
+    const int dst_pitchUV = pss->dst_pitchUV;
+    const int width = pss->widtha;
+    const int height = pss->height;
+    const __m128i *hi = cs->hq, *lo = cs->hlo;
+    const __m128i bias_Y = cs->hbias_Y, bias_UV = cs->hbias_UV;
+    const __m128i lbias_Y = cs->hlbias_Y, lbias_UV = cs->hlbias_UV;
+    const __m128i half = cs->hhalf;
+    const __m128i inmin_Y = cs->hclip[0], inmax_Y = cs->hclip[1];
+    const __m128i inmin_UV = cs->hclip[2], inmax_UV = cs->hclip[3];
+    const __m128i outmin_Y = cs->hclip[4], outmax_Y = cs->hclip[5];
+    const __m128i outmin_UV = cs->hclip[6], outmax_UV = cs->hclip[7];
+    const __m128i zero = _mm_setzero_si128();
+    for (int h=0; h<height; h+=2)
+    {
+        for (int x=0; x<width; x+=32)
+        {
+            __m128i uv[2];
+            if (NV)
+            {
+                uv[0] = _mm_min_epi16(_mm_max_epi16(_mm_sub_epi16(
+                    _mm_load_si128((const __m128i*)(srcpU+x)), half), inmin_UV), inmax_UV);
+                uv[1] = _mm_min_epi16(_mm_max_epi16(_mm_sub_epi16(
+                    _mm_load_si128((const __m128i*)(srcpU+x+16)), half), inmin_UV), inmax_UV);
+            }
+            else
+            {
+                const __m128i u = _mm_min_epi16(_mm_max_epi16(_mm_sub_epi16(
+                    _mm_load_si128((const __m128i*)(srcpU+(x>>1))), half), inmin_UV), inmax_UV);
+                const __m128i v = _mm_min_epi16(_mm_max_epi16(_mm_sub_epi16(
+                    _mm_load_si128((const __m128i*)(srcpV+(x>>1))), half), inmin_UV), inmax_UV);
+                uv[0] = _mm_unpacklo_epi16(u, v);
+                uv[1] = _mm_unpackhi_epi16(u, v);
+            }
+            // uvval hi and lo sums, each one duplicated for its two luma pixels
+            __m128i uvh[4], uvl[4];
+            for (int k=0; k<2; ++k)
+            {
+                const __m128i sh = _mm_add_epi32(_mm_madd_epi16(uv[k], hi[0]), bias_Y);
+                const __m128i sl = _mm_add_epi32(_mm_madd_epi16(uv[k], lo[0]), lbias_Y);
+                uvh[2*k] = _mm_unpacklo_epi32(sh, sh);
+                uvh[2*k+1] = _mm_unpackhi_epi32(sh, sh);
+                uvl[2*k] = _mm_unpacklo_epi32(sl, sl);
+                uvl[2*k+1] = _mm_unpackhi_epi32(sl, sl);
+            }
+            for (int r=0; r<2; ++r)
+            {
+                for (int j=0; j<2; ++j)
+                {
+                    const __m128i y = _mm_min_epi16(_mm_max_epi16(_mm_sub_epi16(_mm_load_si128(
+                        (const __m128i*)(srcpY+r*src_pitchR+x+16*j)), half), inmin_Y), inmax_Y);
+                    const __m128i ylo = _mm_unpacklo_epi16(y, zero);
+                    const __m128i yhi = _mm_unpackhi_epi16(y, zero);
+                    const __m128i rlo = sum_hl(_mm_add_epi32(_mm_madd_epi16(ylo, hi[3]), uvh[2*j]), 
+                        _mm_add_epi32(_mm_madd_epi16(ylo, lo[3]), uvl[2*j]));
+                    const __m128i rhi = sum_hl(_mm_add_epi32(_mm_madd_epi16(yhi, hi[3]), uvh[2*j+1]), 
+                        _mm_add_epi32(_mm_madd_epi16(yhi, lo[3]), uvl[2*j+1]));
+                    const __m128i yd = _mm_min_epi16(_mm_max_epi16(_mm_packs_epi32(rlo, rhi), outmin_Y), outmax_Y);
+                    _mm_store_si128((__m128i*)(dstpY+r*dst_pitchR+x+16*j), _mm_add_epi16(yd, half));
+                }
+            }
+            __m128i nuv[2][2];
+            for (int c=0; c<2; ++c)
+                for (int k=0; k<2; ++k)
+                    nuv[c][k] = sum_hl(_mm_add_epi32(_mm_madd_epi16(uv[k], hi[1+c]), bias_UV), 
+                        _mm_add_epi32(_mm_madd_epi16(uv[k], lo[1+c]), lbias_UV));
+            __m128i nu = _mm_packs_epi32(nuv[0][0], nuv[0][1]);
+            __m128i nv = _mm_packs_epi32(nuv[1][0], nuv[1][1]);
+            nu = _mm_min_epi16(_mm_max_epi16(nu, outmin_UV), outmax_UV);
+            nv = _mm_min_epi16(_mm_max_epi16(nv, outmin_UV), outmax_UV);
+            if (NV)
+            {
+                _mm_store_si128((__m128i*)(dstpU+x), _mm_add_epi16(_mm_unpacklo_epi16(nu, nv), half));
+                _mm_store_si128((__m128i*)(dstpU+x+16), _mm_add_epi16(_mm_unpackhi_epi16(nu, nv), half));
+            }
+            else
+            {
+                _mm_store_si128((__m128i*)(dstpU+(x>>1)), _mm_add_epi16(nu, half));
+                _mm_store_si128((__m128i*)(dstpV+(x>>1)), _mm_add_epi16(nv, half));
+            }
+        }
+        srcpY += src_pitchY*2;
+        dstpY += dst_pitchY*2;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+}
+
+// v210 with the sums of conv_v210_C, 6 pixels (16 bytes) at a time.  pshufb 
+// gathers the two bytes holding each 10 bit sample into a word and pmullw 
+// moves the sample to the top, so one shift right drops its neighbours.  The 
+// u,v words come out as the pairs pmaddwd wants and are centered and clamped 
+// like in conv_YUV420P16_SSE2.  The repack sums the first two samples of 
+// every dword with pmaddwd and adds the third one shifted up by 20.
+void conv_v210_SSSE3(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned char *srcp = pss->srcp;
+    unsigned char *dstp = pss->dstp;
+    const int src_pitch = pss->src_pitch;
+    const int dst_pitch = pss->dst_pitch;
+    const int width = pss->width;
+    const int height = pss->height;
+    const __m128i fact_Y = cs->hq[0], fact_U = cs->hq[1], fact_V = cs->hq[2], fact_YY = cs->hq[3];
+    const __m128i bias_Y = cs->hbias_Y, bias_UV = cs->hbias_UV;
+    const __m128i half = cs->hhalf;
+    const __m128i inmin_Y = cs->hclip[0], inmax_Y = cs->hclip[1];
+    const __m128i inmin_UV = cs->hclip[2], inmax_UV = cs->hclip[3];
+    const __m128i outmin_Y = cs->hclip[4], outmax_Y = cs->hclip[5];
+    const __m128i outmin_UV = cs->hclip[6], outmax_UV = cs->hclip[7];
+    const __m128i shift = _mm_cvtsi32_si128(cs->hshift);
+    const __m128i zero = _mm_setzero_si128();
+    // u0 v0 u1 v1 u2 v2 and y0-y5, the factors undo the 0, 2, or 4 bit offset
+    const __m128i gather_UV = _mm_setr_epi8(0,1, 2,3, 5,6, 8,9, 10,11, 13,14, -1,-1, -1,-1);
+    const __m128i gather_Y = _mm_setr_epi8(1,2, 4,5, 6,7, 9,10, 12,13, 14,15, -1,-1, -1,-1);
+    const __m128i top_UV = _mm_setr_epi16(64, 4, 16, 64, 4, 16, 0, 0);
+    const __m128i top_Y = _mm_setr_epi16(16, 64, 4, 16, 64, 4, 0, 0);
+    // the first two samples of every dword (u0 y0, y1 u1, v1 y3, y4 v2) and 
+    // the third (v0, y2, u2, y5), from the packed u0-u2 v0-v2 and y0-y5 words
+    const __m128i pair_C = _mm_setr_epi8(0,1, -1,-1, -1,-1, 2,3, 10,11, -1,-1, -1,-1, 12,13);
+    const __m128i pair_Y = _mm_setr_epi8(-1,-1, 0,1, 2,3, -1,-1, -1,-1, 6,7, 8,9, -1,-1);
+    const __m128i third_C = _mm_setr_epi8(8,9,-1,-1, -1,-1,-1,-1, 4,5,-1,-1, -1,-1,-1,-1);
+    const __m128i third_Y = _mm_setr_epi8(-1,-1,-1,-1, 4,5,-1,-1, -1,-1,-1,-1, 10,11,-1,-1);
+    const __m128i pack = _mm_set1_epi32(1 | (1024<<16));
+    for (int h=0; h<height; ++h)
+    {
+        for (int x=0; x<width; x+=16)
+        {
+            const __m128i w = _mm_load_si128((const __m128i*)(srcp+x));
+            const __m128i uv = _mm_min_epi16(_mm_max_epi16(_mm_sub_epi16(_mm_srli_epi16(_mm_mullo_epi16(
+                _mm_shuffle_epi8(w, gather_UV), top_UV), 6), half), inmin_UV), inmax_UV);
+            const __m128i y = _mm_min_epi16(_mm_max_epi16(_mm_sub_epi16(_mm_srli_epi16(_mm_mullo_epi16(
+                _mm_shuffle_epi8(w, gather_Y), top_Y), 6), half), inmin_Y), inmax_Y);
+            const __m128i uvval = _mm_add_epi32(_mm_madd_epi16(uv, fact_Y), bias_Y);
+            const __m128i ylo = _mm_sra_epi32(_mm_add_epi32(_mm_madd_epi16(
+                _mm_unpacklo_epi16(y, zero), fact_YY), _mm_unpacklo_epi32(uvval, uvval)), shift);
+            const __m128i yhi = _mm_sra_epi32(_mm_add_epi32(_mm_madd_epi16(
+                _mm_unpackhi_epi16(y, zero), fact_YY), _mm_unpackhi_epi32(uvval, uvval)), shift);
+            const __m128i yd = _mm_add_epi16(_mm_min_epi16(_mm_max_epi16(
+                _mm_packs_epi32(ylo, yhi), outmin_Y), outmax_Y), half);
+            const __m128i nuv = _mm_add_epi16(_mm_min_epi16(_mm_max_epi16(_mm_packs_epi32(
+                _mm_sra_epi32(_mm_add_epi32(_mm_madd_epi16(uv, fact_U), bias_UV), shift),
+                _mm_sra_epi32(_mm_add_epi32(_mm_madd_epi16(uv, fact_V), bias_UV), shift)), 
+                outmin_UV), outmax_UV), half);
+            const __m128i pairs = _mm_or_si128(_mm_shuffle_epi8(nuv, pair_C), _mm_shuffle_epi8(yd, pair_Y));
+            const __m128i third = _mm_or_si128(_mm_shuffle_epi8(nuv, third_C), _mm_shuffle_epi8(yd, third_Y));
+            _mm_store_si128((__m128i*)(dstp+x), _mm_add_epi32(_mm_madd_epi16(pairs, pack), 
+                _mm_slli_epi32(third, 20)));
+        }
+        srcp += src_pitch;
+        dstp += dst_pitch;
+    }
+}
+
+// Rounding constant (ORDERED=false) or the dither_matrix thresholds of 16 
+// pixels of a row, for sums with shift fraction bits.
+template <bool ORDERED>
+static inline void narrow_thresholds(int row, int shift, __m128i t[4])
+{
+    if (ORDERED)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i b = _mm_load_si128((const __m128i*)dither_matrix[row&15]);
+        const __m128i bw[2] = { _mm_unpacklo_epi8(b, zero), _mm_unpackhi_epi8(b, zero) };
+        const __m128i s = _mm_cvtsi32_si128(shift-8);
+        const __m128i rnd = _mm_set1_epi32(1<<(shift-9));
+        for (int i=0; i<4; ++i)
+        {
+            const __m128i d = i&1 ? _mm_unpackhi_epi16(bw[i>>1], zero) : _mm_unpacklo_epi16(bw[i>>1], zero);
+            t[i] = _mm_add_epi32(_mm_sll_epi32(d, s), rnd);
+        }
+    }
+    else
+        t[0] = t[1] = t[2] = t[3] = _mm_set1_epi32(1<<(shift-1));
+}
+
+static inline __m128i narrow_pack(const __m128i &a, const __m128i &b, const __m128i &ta, 
+    const __m128i &tb, const __m128i &shift)
+{
+    return _mm_packs_epi32(_mm_sra_epi32(_mm_add_epi32(a, ta), shift), 
+        _mm_sra_epi32(_mm_add_epi32(b, tb), shift));
+}
+
+// 9-16 bit 4:2:0 in, 8 bit out, same results as convn_YUV420P16_C with 
+// dither=0 (round) or 1 (ORDERED).  The sums of conv_YUV420P16_SSE2 come 
+// out less 128<<nshift, so the 128 is added back on the packed words 
+// before the clamps and packuswb.
+template <bool ORDERED>
+void convn_YUV420P16_SSE2(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned char *srcpY = pss->srcp;
+    const unsigned char *srcpU = pss->srcpU;
+    const unsigned char *srcpV = pss->srcpV;
+    const int src_pitchY = pss->src_pitch;
+    const int src_pitchR = pss->src_pitchR;
+    const int src_pitchUV = pss->src_pitchUV;
+    unsigned char *dstpY = pss->dstp;
+    unsigned char *dstpU = pss->dstpU;
+    unsigned char *dstpV = pss->dstpV;
+    const int dst_pitchY = pss->dst_pitch;
+    const int dst_pitchR = pss->dst_pitchR;
+    const int dst_pitchUV = pss->dst_pitchUV;
+    const int width = pss->widtha;
+    const int height = pss->height;
+    const __m128i fact_Y = cs->hq[0], fact_U = cs->hq[1], fact_V = cs->hq[2], fact_YY = cs->hq[3];
+    const __m128i bias_Y = cs->hbias_Y, bias_UV = cs->hbias_UV;
+    const __m128i half = cs->hhalf;
+    const __m128i inmin_Y = cs->hclip[0], inmax_Y = cs->hclip[1];
+    const __m128i inmin_UV = cs->hclip[2], inmax_UV = cs->hclip[3];
+    const __m128i min_Y = cs->nclip[0], max_Y = cs->nclip[1];
+    const __m128i min_UV = cs->nclip[2], max_UV = cs->nclip[3];
+    const __m128i shift = _mm_cvtsi32_si128(cs->nshift);
+    const __m128i q128 = _mm_set1_epi16(128);
+    const __m128i zero = _mm_setzero_si128();
+    for (int h=0; h<height; h+=2)
+    {
+        const int line = pss->line0+(h>>1)*pss->linestep;
+        __m128i tY[2][4], tC[4];
+        narrow_thresholds<ORDERED>(line<<1, cs->nshift, tY[0]);
+        narrow_thresholds<ORDERED>((line<<1)+1, cs->nshift, tY[1]);
+        narrow_thresholds<ORDERED>(line, cs->nshift, tC);
+        for (int x=0; x<width; x+=32)
+        {
+            const __m128i u = _mm_min_epi16(_mm_max_epi16(_mm_sub_epi16(
+                _mm_load_si128((const __m128i*)(srcpU+(x>>1))), half), inmin_UV), inmax_UV);
+            const __m128i v = _mm_min_epi16(_mm_max_epi16(_mm_sub_epi16(
+                _mm_load_si128((const __m128i*)(srcpV+(x>>1))), half), inmin_UV), inmax_UV);
+            const __m128i uvlo = _mm_unpacklo_epi16(u, v);
+            const __m128i uvhi = _mm_unpackhi_epi16(u, v);
+            const __m128i uvvallo = _mm_add_epi32(_mm_madd_epi16(uvlo, fact_Y), bias_Y);
+            const __m128i uvvalhi = _mm_add_epi32(_mm_madd_epi16(uvhi, fact_Y), bias_Y);
+            const __m128i uvval[4] = {
+                _mm_unpacklo_epi32(uvvallo, uvvallo), _mm_unpackhi_epi32(uvvallo, uvvallo),
+                _mm_unpacklo_epi32(uvvalhi, uvvalhi), _mm_unpackhi_epi32(uvvalhi, uvvalhi) };
+            for (int r=0; r<2; ++r)
+            {
+                __m128i yw[2];
+                for (int j=0; j<2; ++j)
+                {
+                    const __m128i y = _mm_min_epi16(_mm_max_epi16(_mm_sub_epi16(_mm_load_si128(
+                        (const __m128i*)(srcpY+r*src_pitchR+x+16*j)), half), inmin_Y), inmax_Y);
+                    const __m128i ylo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(y, zero), fact_YY), uvval[2*j]);
+                    const __m128i yhi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(y, zero), fact_YY), uvval[2*j+1]);
+                    yw[j] = _mm_min_epi16(_mm_max_epi16(_mm_add_epi16(
+                        narrow_pack(ylo, yhi, tY[r][2*j], tY[r][2*j+1], shift), q128), min_Y), max_Y);
+                }
+                _mm_store_si128((__m128i*)(dstpY+r*dst_pitchR+(x>>1)), _mm_packus_epi16(yw[0], yw[1]));
+            }
+            const __m128i *t = tC+((x>>4)&2);
+            const __m128i nu = _mm_min_epi16(_mm_max_epi16(_mm_add_epi16(narrow_pack(
+                _mm_add_epi32(_mm_madd_epi16(uvlo, fact_U), bias_UV),
+                _mm_add_epi32(_mm_madd_epi16(uvhi, fact_U), bias_UV), t[0], t[1], shift), q128), min_UV), max_UV);
+            const __m128i nv = _mm_min_epi16(_mm_max_epi16(_mm_add_epi16(narrow_pack(
+                _mm_add_epi32(_mm_madd_epi16(uvlo, fact_V), bias_UV),
+                _mm_add_epi32(_mm_madd_epi16(uvhi, fact_V), bias_UV), t[0], t[1], shift), q128), min_UV), max_UV);
+            const __m128i uv = _mm_packus_epi16(nu, nv);
+            _mm_storel_epi64((__m128i*)(dstpU+(x>>2)), uv);
+            _mm_storel_epi64((__m128i*)(dstpV+(x>>2)), _mm_srli_si128(uv, 8));
+        }
+        srcpY += src_pitchY*2;
+        dstpY += dst_pitchY*2;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+}
+
+// 8 bit 4:2:0 (SSH=1), 4:2:2 (SSW=1), or 4:4:4 in, 9-16 bit out, same 
+// results as convd_YUVP8_C.  The exact 32 bit sums of convx_YV12_SSE2 are 
+// shifted by 24-depth and come out less 32768, so packssdw saturates them 
+// to 0-65535 and the clamps can run on signed words.  The 8 bit input is 
+// clamped on the bytes.  Works on 16 luma pixels at a time and stays inside 
+// the 16 bit rows by rounding the width up to 16 rather than using widtha.
+template <int SSW, int SSH>
+void convd_YUVP8_SSE2(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned char *srcpY = pss->srcp;
+    const unsigned char *srcpU = pss->srcpU;
+    const unsigned char *srcpV = pss->srcpV;
+    const int src_pitchY = pss->src_pitch;
+    const int src_pitchR = pss->src_pitchR;
+    const int src_pitchUV = pss->src_pitchUV;
+    unsigned char *dstpY = pss->dstp;
+    unsigned char *dstpU = pss->dstpU;
+    unsigned char *dstpV = pss->dstpV;
+    const int dst_pitchY = pss->dst_pitch;
+    const int dst_pitchR = pss->dst_pitchR;
+    const int dst_pitchUV = pss->dst_pitchUV;
+    const int width = (pss->width+15)&~15;
+    const int height = pss->height;
+    const __m128i fact_Y_hi = cs->xhi[0], fact_Y_lo = cs->xlo[0];
+    const __m128i fact_U_hi = cs->xhi[1], fact_U_lo = cs->xlo[1];
+    const __m128i fact_V_hi = cs->xhi[2], fact_V_lo = cs->xlo[2];
+    const __m128i fact_YY_hi = cs->xhi[3], fact_YY_lo = cs->xlo[3];
+    const __m128i bias_Y = cs->dbias[0], bias_UV = cs->dbias[1];
+    const __m128i min_Y = cs->dclip[0], max_Y = cs->dclip[1];
+    const __m128i min_UV = cs->dclip[2], max_UV = cs->dclip[3];
+    const __m128i shift = _mm_cvtsi32_si128(cs->dshift);
+    const __m128i sign = _mm_set1_epi16((short)0x8000);
+    const __m128i q128 = _mm_set1_epi16(128);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i inmin_Y = _mm_set1_epi8((char)cs->inmin[0]), inmax_Y = _mm_set1_epi8((char)cs->inmax[0]);
+    const __m128i inmin_UV = _mm_set1_epi8((char)cs->inmin[1]), inmax_UV = _mm_set1_epi8((char)cs->inmax[1]);
+    for (int h=0; h<height; h+=1<<SSH)
+    {
+        for (int x=0; x<width; x+=16)
+        {
+            // 8 chroma samples per group, one group for 4:2:x and two for 4:4:4
+            __m128i uvval[4];
+            for (int g=0; g<(SSW ? 1 : 2); ++g)
+            {
+                const __m128i u = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_min_epu8(_mm_max_epu8(
+                    _mm_loadl_epi64((const __m128i*)(srcpU+(x>>SSW)+8*g)), inmin_UV), inmax_UV), zero), q128);
+                const __m128i v = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_min_epu8(_mm_max_epu8(
+                    _mm_loadl_epi64((const __m128i*)(srcpV+(x>>SSW)+8*g)), inmin_UV), inmax_UV), zero), q128);
+                const __m128i uvlo = _mm_unpacklo_epi16(u, v);
+                const __m128i uvhi = _mm_unpackhi_epi16(u, v);
+                const __m128i uvvallo = _mm_add_epi32(madd32(uvlo, fact_Y_hi, fact_Y_lo), bias_Y);
+                const __m128i uvvalhi = _mm_add_epi32(madd32(uvhi, fact_Y_hi, fact_Y_lo), bias_Y);
+                if (SSW)
+                {
+                    uvval[0] = _mm_unpacklo_epi32(uvvallo, uvvallo);
+                    uvval[1] = _mm_unpackhi_epi32(uvvallo, uvvallo);
+                    uvval[2] = _mm_unpacklo_epi32(uvvalhi, uvvalhi);
+                    uvval[3] = _mm_unpackhi_epi32(uvvalhi, uvvalhi);
+                }
+                else
+                {
+                    uvval[2*g] = uvvallo;
+                    uvval[2*g+1] = uvvalhi;
+                }
+                const __m128i nu = _mm_packs_epi32(
+                    _mm_sra_epi32(_mm_add_epi32(madd32(uvlo, fact_U_hi, fact_U_lo), bias_UV), shift),
+                    _mm_sra_epi32(_mm_add_epi32(madd32(uvhi, fact_U_hi, fact_U_lo), bias_UV), shift));
+                const __m128i nv = _mm_packs_epi32(
+                    _mm_sra_epi32(_mm_add_epi32(madd32(uvlo, fact_V_hi, fact_V_lo), bias_UV), shift),
+                    _mm_sra_epi32(_mm_add_epi32(madd32(uvhi, fact_V_hi, fact_V_lo), bias_UV), shift));
+                _mm_store_si128((__m128i*)(dstpU+2*((x>>SSW)+8*g)), 
+                    _mm_xor_si128(_mm_min_epi16(_mm_max_epi16(nu, min_UV), max_UV), sign));
+                _mm_store_si128((__m128i*)(dstpV+2*((x>>SSW)+8*g)), 
+                    _mm_xor_si128(_mm_min_epi16(_mm_max_epi16(nv, min_UV), max_UV), sign));
+            }
+            for (int r=0; r<(1<<SSH); ++r)
+            {
+                const __m128i y = _mm_min_epu8(_mm_max_epu8(
+                    _mm_load_si128((const __m128i*)(srcpY+r*src_pitchR+x)), inmin_Y), inmax_Y);
+                const __m128i yw[2] = { _mm_unpacklo_epi8(y, zero), _mm_unpackhi_epi8(y, zero) };
+                __m128i yd[4];
+                for (int i=0; i<4; ++i)
+                {
+                    const __m128i t = i&1 ? _mm_unpackhi_epi16(yw[i>>1], zero) : 
+                        _mm_unpacklo_epi16(yw[i>>1], zero);
+                    yd[i] = _mm_sra_epi32(_mm_add_epi32(madd32(t, fact_YY_hi, fact_YY_lo), uvval[i]), shift);
+                }
+                for (int j=0; j<2; ++j)
+                {
+                    const __m128i w = _mm_min_epi16(_mm_max_epi16(_mm_packs_epi32(yd[2*j], yd[2*j+1]), min_Y), max_Y);
+                    _mm_store_si128((__m128i*)(dstpY+r*dst_pitchR+2*x+16*j), _mm_xor_si128(w, sign));
+                }
+            }
+        }
+        srcpY += src_pitchY<<SSH;
+        dstpY += dst_pitchY<<SSH;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+}
+
+// Float 4:4:4, same math and order as conv_YUV444F_C on 4 pixels at a time.
+template <bool CLAMP>
+void conv_YUV444PS_SSE2(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned char *srcpY = pss->srcp;
+    const unsigned char *srcpU = pss->srcpU;
+    const unsigned char *srcpV = pss->srcpV;
+    const int src_pitchY = pss->src_pitch;
+    const int src_pitchUV = pss->src_pitchUV;
+    unsigned char *dstpY = pss->dstp;
+    unsigned char *dstpU = pss->dstpU;
+    unsigned char *dstpV = pss->dstpV;
+    const int dst_pitchY = pss->dst_pitch;
+    const int dst_pitchUV = pss->dst_pitchUV;
+    const int width = pss->widtha;
+    const int height = pss->height;
+    const __m128 c1 = cs->fv[0], c2 = cs->fv[1], c3 = cs->fv[2], c4 = cs->fv[3];
+    const __m128 c5 = cs->fv[4], c6 = cs->fv[5], c7 = cs->fv[6], bias_Y = cs->fv[7];
+    const __m128 *clip = cs->fclipv;
+    for (int h=0; h<height; ++h)
+    {
+        for (int x=0; x<width; x+=16)
+        {
+            __m128 y = _mm_load_ps((const float*)(srcpY+x));
+            __m128 u = _mm_load_ps((const float*)(srcpU+x));
+            __m128 v = _mm_load_ps((const float*)(srcpV+x));
+            if (CLAMP)
+            {
+                y = _mm_min_ps(_mm_max_ps(y, clip[0]), clip[1]);
+                u = _mm_min_ps(_mm_max_ps(u, clip[2]), clip[3]);
+                v = _mm_min_ps(_mm_max_ps(v, clip[2]), clip[3]);
+            }
+            __m128 ny = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(c1, y), 
+                _mm_mul_ps(c2, u)), _mm_mul_ps(c3, v)), bias_Y);
+            __m128 nu = _mm_add_ps(_mm_mul_ps(c4, u), _mm_mul_ps(c5, v));
+            __m128 nv = _mm_add_ps(_mm_mul_ps(c6, u), _mm_mul_ps(c7, v));
+            if (CLAMP)
+            {
+                ny = _mm_min_ps(_mm_max_ps(ny, clip[4]), clip[5]);
+                nu = _mm_min_ps(_mm_max_ps(nu, clip[6]), clip[7]);
+                nv = _mm_min_ps(_mm_max_ps(nv, clip[6]), clip[7]);
+            }
+            _mm_store_ps((float*)(dstpY+x), ny);
+            _mm_store_ps((float*)(dstpU+x), nu);
+            _mm_store_ps((float*)(dstpV+x), nv);
+        }
+        srcpY += src_pitchY;
+        dstpY += dst_pitchY;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+}
+
+// The float 8 bit level in 2^-16 units like fixf, maxps returns the -1 for NaN.
+static inline __m128i fixps(const __m128 &f)
+{
+    return _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(f, _mm_set1_ps(-1.0f)), 
+        _mm_set1_ps(256.0f)), _mm_set1_ps(65536.0f)));
+}
+
+// Float 4:4:4 in, 8 bit out, same results as convn_YUV444F_C<float> with 
+// dither=0 (round) or 1 (ORDERED).  Works on 8 pixels at a time.
+template <bool ORDERED>
+void convn_YUV444PS_SSE2(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned char *srcpY = pss->srcp;
+    const unsigned char *srcpU = pss->srcpU;
+    const unsigned char *srcpV = pss->srcpV;
+    const int src_pitchY = pss->src_pitch;
+    const int src_pitchUV = pss->src_pitchUV;
+    unsigned char *dstpY = pss->dstp;
+    unsigned char *dstpU = pss->dstpU;
+    unsigned char *dstpV = pss->dstpV;
+    const int dst_pitchY = pss->dst_pitch;
+    const int dst_pitchUV = pss->dst_pitchUV;
+    const int width = pss->widtha;
+    const int height = pss->height;
+    const __m128 c1 = cs->fv[0], c2 = cs->fv[1], c3 = cs->fv[2], c4 = cs->fv[3];
+    const __m128 c5 = cs->fv[4], c6 = cs->fv[5], c7 = cs->fv[6], bias_Y = cs->fv[7];
+    const __m128 *clip = cs->fclipv;
+    const __m128 k255 = _mm_set1_ps(255.0f), k128 = _mm_set1_ps(128.0f);
+    const __m128i min_Y = cs->nclip[0], max_Y = cs->nclip[1];
+    const __m128i min_UV = cs->nclip[2], max_UV = cs->nclip[3];
+    const __m128i shift = _mm_cvtsi32_si128(16);
+    for (int h=0; h<height; ++h)
+    {
+        __m128i tr[4];
+        narrow_thresholds<ORDERED>(pss->line0+h*pss->linestep, 16, tr);
+        for (int x=0; x<width; x+=32)
+        {
+            __m128i qy[2], qu[2], qv[2];
+            for (int i=0; i<2; ++i)
+            {
+                const __m128 y = _mm_min_ps(_mm_max_ps(_mm_load_ps((const float*)(srcpY+x+16*i)), clip[0]), clip[1]);
+                const __m128 u = _mm_min_ps(_mm_max_ps(_mm_load_ps((const float*)(srcpU+x+16*i)), clip[2]), clip[3]);
+                const __m128 v = _mm_min_ps(_mm_max_ps(_mm_load_ps((const float*)(srcpV+x+16*i)), clip[2]), clip[3]);
+                qy[i] = fixps(_mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(c1, y), 
+                    _mm_mul_ps(c2, u)), _mm_mul_ps(c3, v)), bias_Y), k255));
+                qu[i] = fixps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(c4, u), _mm_mul_ps(c5, v)), k255), k128));
+                qv[i] = fixps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(c6, u), _mm_mul_ps(c7, v)), k255), k128));
+            }
+            const __m128i *t = tr+((x>>4)&2);
+            const __m128i ny = _mm_min_epi16(_mm_max_epi16(narrow_pack(qy[0], qy[1], t[0], t[1], shift), min_Y), max_Y);
+            const __m128i nu = _mm_min_epi16(_mm_max_epi16(narrow_pack(qu[0], qu[1], t[0], t[1], shift), min_UV), max_UV);
+            const __m128i nv = _mm_min_epi16(_mm_max_epi16(narrow_pack(qv[0], qv[1], t[0], t[1], shift), min_UV), max_UV);
+            const __m128i uv = _mm_packus_epi16(nu, nv);
+            _mm_storel_epi64((__m128i*)(dstpY+(x>>2)), _mm_packus_epi16(ny, ny));
+            _mm_storel_epi64((__m128i*)(dstpU+(x>>2)), uv);
+            _mm_storel_epi64((__m128i*)(dstpV+(x>>2)), _mm_srli_si128(uv, 8));
+        }
+        srcpY += src_pitchY;
+        dstpY += dst_pitchY;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+}
+
+static inline void load8_rgb(const unsigned char *p, __m128 &lo, __m128 &hi)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i w = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)p), zero);
+    lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(w, zero));
+    hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(w, zero));
+}
+
+static inline void load8_rgb(const unsigned short *p, __m128 &lo, __m128 &hi)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i w = _mm_load_si128((const __m128i*)p);
+    lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(w, zero));
+    hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(w, zero));
+}
+
+// Integer output is clamped to 0-(max+0.5) with the 0.5 already in the 
+// offset, so truncation rounds and packssdw never saturates (RGB48 is 
+// moved down by 32768 for it).
+static inline void store8_rgb(unsigned char *p, const __m128 &lo, const __m128 &hi)
+{
+    const __m128i w = _mm_packs_epi32(_mm_cvttps_epi32(lo), _mm_cvttps_epi32(hi));
+    _mm_storel_epi64((__m128i*)p, _mm_packus_epi16(w, w));
+}
+
+static inline void store8_rgb(unsigned short *p, const __m128 &lo, const __m128 &hi)
+{
+    const __m128i k = _mm_set1_epi32(32768);
+    const __m128i w = _mm_packs_epi32(_mm_sub_epi32(_mm_cvttps_epi32(lo), k), 
+        _mm_sub_epi32(_mm_cvttps_epi32(hi), k));
+    _mm_store_si128((__m128i*)p, _mm_xor_si128(w, _mm_set1_epi16((short)0x8000)));
+}
+
+static inline void store8_rgb(float *p, const __m128 &lo, const __m128 &hi)
+{
+    _mm_store_ps(p, lo);
+    _mm_store_ps(p+4, hi);
+}
+
+// R, G, and B of 4 pixels in the same order as rgb_px_C.
+static inline void rgb4_SSE2(const CFS *cs, __m128 y, const __m128 &u, const __m128 &v, __m128 o[3])
+{
+    const __m128 *k = cs->rcv, *clip = cs->rclipv;
+    y = _mm_min_ps(_mm_max_ps(y, clip[0]), clip[1]);
+    for (int i=0; i<3; ++i)
+    {
+        const __m128 t = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(k[4*i], y), 
+            _mm_mul_ps(k[4*i+1], u)), _mm_mul_ps(k[4*i+2], v)), k[4*i+3]);
+        o[i] = _mm_min_ps(_mm_max_ps(t, clip[2]), clip[3]);
+    }
+}
+
+static inline __m128i load8_chroma(const unsigned char *p)
+{
+    return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)p), _mm_setzero_si128());
+}
+
+static inline __m128i load8_chroma(const unsigned short *p)
+{
+    return _mm_loadu_si128((const __m128i*)p);
+}
+
+// Same as rgb_chroma_row_C on 8 samples at a time.  The samples are 
+// centered and clamped as words, the 3:1 blend needs dwords at 16 bit.
+template <typename T, int SSH>
+static void rgb_chroma_row_SSE2(const T *pU, const T *pV, const T *nU, const T *nV, 
+    int cw, const CFS *cs, int *cu, int *cv)
+{
+    const __m128i half = cs->hhalf, lo = cs->hclip[2], hi = cs->hclip[3];
+    const T *p[2] = { pU, pV }, *n[2] = { nU, nV };
+    int *c[2] = { cu, cv };
+    for (int j=0; j<2; ++j)
+    {
+        for (int x=0; x<cw; x+=8)
+        {
+            const __m128i a = _mm_min_epi16(_mm_max_epi16(_mm_sub_epi16(load8_chroma(p[j]+x), half), lo), hi);
+            __m128i dlo = _mm_srai_epi32(_mm_unpacklo_epi16(a, a), 16);
+            __m128i dhi = _mm_srai_epi32(_mm_unpackhi_epi16(a, a), 16);
+            if (SSH)
+            {
+                const __m128i b = _mm_min_epi16(_mm_max_epi16(_mm_sub_epi16(load8_chroma(n[j]+x), half), lo), hi);
+                dlo = _mm_add_epi32(_mm_add_epi32(_mm_add_epi32(dlo, dlo), dlo), _mm_srai_epi32(_mm_unpacklo_epi16(b, b), 16));
+                dhi = _mm_add_epi32(_mm_add_epi32(_mm_add_epi32(dhi, dhi), dhi), _mm_srai_epi32(_mm_unpackhi_epi16(b, b), 16));
+            }
+            _mm_store_si128((__m128i*)(c[j]+x), dlo);
+            _mm_store_si128((__m128i*)(c[j]+x+4), dhi);
+        }
+        c[j][cw] = c[j][cw-1];
+    }
+}
+
+// Chroma of 8 luma pixels from the rows of rgb_chroma_row_SSE2, with the 
+// horizontal interpolation between cosited samples for SSW.
+template <int SSW>
+static inline void chroma8_rgb(const int *c, int x, __m128 &lo, __m128 &hi)
+{
+    if (SSW)
+    {
+        const __m128i a = _mm_load_si128((const __m128i*)(c+(x>>1)));
+        const __m128i e = _mm_add_epi32(a, a);
+        const __m128i o = _mm_add_epi32(a, _mm_loadu_si128((const __m128i*)(c+(x>>1)+1)));
+        lo = _mm_cvtepi32_ps(_mm_unpacklo_epi32(e, o));
+        hi = _mm_cvtepi32_ps(_mm_unpackhi_epi32(e, o));
+    }
+    else
+    {
+        lo = _mm_cvtepi32_ps(_mm_load_si128((const __m128i*)(c+x)));
+        hi = _mm_cvtepi32_ps(_mm_load_si128((const __m128i*)(c+x+4)));
+    }
+}
+
+// 8 bit 4:2:0/4:2:2/4:4:4 or 9-16 bit 4:2:0 (T) in, RGB24/RGB48/RGBS (D) 
+// out, same results as convr_YUVP_C.  Works on 8 pixels at a time in float.
+template <typename T, int SSW, int SSH, typename D>
+void convr_YUVP_SSE2(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const T *srcp = (const T*)pss->srcp;
+    const T *srcpU = (const T*)pss->srcpU;
+    const T *srcpV = (const T*)pss->srcpV;
+    D *dstpR = (D*)pss->dstp;
+    D *dstpG = (D*)pss->dstpU;
+    D *dstpB = (D*)pss->dstpV;
+    const int src_pitch = pss->src_pitch/sizeof(T);
+    const int src_pitchR = pss->src_pitchR/sizeof(T);
+    const int src_pitchUV = pss->src_pitchUV/sizeof(T);
+    const int src_pitchUVR = pss->src_pitchUVR/sizeof(T);
+    const int dst_pitch = pss->dst_pitch/sizeof(D);
+    const int dst_pitchR = pss->dst_pitchR/sizeof(D);
+    const int height = pss->height;
+    const int width = pss->width/sizeof(T);
+    const int cw = width>>SSW;
+    int *cu = pss->dith, *cv = cu+((width+31)&~31)+16;
+    for (int h=0; h<height; h+=1<<SSH)
+    {
+        const int line = pss->line0+(h>>SSH)*pss->linestep;
+        for (int r=0; r<(1<<SSH); ++r)
+        {
+            const int nl = SSH ? (std::min)((std::max)(line+(r ? 1 : -1), 0), pss->linesUV-1)-line : 0;
+            rgb_chroma_row_SSE2<T,SSH>(srcpU, srcpV, srcpU+nl*src_pitchUVR, srcpV+nl*src_pitchUVR, cw, cs, cu, cv);
+            const T *s = srcp+r*src_pitchR;
+            D *dr = dstpR+r*dst_pitchR, *dg = dstpG+r*dst_pitchR, *db = dstpB+r*dst_pitchR;
+            for (int x=0; x<width; x+=8)
+            {
+                __m128 y[2], u[2], v[2], lo[3], hi[3];
+                load8_rgb(s+x, y[0], y[1]);
+                chroma8_rgb<SSW>(cu, x, u[0], u[1]);
+                chroma8_rgb<SSW>(cv, x, v[0], v[1]);
+                rgb4_SSE2(cs, y[0], u[0], v[0], lo);
+                rgb4_SSE2(cs, y[1], u[1], v[1], hi);
+                store8_rgb(dr+x, lo[0], hi[0]);
+                store8_rgb(dg+x, lo[1], hi[1]);
+                store8_rgb(db+x, lo[2], hi[2]);
+            }
+        }
+        srcp += src_pitch<<SSH;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpR += dst_pitch<<SSH;
+        dstpG += dst_pitch<<SSH;
+        dstpB += dst_pitch<<SSH;
+    }
+}
+
+// Float 4:4:4 in, RGB24/RGB48/RGBS out, same results as 
+// convr_YUV444F_C<float>.
+template <typename D>
+void convr_YUV444PS_SSE2(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const float *srcp = (const float*)pss->srcp;
+    const float *srcpU = (const float*)pss->srcpU;
+    const float *srcpV = (const float*)pss->srcpV;
+    D *dstpR = (D*)pss->dstp;
+    D *dstpG = (D*)pss->dstpU;
+    D *dstpB = (D*)pss->dstpV;
+    const int src_pitch = pss->src_pitch/sizeof(float);
+    const int src_pitchUV = pss->src_pitchUV/sizeof(float);
+    const int dst_pitch = pss->dst_pitch/sizeof(D);
+    const int height = pss->height;
+    const int width = pss->width/sizeof(float);
+    const __m128 *clip = cs->fclipv;
+    for (int h=0; h<height; ++h)
+    {
+        for (int x=0; x<width; x+=8)
+        {
+            __m128 o[2][3];
+            for (int i=0; i<2; ++i)
+            {
+                const __m128 u = _mm_min_ps(_mm_max_ps(_mm_load_ps(srcpU+x+4*i), clip[2]), clip[3]);
+                const __m128 v = _mm_min_ps(_mm_max_ps(_mm_load_ps(srcpV+x+4*i), clip[2]), clip[3]);
+                rgb4_SSE2(cs, _mm_load_ps(srcp+x+4*i), u, v, o[i]);
+            }
+            store8_rgb(dstpR+x, o[0][0], o[1][0]);
+            store8_rgb(dstpG+x, o[0][1], o[1][1]);
+            store8_rgb(dstpB+x, o[0][2], o[1][2]);
+        }
+        srcp += src_pitch;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpR += dst_pitch;
+        dstpG += dst_pitch;
+        dstpB += dst_pitch;
+    }
+}
+
+static inline void load8_rgb(const float *p, __m128 &lo, __m128 &hi)
+{
+    lo = _mm_load_ps(p);
+    hi = _mm_load_ps(p+4);
+}
+
+static inline void store4_rgb(unsigned char *p, const __m128 &v)
+{
+    const __m128i w = _mm_packs_epi32(_mm_cvttps_epi32(v), _mm_setzero_si128());
+    *(int*)p = _mm_cvtsi128_si32(_mm_packus_epi16(w, w));
+}
+
+static inline void store4_rgb(unsigned short *p, const __m128 &v)
+{
+    const __m128i w = _mm_packs_epi32(_mm_sub_epi32(_mm_cvttps_epi32(v), _mm_set1_epi32(32768)), 
+        _mm_setzero_si128());
+    _mm_storel_epi64((__m128i*)p, _mm_xor_si128(w, _mm_set1_epi16((short)0x8000)));
+}
+
+static inline void store4_rgb(float *p, const __m128 &v)
+{
+    _mm_store_ps(p, v);
+}
+
+// One row of rc/rclip on 4 pixels, in the same order as yuv_px_C.
+static inline __m128 yuv4_SSE2(const __m128 *k, const __m128 *clip, const __m128 &r, 
+    const __m128 &g, const __m128 &b)
+{
+    const __m128 t = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(k[0], r), 
+        _mm_mul_ps(k[1], g)), _mm_mul_ps(k[2], b)), k[3]);
+    return _mm_min_ps(_mm_max_ps(t, clip[0]), clip[1]);
+}
+
+// 8-16 bit or float RGB (T) in, 4:2:0 (D) out, same results as convy_RGB_C.  
+// Works on 8x2 pixels at a time, the 2x2 sums are a vertical add followed 
+// by adding the even and odd lanes.
+template <typename T, typename D>
+void convy_RGB_SSE2(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const T *srcp[3] = { (const T*)pss->srcp, (const T*)pss->srcpU, (const T*)pss->srcpV };
+    D *dstp = (D*)pss->dstp;
+    D *dstpU = (D*)pss->dstpU;
+    D *dstpV = (D*)pss->dstpV;
+    const int src_pitch = pss->src_pitch/sizeof(T);
+    const int src_pitchR = pss->src_pitchR/sizeof(T);
+    const int dst_pitch = pss->dst_pitch/sizeof(D);
+    const int dst_pitchR = pss->dst_pitchR/sizeof(D);
+    const int dst_pitchUV = pss->dst_pitchUV/sizeof(D);
+    const int height = pss->height;
+    const int width = pss->width/sizeof(T);
+    const __m128 *k = cs->rcv, *clip = cs->rclipv, *fclip = cs->fclipv;
+    for (int h=0; h<height; h+=2)
+    {
+        for (int x=0; x<width; x+=8)
+        {
+            // p[plane][row][half]
+            __m128 p[3][2][2], sum[3];
+            for (int c=0; c<3; ++c)
+            {
+                for (int r=0; r<2; ++r)
+                {
+                    load8_rgb(srcp[c]+r*src_pitchR+x, p[c][r][0], p[c][r][1]);
+                    for (int i=0; i<2; ++i)
+                        p[c][r][i] = _mm_min_ps(_mm_max_ps(p[c][r][i], fclip[0]), fclip[1]);
+                }
+                const __m128 lo = _mm_add_ps(p[c][0][0], p[c][1][0]);
+                const __m128 hi = _mm_add_ps(p[c][0][1], p[c][1][1]);
+                sum[c] = _mm_add_ps(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2,0,2,0)), 
+                    _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3,1,3,1)));
+            }
+            for (int r=0; r<2; ++r)
+            {
+                store8_rgb(dstp+r*dst_pitchR+x, 
+                    yuv4_SSE2(k, clip, p[0][r][0], p[1][r][0], p[2][r][0]), 
+                    yuv4_SSE2(k, clip, p[0][r][1], p[1][r][1], p[2][r][1]));
+            }
+            store4_rgb(dstpU+(x>>1), yuv4_SSE2(k+4, clip+2, sum[0], sum[1], sum[2]));
+            store4_rgb(dstpV+(x>>1), yuv4_SSE2(k+8, clip+2, sum[0], sum[1], sum[2]));
+        }
+        for (int c=0; c<3; ++c)
+            srcp[c] += src_pitch<<1;
+        dstp += dst_pitch<<1;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+}
+
+static inline void store8_u16(unsigned short *p, const __m128i &lo, const __m128i &hi)
+{
+    const __m128i k = _mm_set1_epi32(32768);
+    const __m128i w = _mm_packs_epi32(_mm_sub_epi32(lo, k), _mm_sub_epi32(hi, k));
+    _mm_store_si128((__m128i*)p, _mm_xor_si128(w, _mm_set1_epi16((short)0x8000)));
+}
+
+// 8-16 bit YUV 4:4:4 (T) in, YCoCg out, same results as convc_YUV444_C.  
+// The RGB from rgb4_SSE2 is truncated to dwords and lifted there.
+template <typename T>
+void convc_YUV444_SSE2(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const T *srcp = (const T*)pss->srcp;
+    const T *srcpU = (const T*)pss->srcpU;
+    const T *srcpV = (const T*)pss->srcpV;
+    unsigned short *dstp = (unsigned short*)pss->dstp;
+    unsigned short *dstpCo = (unsigned short*)pss->dstpU;
+    unsigned short *dstpCg = (unsigned short*)pss->dstpV;
+    const int src_pitch = pss->src_pitch/sizeof(T);
+    const int src_pitchUV = pss->src_pitchUV/sizeof(T);
+    const int dst_pitch = pss->dst_pitch/sizeof(unsigned short);
+    const int dst_pitchUV = pss->dst_pitchUV/sizeof(unsigned short);
+    const int height = pss->height;
+    const int width = pss->width/sizeof(T);
+    const __m128i half = cs->hhalf, lo = cs->hclip[2], hi = cs->hclip[3];
+    const __m128i cbias = _mm_set1_epi32(1<<cs->rgb);
+    for (int h=0; h<height; ++h)
+    {
+        for (int x=0; x<width; x+=8)
+        {
+            __m128 y[2];
+            load8_rgb(srcp+x, y[0], y[1]);
+            const __m128i u = _mm_min_epi16(_mm_max_epi16(_mm_sub_epi16(load8_chroma(srcpU+x), half), lo), hi);
+            const __m128i v = _mm_min_epi16(_mm_max_epi16(_mm_sub_epi16(load8_chroma(srcpV+x), half), lo), hi);
+            __m128i oy[2], oco[2], ocg[2];
+            for (int i=0; i<2; ++i)
+            {
+                const __m128 uf = _mm_cvtepi32_ps(_mm_srai_epi32(i ? _mm_unpackhi_epi16(u, u) : _mm_unpacklo_epi16(u, u), 16));
+                const __m128 vf = _mm_cvtepi32_ps(_mm_srai_epi32(i ? _mm_unpackhi_epi16(v, v) : _mm_unpacklo_epi16(v, v), 16));
+                __m128 o[3];
+                rgb4_SSE2(cs, y[i], uf, vf, o);
+                const __m128i r = _mm_cvttps_epi32(o[0]), g = _mm_cvttps_epi32(o[1]), b = _mm_cvttps_epi32(o[2]);
+                const __m128i co = _mm_sub_epi32(r, b);
+                const __m128i t = _mm_add_epi32(b, _mm_srai_epi32(co, 1));
+                const __m128i cg = _mm_sub_epi32(g, t);
+                oy[i] = _mm_add_epi32(t, _mm_srai_epi32(cg, 1));
+                oco[i] = _mm_add_epi32(co, cbias);
+                ocg[i] = _mm_add_epi32(cg, cbias);
+            }
+            store8_u16(dstp+x, oy[0], oy[1]);
+            store8_u16(dstpCo+x, oco[0], oco[1]);
+            store8_u16(dstpCg+x, ocg[0], ocg[1]);
+        }
+        srcp += src_pitch;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstp += dst_pitch;
+        dstpCo += dst_pitchUV;
+        dstpCg += dst_pitchUV;
+    }
+}
+
+// YCoCg in, 8-16 bit YUV 4:4:4 (D) out, same results as convc_YCoCg_C.
+template <typename D>
+void convc_YCoCg_SSE2(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned short *srcp = (const unsigned short*)pss->srcp;
+    const unsigned short *srcpCo = (const unsigned short*)pss->srcpU;
+    const unsigned short *srcpCg = (const unsigned short*)pss->srcpV;
+    D *dstp = (D*)pss->dstp;
+    D *dstpU = (D*)pss->dstpU;
+    D *dstpV = (D*)pss->dstpV;
+    const int src_pitch = pss->src_pitch/sizeof(unsigned short);
+    const int src_pitchUV = pss->src_pitchUV/sizeof(unsigned short);
+    const int dst_pitch = pss->dst_pitch/sizeof(D);
+    const int dst_pitchUV = pss->dst_pitchUV/sizeof(D);
+    const int height = pss->height;
+    const int width = pss->width/sizeof(unsigned short);
+    const __m128 *k = cs->rcv, *clip = cs->rclipv, *fclip = cs->fclipv;
+    const __m128i zero = _mm_setzero_si128(), cbias = _mm_set1_epi32(1<<cs->rgbin);
+    for (int h=0; h<height; ++h)
+    {
+        for (int x=0; x<width; x+=8)
+        {
+            const __m128i y = _mm_load_si128((const __m128i*)(srcp+x));
+            const __m128i co = _mm_load_si128((const __m128i*)(srcpCo+x));
+            const __m128i cg = _mm_load_si128((const __m128i*)(srcpCg+x));
+            __m128 o[3][2];
+            for (int i=0; i<2; ++i)
+            {
+                const __m128i yd = i ? _mm_unpackhi_epi16(y, zero) : _mm_unpacklo_epi16(y, zero);
+                const __m128i cod = _mm_sub_epi32(i ? _mm_unpackhi_epi16(co, zero) : _mm_unpacklo_epi16(co, zero), cbias);
+                const __m128i cgd = _mm_sub_epi32(i ? _mm_unpackhi_epi16(cg, zero) : _mm_unpacklo_epi16(cg, zero), cbias);
+                const __m128i t = _mm_sub_epi32(yd, _mm_srai_epi32(cgd, 1));
+                const __m128i g = _mm_add_epi32(cgd, t);
+                const __m128i b = _mm_sub_epi32(t, _mm_srai_epi32(cod, 1));
+                const __m128i r = _mm_add_epi32(b, cod);
+                const __m128 rf = _mm_min_ps(_mm_max_ps(_mm_cvtepi32_ps(r), fclip[0]), fclip[1]);
+                const __m128 gf = _mm_min_ps(_mm_max_ps(_mm_cvtepi32_ps(g), fclip[0]), fclip[1]);
+                const __m128 bf = _mm_min_ps(_mm_max_ps(_mm_cvtepi32_ps(b), fclip[0]), fclip[1]);
+                o[0][i] = yuv4_SSE2(k, clip, rf, gf, bf);
+                o[1][i] = yuv4_SSE2(k+4, clip+2, rf, gf, bf);
+                o[2][i] = yuv4_SSE2(k+8, clip+2, rf, gf, bf);
+            }
+            store8_rgb(dstp+x, o[0][0], o[0][1]);
+            store8_rgb(dstpU+x, o[1][0], o[1][1]);
+            store8_rgb(dstpV+x, o[2][0], o[2][1]);
+        }
+        srcp += src_pitch;
+        srcpCo += src_pitchUV;
+        srcpCg += src_pitchUV;
+        dstp += dst_pitch;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+}
+
+#ifdef CM_AVX2
+static inline __m256 load8f(const float *p) { return _mm256_load_ps(p); }
+static inline __m256 load8f(const unsigned short *p) { return _mm256_cvtph_ps(_mm_load_si128((const __m128i*)p)); }
+static inline void store8f(float *p, const __m256 &v) { _mm256_store_ps(p, v); }
+static inline void store8f(unsigned short *p, const __m256 &v) { _mm_store_si128((__m128i*)p, _mm256_cvtps_ph(v, 0)); }
+
+// Float (T=float) and half (T=unsigned short, f16c) 4:4:4 on 8 pixels at a 
+// time.  The fused multiply-adds round once per chain, so the results can 
+// differ from conv_YUV444F_C in the last bit.
+template <typename T, bool CLAMP>
+void conv_YUV444F_AVX2(void *ps)
+{
+    const PS_INFO *pss = (PS_INFO*)ps;
+    const CFS *cs = pss->cs;
+    const unsigned char *srcpY = pss->srcp;
+    const unsigned char *srcpU = pss->srcpU;
+    const unsigned char *srcpV = pss->srcpV;
+    const int src_pitchY = pss->src_pitch;
+    const int src_pitchUV = pss->src_pitchUV;
+    unsigned char *dstpY = pss->dstp;
+    unsigned char *dstpU = pss->dstpU;
+    unsigned char *dstpV = pss->dstpV;
+    const int dst_pitchY = pss->dst_pitch;
+    const int dst_pitchUV = pss->dst_pitchUV;
+    const int width = pss->widtha;
+    const int height = pss->height;
+    const __m256 c1 = _mm256_broadcast_ps(&cs->fv[0]), c2 = _mm256_broadcast_ps(&cs->fv[1]);
+    const __m256 c3 = _mm256_broadcast_ps(&cs->fv[2]), c4 = _mm256_broadcast_ps(&cs->fv[3]);
+    const __m256 c5 = _mm256_broadcast_ps(&cs->fv[4]), c6 = _mm256_broadcast_ps(&cs->fv[5]);
+    const __m256 c7 = _mm256_broadcast_ps(&cs->fv[6]), bias_Y = _mm256_broadcast_ps(&cs->fv[7]);
+    __m256 clip[8];
+    for (int i=0; i<8; ++i)
+        clip[i] = _mm256_broadcast_ps(&cs->fclipv[i]);
+    for (int h=0; h<height; ++h)
+    {
+        for (int x=0; x<width; x+=8*sizeof(T))
+        {
+            __m256 y = load8f((const T*)(srcpY+x));
+            __m256 u = load8f((const T*)(srcpU+x));
+            __m256 v = load8f((const T*)(srcpV+x));
+            if (CLAMP)
+            {
+                y = _mm256_min_ps(_mm256_max_ps(y, clip[0]), clip[1]);
+                u = _mm256_min_ps(_mm256_max_ps(u, clip[2]), clip[3]);
+                v = _mm256_min_ps(_mm256_max_ps(v, clip[2]), clip[3]);
+            }
+            __m256 ny = _mm256_fmadd_ps(c1, y, _mm256_fmadd_ps(c2, u, _mm256_fmadd_ps(c3, v, bias_Y)));
+            __m256 nu = _mm256_fmadd_ps(c4, u, _mm256_mul_ps(c5, v));
+            __m256 nv = _mm256_fmadd_ps(c6, u, _mm256_mul_ps(c7, v));
+            if (CLAMP)
+            {
+                ny = _mm256_min_ps(_mm256_max_ps(ny, clip[4]), clip[5]);
+                nu = _mm256_min_ps(_mm256_max_ps(nu, clip[6]), clip[7]);
+                nv = _mm256_min_ps(_mm256_max_ps(nv, clip[6]), clip[7]);
+            }
+            store8f((T*)(dstpY+x), ny);
+            store8f((T*)(dstpU+x), nu);
+            store8f((T*)(dstpV+x), nv);
+        }
+        srcpY += src_pitchY;
+        dstpY += dst_pitchY;
+        srcpU += src_pitchUV;
+        srcpV += src_pitchUV;
+        dstpU += dst_pitchUV;
+        dstpV += dst_pitchUV;
+    }
+    _mm256_zeroupper();
+}
+#endif
+
+// Broadcasts the simd constants of every kernel family for the coefficients 
+// already in cs.
+void init_simd_constants(CFS *cs)
+{
+    if (cs->rgb || cs->rgbin)
+    {
+        for (int i=0; i<12; ++i)
+            cs->rcv[i] = _mm_set1_ps(cs->rc[i]);
+        for (int i=0; i<4; ++i)
+        {
+            cs->rclipv[i] = _mm_set1_ps(cs->rclip[i]);
+            cs->fclipv[i] = _mm_set1_ps(cs->fclip[i]);
+        }
+        if (cs->rgb && !cs->fp)
+        {
+            // integer chroma is clamped on the centered words like the 9-16 bit kernels
+            const int half = 1<<(cs->bits-1);
+            cs->hhalf = _mm_set1_epi16((short)half);
+            cs->hclip[2] = _mm_set1_epi16((short)(cs->inmin[1]-half));
+            cs->hclip[3] = _mm_set1_epi16((short)(cs->inmax[1]-half));
+        }
+        return;
+    }
+    for (int i=0; cs->nshift && i<2; ++i)
+    {
+        cs->nclip[2*i] = _mm_set1_epi16((short)cs->outmin[i]);
+        cs->nclip[2*i+1] = _mm_set1_epi16((short)cs->outmax[i]);
+    }
+    if (cs->fp)
+    {
+        for (int i=0; i<8; ++i)
+        {
+            cs->fv[i] = _mm_set1_ps(cs->fc[i]);
+            cs->fclipv[i] = _mm_set1_ps(cs->fclip[i]);
+        }
+        return;
+    }
+    if (cs->bits > 8)
+    {
+        const int half = 1<<(cs->bits-1);
+        if (cs->hshift > 14)
+        {
+            // wc8 and cuv are already for centered y and output, see load_coefficients
+            getsse2w(cs->c2, cs->c3, cs->hq[0], cs->hlo[0]);
+            getsse2w(cs->c4, cs->c5, cs->hq[1], cs->hlo[1]);
+            getsse2w(cs->c6, cs->c7, cs->hq[2], cs->hlo[2]);
+            getsse2w(cs->c1, 0, cs->hq[3], cs->hlo[3]);
+            cs->hbias_Y = _mm_set1_epi32((int)(cs->wc8>>12));
+            cs->hlbias_Y = _mm_set1_epi32((int)(cs->wc8&0xFFF));
+            cs->hbias_UV = _mm_set1_epi32(cs->cuv>>12);
+            cs->hlbias_UV = _mm_set1_epi32(cs->cuv&0xFFF);
+        }
+        else
+        {
+            cs->hq[0] = _mm_set1_epi32((cs->c2&0xFFFF) | (cs->c3<<16));
+            cs->hq[1] = _mm_set1_epi32((cs->c4&0xFFFF) | (cs->c5<<16));
+            cs->hq[2] = _mm_set1_epi32((cs->c6&0xFFFF) | (cs->c7<<16));
+            cs->hq[3] = _mm_set1_epi32(cs->c1&0xFFFF);
+            // y is centered on half too and the result comes out less half
+            cs->hbias_Y = _mm_set1_epi32(cs->c8 + cs->c1*half - (half<<cs->hshift));
+            cs->hbias_UV = _mm_set1_epi32(cs->cuv - (half<<cs->hshift));
+        }
+        cs->hhalf = _mm_set1_epi16((short)half);
+        for (int i=0; i<2; ++i)
+        {
+            cs->hclip[2*i] = _mm_set1_epi16((short)(cs->inmin[i]-half));
+            cs->hclip[2*i+1] = _mm_set1_epi16((short)(cs->inmax[i]-half));
+            cs->hclip[4+2*i] = _mm_set1_epi16((short)(cs->outmin[i]-half));
+            cs->hclip[5+2*i] = _mm_set1_epi16((short)(cs->outmax[i]-half));
+        }
+        return;
+    }
+    const int c[6] = { cs->c2, cs->c3, cs->c4, cs->c5, cs->c6, cs->c7 };
+    for (int i=0; i<6; ++i)
+    {
+        const int a = abs(c[i]);
+        const int w = simd_scale(a);
+        cs->sse2v[i] = _mm_set1_epi16((short)w);
+        cs->mmxv[i] = w*0x0001000100010001LL;
+        getsse2c(c[i], cs->fact[i], cs->shift[i]);
+    }
+    cs->fact_YY = _mm_set1_epi16((short)((cs->c1+2)>>2)); // used with pmulhuw on Y*256
+    cs->bias_Y = _mm_set1_epi16((short)((cs->c8+512)>>10));
+    getsse2p(cs->c2, cs->c3, cs->xhi[0], cs->xlo[0]);
+    getsse2p(cs->c4, cs->c5, cs->xhi[1], cs->xlo[1]);
+    getsse2p(cs->c6, cs->c7, cs->xhi[2], cs->xlo[2]);
+    getsse2p(cs->c1, 0, cs->xhi[3], cs->xlo[3]);
+    cs->xbias_Y = _mm_set1_epi32(cs->c8);
+    cs->approxFits = getssse3p(cs->c2, cs->c3, 0, cs->aq[0], cs->abias[0], cs->ak[0]);
+    cs->approxFits &= getssse3p(cs->c4-65536, cs->c5, 8, cs->aq[1], cs->abias[1], cs->ak[1]);
+    cs->approxFits &= getssse3p(cs->c6, cs->c7-65536, 8, cs->aq[2], cs->abias[2], cs->ak[2]);
+    cs->afact_YY = _mm_set1_epi16((short)((cs->c1+8)>>4)); // used with pmulhrsw on Y*128
+    cs->abias_Y = _mm_set1_epi16((short)((cs->c8+2048)>>12));
+    if (cs->dshift)
+    {
+        cs->dbias[0] = _mm_set1_epi32(cs->c8 - (32768<<cs->dshift));
+        cs->dbias[1] = _mm_set1_epi32(cs->cuv - (32768<<cs->dshift));
+        for (int i=0; i<2; ++i)
+        {
+            cs->dclip[2*i] = _mm_set1_epi16((short)(cs->outmin[i]-32768));
+            cs->dclip[2*i+1] = _mm_set1_epi16((short)(cs->outmax[i]-32768));
+        }
+    }
+}
+
+// neutral_chroma_C with 16 samples per step, the rows are aligned like the 
+// kernel inputs.
+bool neutral_chroma_SSE2(const unsigned char *srcp, int pitch, int width, int height)
+{
+    const __m128i q128 = _mm_set1_epi8((char)128);
+    const __m128i zero = _mm_setzero_si128();
+    const int widtha = width&~15;
+    for (int y=0; y<height; ++y)
+    {
+        __m128i d = zero;
+        for (int x=0; x<widtha; x+=16)
+            d = _mm_or_si128(d, _mm_xor_si128(_mm_load_si128((const __m128i*)(srcp+x)), q128));
+        int t = 0;
+        for (int x=widtha; x<width; ++x)
+            t |= srcp[x]^128;
+        if (t || _mm_movemask_epi8(_mm_cmpeq_epi8(d, zero)) != 0xFFFF)
+            return false;
+        srcp += pitch;
+    }
+    return true;
+}
+
+// hash_plane_C with both lanes in one register, pmuludq takes the low dwords 
+// so the high halves are shifted down first.
+static inline __m128i hash_block_SSE2(__m128i a, __m128i d, int k)
+{
+    const __m128i dk = _mm_xor_si128(d, _mm_load_si128((const __m128i*)(hash_secret+2*k)));
+    a = _mm_add_epi64(a, _mm_mul_epu32(dk, _mm_srli_epi64(dk, 32)));
+    return _mm_add_epi64(a, _mm_shuffle_epi32(d, 0x4E));
+}
+
+void hash_plane_SSE2(const unsigned char *srcp, int pitch, int width, int height, uint64_t acc[2])
+{
+    __m128i a = _mm_loadu_si128((const __m128i*)acc);
+    const int widtha = width&~15;
+    for (int y=0; y<height; ++y)
+    {
+        for (int x=0; x<widtha; x+=16)
+            a = hash_block_SSE2(a, _mm_load_si128((const __m128i*)(srcp+x)), ((x>>4)+y)&7);
+        if (widtha < width)
+        {
+            __declspec(align(16)) unsigned char t[16] = { 0 };
+            memcpy(t, srcp+widtha, width-widtha);
+            a = hash_block_SSE2(a, _mm_load_si128((const __m128i*)t), ((widtha>>4)+y)&7);
+        }
+        srcp += pitch;
+    }
+    _mm_storeu_si128((__m128i*)acc, a);
+}
+
+template void conv_YV12_SSE2<false,false>(void *ps);
+template void conv_YV12_SSE2<false,true>(void *ps);
+template void conv_YV12_SSE2<true,false>(void *ps);
+template void conv_YV12_SSE2<true,true>(void *ps);
+template void convx_YV12_SSE2<false,0,false>(void *ps);
+template void convx_YV12_SSE2<false,0,true>(void *ps);
+template void convx_YV12_SSE2<true,0,false>(void *ps);
+template void convx_YV12_SSE2<true,0,true>(void *ps);
+template void convx_YV12_SSE2<false,1,false>(void *ps);
+template void convx_YV12_SSE2<false,1,true>(void *ps);
+template void convx_YV12_SSE2<true,1,false>(void *ps);
+template void convx_YV12_SSE2<true,1,true>(void *ps);
+template void conv_YUY2_SSE2<false,false>(void *ps);
+template void conv_YUY2_SSE2<false,true>(void *ps);
+template void conv_YUY2_SSE2<true,false>(void *ps);
+template void conv_YUY2_SSE2<true,true>(void *ps);
+template void convx_YUVP8_SSE2<0,false>(void *ps);
+template void convx_YUVP8_SSE2<0,true>(void *ps);
+template void convx_YUVP8_SSE2<1,false>(void *ps);
+template void convx_YUVP8_SSE2<1,true>(void *ps);
+template void convx_YUVP8_SSE2<2,false>(void *ps);
+template void convx_YUVP8_SSE2<2,true>(void *ps);
+template void convl_YUVP8_SSE2<0,0,false>(void *ps);
+template void convl_YUVP8_SSE2<0,0,true>(void *ps);
+template void convl_YUVP8_SSE2<1,0,false>(void *ps);
+template void convl_YUVP8_SSE2<1,0,true>(void *ps);
+template void convl_YUVP8_SSE2<1,1,false>(void *ps);
+template void convl_YUVP8_SSE2<1,1,true>(void *ps);
+template void convl_YUVP8_SSE2<2,0,false>(void *ps);
+template void convl_YUVP8_SSE2<2,0,true>(void *ps);
+template void conv_YUV420P16_SSE2<false,0>(void *ps);
+template void conv_YUV420P16_SSE2<true,0>(void *ps);
+template void conv_YUV420P16_SSE2<false,1>(void *ps);
+template void conv_YUV420P16_SSE2<true,1>(void *ps);
+template void conv_YUV420P16W_SSE2<0>(void *ps);
+template void conv_YUV420P16W_SSE2<1>(void *ps);
+template void conva_YV12_SSSE3<false,false>(void *ps);
+template void conva_YV12_SSSE3<false,true>(void *ps);
+template void conva_YV12_SSSE3<true,false>(void *ps);
+template void conva_YV12_SSSE3<true,true>(void *ps);
+template void convd_YUVP8_SSE2<0,0>(void *ps);
+template void convd_YUVP8_SSE2<1,0>(void *ps);
+template void convd_YUVP8_SSE2<1,1>(void *ps);
+template void conv_YUV444PS_SSE2<false>(void *ps);
+template void conv_YUV444PS_SSE2<true>(void *ps);
+template void convn_YUV420P16_SSE2<false>(void *ps);
+template void convn_YUV420P16_SSE2<true>(void *ps);
+template void convn_YUV444PS_SSE2<false>(void *ps);
+template void convn_YUV444PS_SSE2<true>(void *ps);
+template void convr_YUVP_SSE2<unsigned char,0,0,unsigned char>(void *ps);
+template void convr_YUVP_SSE2<unsigned char,0,0,unsigned short>(void *ps);
+template void convr_YUVP_SSE2<unsigned char,0,0,float>(void *ps);
+template void convr_YUVP_SSE2<unsigned char,1,0,unsigned char>(void *ps);
+template void convr_YUVP_SSE2<unsigned char,1,0,unsigned short>(void *ps);
+template void convr_YUVP_SSE2<unsigned char,1,0,float>(void *ps);
+template void convr_YUVP_SSE2<unsigned char,1,1,unsigned char>(void *ps);
+template void convr_YUVP_SSE2<unsigned char,1,1,unsigned short>(void *ps);
+template void convr_YUVP_SSE2<unsigned char,1,1,float>(void *ps);
+template void convr_YUVP_SSE2<unsigned short,1,1,unsigned char>(void *ps);
+template void convr_YUVP_SSE2<unsigned short,1,1,unsigned short>(void *ps);
+template void convr_YUVP_SSE2<unsigned short,1,1,float>(void *ps);
+template void convr_YUV444PS_SSE2<unsigned char>(void *ps);
+template void convr_YUV444PS_SSE2<unsigned short>(void *ps);
+template void convr_YUV444PS_SSE2<float>(void *ps);
+template void convy_RGB_SSE2<unsigned char,unsigned char>(void *ps);
+template void convy_RGB_SSE2<unsigned char,unsigned short>(void *ps);
+template void convy_RGB_SSE2<unsigned char,float>(void *ps);
+template void convy_RGB_SSE2<unsigned short,unsigned char>(void *ps);
+template void convy_RGB_SSE2<unsigned short,unsigned short>(void *ps);
+template void convy_RGB_SSE2<unsigned short,float>(void *ps);
+template void convy_RGB_SSE2<float,unsigned char>(void *ps);
+template void convy_RGB_SSE2<float,unsigned short>(void *ps);
+template void convy_RGB_SSE2<float,float>(void *ps);
+template void convc_YUV444_SSE2<unsigned char>(void *ps);
+template void convc_YUV444_SSE2<unsigned short>(void *ps);
+template void convc_YCoCg_SSE2<unsigned char>(void *ps);
+template void convc_YCoCg_SSE2<unsigned short>(void *ps);
+#ifdef CM_AVX2
+template void conva_YV12_AVX2<false,false>(void *ps);
+template void conva_YV12_AVX2<false,true>(void *ps);
+template void conva_YV12_AVX2<true,false>(void *ps);
+template void conva_YV12_AVX2<true,true>(void *ps);
+template void conv_YUV444F_AVX2<float,false>(void *ps);
+template void conv_YUV444F_AVX2<float,true>(void *ps);
+template void conv_YUV444F_AVX2<unsigned short,false>(void *ps);
+template void conv_YUV444F_AVX2<unsigned short,true>(void *ps);
+#endif